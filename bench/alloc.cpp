@@ -0,0 +1,90 @@
+#include "alloc.h"
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+thread_local bool armed = false;
+thread_local bool inside = false; // In an operator new, which mallocs.
+thread_local unsigned long count = 0;
+
+void *counted_new(std::size_t size) noexcept {
+  if (armed) {
+    ++count;
+  }
+  inside = true;
+  void *ptr = std::malloc(size ? size : 1);
+  inside = false;
+  return ptr;
+}
+
+} // namespace
+
+namespace Alloc {
+
+void arm() {
+  count = 0;
+  armed = true;
+}
+
+unsigned long disarm() {
+  armed = false;
+  return count;
+}
+
+} // namespace Alloc
+
+void *operator new(std::size_t size) {
+  if (void *ptr = counted_new(size))
+    return ptr;
+  throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size) {
+  if (void *ptr = counted_new(size))
+    return ptr;
+  throw std::bad_alloc();
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+  return counted_new(size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+  return counted_new(size);
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete[](void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, std::size_t) noexcept { std::free(ptr); }
+
+#ifdef __GLIBC__
+// C code, such as libxcb, allocates with malloc directly.
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size) {
+  if (armed && !inside) {
+    ++count;
+  }
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+  if (armed) {
+    ++count;
+  }
+  return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+  if (armed) {
+    ++count;
+  }
+  return __libc_realloc(ptr, size);
+}
+}
+#endif
@@ -0,0 +1,27 @@
+#ifndef ALLOC_H
+#define ALLOC_H
+
+/**
+ * @brief Counts the heap allocations of one thread, through a replacement
+ * operator new and, on glibc, malloc, calloc and realloc.
+ *
+ * Only linked into helios-churn when built with -Dalloc_check=true, since
+ * replacing the allocator slows every allocation of the process down.
+ */
+namespace Alloc {
+
+/**
+ * @brief Starts counting the allocations of the calling thread.
+ */
+void arm();
+
+/**
+ * @brief Stops counting.
+ *
+ * @return The allocations since arm().
+ */
+unsigned long disarm();
+
+} // namespace Alloc
+
+#endif
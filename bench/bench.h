@@ -0,0 +1,17 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "../src/include/config.h"
+
+/**
+ * @brief The config the benchmarks run with: the defaults of config.toml,
+ * without bindings or startup programs.
+ */
+inline Config bench_config() {
+  Config config;
+  config.border = {2, 0xffeb231, 0x483d8b, 20};
+  config.window.gap = 30;
+  return config;
+}
+
+#endif
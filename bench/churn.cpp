@@ -0,0 +1,160 @@
+#include "../src/include/helios.h"
+#include "bench.h"
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+
+#ifdef HELIOS_ALLOC_CHECK
+#include "alloc.h"
+#endif
+
+namespace {
+
+void usage() {
+  std::fprintf(stderr,
+               "Usage: helios-churn [--cycles N] [--windows K] "
+               "[--layout NAME] [--alloc-check]\n"
+               "\n"
+               "Maps, enters and destroys windows through the window manager "
+               "on a fake X\n"
+               "server, keeping K windows alive, and prints the cost per "
+               "cycle. --layout\n"
+               "tiles them with dwindle, master-stack, monocle or grid, "
+               "dwindle by default.\n"
+               "\n"
+               "--alloc-check counts the heap allocations of the window "
+               "manager once every\n"
+               "window was replaced, and fails if there are any. It needs "
+               "-Dalloc_check=true.\n");
+}
+
+} // namespace
+
+/**
+ * @brief The entry point of helios-churn.
+ *
+ * Each cycle maps a new window in one batch, then enters one of the live
+ * windows and destroys the oldest in another, so every cycle adopts, tiles,
+ * moves the focus and retiles.
+ *
+ * With --alloc-check, the cycles after the first K are also checked not to
+ * allocate while the window manager handles them. Only the window manager is
+ * counted, not the fake server queueing the events.
+ *
+ * @return 0 on success, 1 if the window manager lost track of a window or
+ * allocated, 2 on a usage error.
+ */
+int main(int argc, char **argv) {
+  unsigned long cycles = 1000000;
+  unsigned long windows = 16;
+  bool alloc_check = false;
+  Config config = bench_config();
+
+  for (int i = 1; i < argc; ++i) {
+    unsigned long *value = nullptr;
+    if (std::strcmp(argv[i], "--layout") == 0 && i + 1 < argc) {
+      Layout::Kind kind;
+      if (!Layout::parse_kind(argv[++i], kind)) {
+        usage();
+        return 2;
+      }
+      config.window.layouts = {argv[i]};
+      continue;
+    } else if (std::strcmp(argv[i], "--alloc-check") == 0) {
+#ifdef HELIOS_ALLOC_CHECK
+      alloc_check = true;
+      continue;
+#else
+      std::fprintf(stderr, "helios-churn: build with -Dalloc_check=true to "
+                           "use --alloc-check\n");
+      return 2;
+#endif
+    } else if (std::strcmp(argv[i], "--cycles") == 0) {
+      value = &cycles;
+    } else if (std::strcmp(argv[i], "--windows") == 0) {
+      value = &windows;
+    }
+    if (!value || ++i == argc) {
+      usage();
+      return 2;
+    }
+    char *end = nullptr;
+    *value = std::strtoul(argv[i], &end, 10);
+    if (*end != '\0' || *value == 0) {
+      usage();
+      return 2;
+    }
+  }
+
+  BasicWindowManager<FakeBackend> wm(config);
+  FakeBackend &server = wm.server();
+  std::deque<xcb_window_t> alive;
+  unsigned long allocations = 0;
+
+  // Handles the queued events, counting allocations once the window manager
+  // has replaced every window and its buffers have grown to fit.
+  auto process = [&](unsigned long cycle) {
+#ifdef HELIOS_ALLOC_CHECK
+    if (alloc_check && cycle >= windows) {
+      Alloc::arm();
+      wm.process_events();
+      allocations += Alloc::disarm();
+      return;
+    }
+#endif
+    (void)cycle;
+    wm.process_events();
+  };
+
+  auto map_one = [&](unsigned long cycle) {
+    xcb_window_t window = server.create_window();
+    server.inject_map_request(window);
+    alive.push_back(window);
+    process(cycle);
+  };
+
+  for (unsigned long i = 0; i < windows; ++i) {
+    map_one(0);
+  }
+  server.reset_counts();
+
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned long cycle = 0; cycle < cycles; ++cycle) {
+    map_one(cycle);
+    server.inject_enter_notify(alive[cycle % alive.size()]);
+    server.destroy_window(alive.front());
+    alive.pop_front();
+    process(cycle);
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  double ns = std::chrono::duration<double, std::nano>(elapsed).count();
+
+  std::printf("%lu cycles with %lu windows: %.0f ns/cycle\n", cycles, windows,
+              ns / double(cycles));
+  std::printf("requests/cycle: %.2f (configure %.2f, border %.2f, focus "
+              "%.2f), flushes/cycle: %.2f\n",
+              double(server.requests()) / double(cycles),
+              double(server.count(FakeBackend::CONFIGURE)) / double(cycles),
+              double(server.count(FakeBackend::BORDER_COLOR)) / double(cycles),
+              double(server.count(FakeBackend::FOCUS)) / double(cycles),
+              double(server.count(FakeBackend::FLUSH)) / double(cycles));
+
+  if (alloc_check) {
+    std::printf("allocations: %lu in %lu cycles\n", allocations,
+                cycles > windows ? cycles - windows : 0);
+    if (allocations) {
+      std::fprintf(stderr, "helios-churn: handling events allocated\n");
+      return 1;
+    }
+  }
+
+  if (wm.managed() != windows) {
+    std::fprintf(stderr, "helios-churn: %zu windows managed, expected %lu\n",
+                 wm.managed(), windows);
+    return 1;
+  }
+  return 0;
+}
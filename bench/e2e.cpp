@@ -0,0 +1,977 @@
+#include "../src/include/ipc.h"
+#include "../src/include/stats.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <poll.h>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+#include <xcb/record.h>
+#include <xcb/xcb.h>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+void usage() {
+  std::fprintf(
+      stderr,
+      "Usage: helios-e2e [--helios PATH] [--xvfb PATH] [--rounds N] "
+      "[--rate N] [--switch N]\n"
+      "                  [--json] [COUNT...]\n"
+      "\n"
+      "Starts helios on a new Xvfb, then maps, focuses and destroys COUNT "
+      "windows\n"
+      "(1, 10, 100 and 1000 by default) from a separate client, all at once "
+      "or N per\n"
+      "second with --rate, and prints the map to tile and enter to focus "
+      "latencies\n"
+      "and the requests helios sent. Then it fills two workspaces with N "
+      "windows each\n"
+      "(--switch, 50 by default, 0 to skip) and times the switches between "
+      "them.\n");
+}
+
+/**
+ * How long without a request from the window manager before it is taken to
+ * be done with what it was given.
+ */
+constexpr auto QUIET = std::chrono::milliseconds(50);
+
+/**
+ * How long to wait for anything before giving up.
+ */
+constexpr auto TIMEOUT = std::chrono::seconds(10);
+
+/**
+ * How many windows of a round the pointer is moved into.
+ */
+constexpr unsigned ENTERS = 100;
+
+/**
+ * How many times a round of the switch phase switches workspaces.
+ */
+constexpr unsigned SWITCHES = 10;
+
+/**
+ * The config helios runs with: that of the microbenchmarks, without startup
+ * programs, which would map windows of their own.
+ */
+constexpr const char *CONFIG = "[general]\n"
+                               "startup = []\n"
+                               "bindings = []\n"
+                               "\n"
+                               "[general.border]\n"
+                               "width = 2\n"
+                               "active_color = 0xffeb231\n"
+                               "inactive_color = 0x483D8B\n"
+                               "radius = 20\n"
+                               "\n"
+                               "[general.window]\n"
+                               "gap = 30\n";
+
+/**
+ * A child process, killed and reaped when it goes out of scope.
+ */
+class Child {
+public:
+  /**
+   * @param argv The program and its arguments.
+   * @param dir The directory to run it in, or nullptr.
+   * @param env An environment variable to set, as NAME=VALUE, or nullptr.
+   * @param keep An fd the child keeps, or -1.
+   * @param quiet Whether to send its output to /dev/null.
+   */
+  Child(std::vector<std::string> argv, const char *dir, const char *env,
+        int keep, bool quiet) {
+    pid = fork();
+    if (pid < 0)
+      throw std::runtime_error(std::string("fork: ") + std::strerror(errno));
+    if (pid > 0)
+      return;
+
+    if (quiet) {
+      int null = open("/dev/null", O_WRONLY);
+      dup2(null, STDOUT_FILENO);
+      dup2(null, STDERR_FILENO);
+    }
+    if (keep >= 0) {
+      fcntl(keep, F_SETFD, 0);
+    }
+    if ((dir && chdir(dir) != 0) || (env && putenv(const_cast<char *>(env)))) {
+      _exit(127);
+    }
+    std::vector<char *> args;
+    for (auto &arg : argv) {
+      args.push_back(arg.data());
+    }
+    args.push_back(nullptr);
+    execvp(args[0], args.data());
+    std::fprintf(stderr, "helios-e2e: unable to run %s: %s\n", args[0],
+                 std::strerror(errno));
+    _exit(127);
+  }
+
+  ~Child() {
+    if (running()) {
+      kill(pid, SIGTERM);
+      waitpid(pid, nullptr, 0);
+    }
+  }
+
+  Child(const Child &) = delete;
+  Child &operator=(const Child &) = delete;
+
+  bool running() { return waitpid(pid, nullptr, WNOHANG) == 0; }
+
+private:
+  pid_t pid;
+};
+
+/**
+ * Starts Xvfb on the first free display, as told by -displayfd.
+ *
+ * @return The display, such as ":1".
+ */
+std::string start_xvfb(const std::string &xvfb, std::unique_ptr<Child> &out) {
+  int fds[2];
+  if (pipe2(fds, O_CLOEXEC) != 0)
+    throw std::runtime_error(std::string("pipe: ") + std::strerror(errno));
+
+  out = std::make_unique<Child>(
+      std::vector<std::string>{xvfb, "-displayfd", std::to_string(fds[1]),
+                               "-screen", "0", "1920x1080x24", "-nolisten",
+                               "tcp", "-noreset"},
+      nullptr, nullptr, fds[1], true);
+  close(fds[1]);
+
+  std::string display = ":";
+  pollfd pfd = {fds[0], POLLIN, 0};
+  char c;
+  while (poll(&pfd, 1, 10000) > 0 && read(fds[0], &c, 1) == 1 && c != '\n') {
+    display += c;
+  }
+  close(fds[0]);
+  if (display.size() == 1)
+    throw std::runtime_error("Xvfb did not start");
+  return display;
+}
+
+/**
+ * Counts the requests of one client, seen through the RECORD extension on
+ * connections of its own.
+ */
+class RequestCounter {
+public:
+  RequestCounter(const std::string &display, uint32_t client_base)
+      : base(client_base) {
+    control = xcb_connect(display.c_str(), nullptr);
+    data = xcb_connect(display.c_str(), nullptr);
+    if (xcb_connection_has_error(control) || xcb_connection_has_error(data))
+      throw std::runtime_error("Unable to connect to " + display);
+
+    auto *ext = xcb_get_extension_data(control, &xcb_record_id);
+    if (!ext || !ext->present)
+      throw std::runtime_error("The X server lacks the RECORD extension");
+
+    context = xcb_generate_id(control);
+    xcb_record_range_t range = {};
+    range.core_requests.first = 1;
+    range.core_requests.last = 127;
+    range.ext_requests.major.first = 128;
+    range.ext_requests.major.last = 255;
+    range.ext_requests.minor.last = UINT16_MAX;
+    xcb_record_client_spec_t spec = XCB_RECORD_CS_ALL_CLIENTS;
+    auto *error = xcb_request_check(
+        control, xcb_record_create_context_checked(control, context, 0, 1, 1,
+                                                   &spec, &range));
+    if (error) {
+      free(error);
+      throw std::runtime_error("Unable to create a RECORD context");
+    }
+
+    reader = std::thread([this] { read_data(); });
+  }
+
+  ~RequestCounter() {
+    xcb_record_disable_context(control, context);
+    xcb_flush(control);
+    reader.join();
+    xcb_record_free_context(control, context);
+    xcb_disconnect(data);
+    xcb_disconnect(control);
+  }
+
+  uint64_t total() const { return requests.load(); }
+  uint64_t configures() const { return configure_requests.load(); }
+
+  /**
+   * @brief When the client last sent a request.
+   */
+  Clock::time_point last_request() const {
+    return Clock::time_point(Clock::duration(last.load()));
+  }
+
+private:
+  void read_data() {
+    auto cookie = xcb_record_enable_context(data, context);
+    while (auto *reply = xcb_record_enable_context_reply(data, cookie,
+                                                         nullptr)) {
+      bool done = reply->category == XCB_RECORD_CATEGORY_END_OF_DATA;
+      if (reply->category == XCB_RECORD_CATEGORY_FROM_CLIENT &&
+          reply->client_swapped == 0 && reply->xid_base == base) {
+        count(xcb_record_enable_context_data(reply),
+              xcb_record_enable_context_data_length(reply));
+      }
+      free(reply);
+      if (done)
+        break;
+    }
+  }
+
+  /**
+   * Walks the requests of a reply by their length fields.
+   */
+  void count(const uint8_t *bytes, int length) {
+    size_t size = static_cast<size_t>(length);
+    for (size_t pos = 0; pos + 4 <= size;) {
+      uint8_t opcode = bytes[pos];
+      uint32_t words;
+      uint16_t short_words;
+      std::memcpy(&short_words, bytes + pos + 2, sizeof(short_words));
+      words = short_words;
+      if (words == 0 && pos + 8 <= size) { // BIG-REQUESTS
+        std::memcpy(&words, bytes + pos + 4, sizeof(words));
+      }
+      if (words == 0)
+        break;
+
+      ++requests;
+      if (opcode == XCB_CONFIGURE_WINDOW) {
+        ++configure_requests;
+      }
+      pos += size_t(words) * 4;
+    }
+    last = Clock::now().time_since_epoch().count();
+  }
+
+  xcb_connection_t *control;
+  xcb_connection_t *data;
+  xcb_record_context_t context;
+  uint32_t base;
+  std::thread reader;
+  std::atomic<uint64_t> requests{0};
+  std::atomic<uint64_t> configure_requests{0};
+  std::atomic<Clock::rep> last{0};
+};
+
+/**
+ * A window of the test client, as the events it got describe it.
+ */
+struct Window {
+  Clock::time_point mapped_at;
+  Clock::time_point final_at; // The first ConfigureNotify with the geometry.
+  Clock::time_point tiled_at; // The first ConfigureNotify that moved it.
+  Clock::time_point shown_at; // The last MapNotify or Expose.
+  int16_t x = 0, y = 0;
+  uint16_t width = 0, height = 0;
+  bool mapped = false;
+};
+
+/**
+ * What one COUNT measured, over every round.
+ */
+struct Totals {
+  Histogram map_to_tile;
+  Histogram enter_to_focus;
+  uint64_t enter_misses = 0; // Crossings not followed by a FocusIn.
+  uint64_t retiles = 0;      // Retiles that left the focus where it was.
+  uint64_t retile_focus_ins = 0; // FocusIn the clients got during them.
+  double map_seconds = 0;    // Until the last window got its geometry.
+  uint64_t windows = 0;
+  uint64_t map_requests = 0, focus_requests = 0, destroy_requests = 0;
+  uint64_t configures = 0;
+};
+
+/**
+ * What the switch phase measured, over every round.
+ */
+struct SwitchTotals {
+  Histogram switch_to_shown; // Until the last MapNotify or Expose.
+  uint64_t switches = 0;
+  uint64_t requests = 0;
+};
+
+/**
+ * Connects to the IPC socket of helios, which it may not have created yet.
+ */
+int connect_ipc(const std::string &path) {
+  sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path))
+    throw std::runtime_error("Socket path too long: " + path);
+  std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+  auto deadline = Clock::now() + TIMEOUT;
+  for (;;) {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+      throw std::runtime_error(std::string("socket: ") + std::strerror(errno));
+    if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0)
+      return fd;
+    close(fd);
+    if (Clock::now() > deadline)
+      throw std::runtime_error("Unable to connect to " + path);
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+}
+
+class Client {
+public:
+  /**
+   * @param socket The IPC socket of helios.
+   */
+  Client(const std::string &display, RequestCounter &counter,
+         std::string socket)
+      : conn(xcb_connect(display.c_str(), nullptr)), requests(counter),
+        socket(std::move(socket)) {
+    if (xcb_connection_has_error(conn))
+      throw std::runtime_error("Unable to connect to " + display);
+    root = xcb_setup_roots_iterator(xcb_get_setup(conn)).data->root;
+  }
+
+  ~Client() {
+    if (ipc >= 0)
+      close(ipc);
+    xcb_disconnect(conn);
+  }
+
+  /**
+   * Maps count windows, waits until helios is done tiling them, then enters
+   * the first ENTERS of them one by one and destroys them all. Before that,
+   * one window that is not focused is destroyed with the pointer out of
+   * every window, so that helios retiles the others without moving the
+   * focus.
+   *
+   * @param rate The windows mapped, then destroyed, per second, or 0 for
+   * all at once. At a rate, each window is timed from its own map to its
+   * first tile, as helios retiles it again for the ones after it.
+   */
+  void round(unsigned count, unsigned rate, Totals &totals) {
+    std::unordered_map<xcb_window_t, Window> windows;
+    std::vector<xcb_window_t> order;
+    for (unsigned i = 0; i < count; ++i) {
+      xcb_window_t window = create();
+      windows[window];
+      order.push_back(window);
+    }
+    settle(windows, false);
+
+    uint64_t before = requests.total(), configures = requests.configures();
+    auto start = Clock::now();
+    for (size_t i = 0; i < order.size(); ++i) {
+      if (rate) {
+        pace(start, rate, i, windows);
+      }
+      xcb_map_window(conn, order[i]);
+      windows[order[i]].mapped_at = rate ? Clock::now() : start;
+    }
+    xcb_flush(conn);
+    settle(windows, true);
+
+    Clock::time_point last = start;
+    for (const auto &[window, state] : windows) {
+      if (state.final_at < start)
+        throw std::runtime_error("helios never tiled a window");
+      auto tiled = rate ? state.tiled_at : state.final_at;
+      totals.map_to_tile.record(static_cast<uint64_t>(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(
+              tiled - state.mapped_at)
+              .count()));
+      last = std::max(last, state.final_at);
+    }
+    totals.map_seconds += std::chrono::duration<double>(last - start).count();
+    totals.map_requests += requests.total() - before;
+    totals.configures += requests.configures() - configures;
+
+    before = requests.total();
+    for (unsigned i = 0; i < count && i < ENTERS; ++i) {
+      enter(order[i], windows[order[i]], totals);
+    }
+    totals.focus_requests += requests.total() - before;
+
+    before = requests.total();
+    retile(windows, order, totals);
+    start = Clock::now();
+    for (size_t i = 0; i < order.size(); ++i) {
+      if (rate) {
+        pace(start, rate, i, windows);
+      }
+      xcb_destroy_window(conn, order[i]);
+    }
+    xcb_flush(conn);
+    windows.clear();
+    settle(windows, false);
+    totals.destroy_requests += requests.total() - before;
+    totals.windows += count;
+  }
+
+  /**
+   * Maps count windows on workspace 0 and count on workspace 1, then
+   * switches between them SWITCHES times, as `helios-msg workspace N` does.
+   * Each switch is timed from the request until the last window it shows
+   * got its MapNotify or Expose, and the windows are destroyed at the end.
+   */
+  void switch_round(unsigned count, SwitchTotals &totals) {
+    std::unordered_map<xcb_window_t, Window> windows[2];
+    for (unsigned workspace = 0; workspace < 2; ++workspace) {
+      switch_to(workspace);
+      for (unsigned i = 0; i < count; ++i) {
+        xcb_window_t window = create();
+        windows[workspace][window];
+        xcb_map_window(conn, window);
+      }
+      settle(windows[workspace], true);
+    }
+
+    for (unsigned i = 0; i < SWITCHES; ++i) {
+      auto &shown = windows[i % 2];
+      for (auto &[window, state] : shown) {
+        state.mapped = false;
+      }
+
+      uint64_t before = requests.total();
+      auto start = Clock::now();
+      switch_to(i % 2);
+      settle(shown, true);
+
+      Clock::time_point last = start;
+      for (const auto &[window, state] : shown) {
+        last = std::max(last, state.shown_at);
+      }
+      totals.switch_to_shown.record(static_cast<uint64_t>(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(last - start)
+              .count()));
+      totals.requests += requests.total() - before;
+      ++totals.switches;
+    }
+
+    for (auto &workspace : windows) {
+      for (const auto &[window, state] : workspace) {
+        xcb_destroy_window(conn, window);
+      }
+      workspace.clear();
+    }
+    switch_to(0);
+    settle(windows[0], false);
+  }
+
+private:
+  /**
+   * Creates a window, unmapped, with the events the rounds look at.
+   */
+  xcb_window_t create() {
+    uint32_t mask = XCB_EVENT_MASK_EXPOSURE | XCB_EVENT_MASK_STRUCTURE_NOTIFY |
+                    XCB_EVENT_MASK_ENTER_WINDOW | XCB_EVENT_MASK_FOCUS_CHANGE;
+    xcb_window_t window = xcb_generate_id(conn);
+    xcb_create_window(conn, XCB_COPY_FROM_PARENT, window, root, 0, 0, 100, 100,
+                      0, XCB_WINDOW_CLASS_INPUT_OUTPUT, XCB_COPY_FROM_PARENT,
+                      XCB_CW_EVENT_MASK, &mask);
+    return window;
+  }
+
+  /**
+   * Runs the ch action over the IPC socket and waits for the reply.
+   */
+  void switch_to(unsigned workspace) {
+    if (ipc < 0) {
+      ipc = connect_ipc(socket);
+    }
+
+    Ipc::Writer out;
+    out.str("ch");
+    out.str(std::to_string(workspace));
+    Ipc::Header header = {static_cast<uint32_t>(out.data().size()),
+                          Ipc::REQUEST_ACTION, 0};
+    std::string message(reinterpret_cast<const char *>(&header),
+                        sizeof(header));
+    message += out.data();
+
+    if (send(ipc, message.data(), message.size(), MSG_NOSIGNAL) !=
+            static_cast<ssize_t>(message.size()) ||
+        recv(ipc, &header, sizeof(header), MSG_WAITALL) != sizeof(header) ||
+        header.flags != Ipc::STATUS_OK || header.length != 0)
+      throw std::runtime_error("helios did not switch workspaces");
+  }
+
+  /**
+   * Destroys a window other than the focused one and counts the FocusIn
+   * events of the retile that follows. There should be none: the focus
+   * stays where it was, so helios has no reason to set it again.
+   */
+  void retile(std::unordered_map<xcb_window_t, Window> &windows,
+              std::vector<xcb_window_t> &order, Totals &totals) {
+    auto victim = std::find_if(order.begin(), order.end(),
+                               [&](xcb_window_t w) { return w != focused; });
+    if (focused == XCB_NONE || victim == order.end())
+      return;
+
+    // Into the outer gap, over the root window, which helios ignores.
+    xcb_warp_pointer(conn, XCB_NONE, root, 0, 0, 0, 0, 1, 1);
+    settle(windows, false);
+
+    focus_ins = 0;
+    xcb_destroy_window(conn, *victim);
+    windows.erase(*victim);
+    order.erase(victim);
+    settle(windows, false);
+
+    ++totals.retiles;
+    totals.retile_focus_ins += focus_ins;
+  }
+
+  /**
+   * Takes events until it is time for the i-th window of a round at a rate,
+   * so that helios gets the requests one by one.
+   */
+  void pace(Clock::time_point start, unsigned rate, size_t i,
+            std::unordered_map<xcb_window_t, Window> &windows) {
+    auto at = start + std::chrono::duration_cast<Clock::duration>(
+                          std::chrono::duration<double>(double(i) / rate));
+    xcb_flush(conn);
+    for (;;) {
+      while (auto *event = xcb_poll_for_event(conn)) {
+        handle(event, windows);
+        free(event);
+      }
+      auto now = Clock::now();
+      if (now >= at)
+        return;
+      wait_event(at - now);
+    }
+  }
+
+  /**
+   * Takes events until helios has been quiet for a while, and has mapped
+   * every window if it should have.
+   */
+  void settle(std::unordered_map<xcb_window_t, Window> &windows,
+              bool mapped) {
+    auto deadline = Clock::now() + TIMEOUT;
+    auto all_mapped = [&] {
+      return std::all_of(windows.begin(), windows.end(),
+                         [](const auto &w) { return w.second.mapped; });
+    };
+    xcb_flush(conn);
+    for (;;) {
+      while (auto *event = xcb_poll_for_event(conn)) {
+        handle(event, windows);
+        free(event);
+      }
+      auto now = Clock::now();
+      if (now - requests.last_request() >= QUIET &&
+          now - last_event >= QUIET && (!mapped || all_mapped())) {
+        return;
+      }
+      if (now > deadline)
+        throw std::runtime_error("helios did not settle");
+      wait_event(std::chrono::milliseconds(5));
+    }
+  }
+
+  void handle(xcb_generic_event_t *event,
+              std::unordered_map<xcb_window_t, Window> &windows) {
+    last_event = Clock::now();
+    switch (event->response_type & ~0x80) {
+    case XCB_MAP_NOTIFY: {
+      auto *map = reinterpret_cast<xcb_map_notify_event_t *>(event);
+      auto it = windows.find(map->window);
+      if (it != windows.end()) {
+        it->second.mapped = true;
+        it->second.shown_at = last_event;
+      }
+      break;
+    }
+    case XCB_EXPOSE: {
+      auto *expose = reinterpret_cast<xcb_expose_event_t *>(event);
+      auto it = windows.find(expose->window);
+      if (it != windows.end()) {
+        it->second.shown_at = last_event;
+      }
+      break;
+    }
+    case XCB_CONFIGURE_NOTIFY: {
+      auto *configure =
+          reinterpret_cast<xcb_configure_notify_event_t *>(event);
+      auto it = windows.find(configure->window);
+      if (it == windows.end())
+        break;
+      Window &state = it->second;
+      if (state.x != configure->x || state.y != configure->y ||
+          state.width != configure->width ||
+          state.height != configure->height) {
+        state.x = configure->x;
+        state.y = configure->y;
+        state.width = configure->width;
+        state.height = configure->height;
+        state.final_at = last_event;
+        if (state.tiled_at < state.mapped_at) {
+          state.tiled_at = last_event;
+        }
+      }
+      break;
+    }
+    case XCB_ENTER_NOTIFY: {
+      auto *enter = reinterpret_cast<xcb_enter_notify_event_t *>(event);
+      if (enter->mode == XCB_NOTIFY_MODE_NORMAL) {
+        entered = enter->event;
+        entered_at = last_event;
+      }
+      break;
+    }
+    case XCB_FOCUS_IN: {
+      auto *focus = reinterpret_cast<xcb_focus_in_event_t *>(event);
+      if (focus->mode == XCB_NOTIFY_MODE_NORMAL &&
+          focus->detail != XCB_NOTIFY_DETAIL_POINTER) {
+        focused = focus->event;
+        focused_at = last_event;
+        ++focus_ins;
+      }
+      break;
+    }
+    }
+  }
+
+  /**
+   * Moves the pointer into a window, and times how long helios takes to
+   * focus it after the client sees the pointer come in.
+   */
+  void enter(xcb_window_t window, Window &state, Totals &totals) {
+    std::unordered_map<xcb_window_t, Window> none;
+    if (focused == window)
+      return; // Nothing would change.
+
+    entered = focused = XCB_NONE;
+    xcb_warp_pointer(conn, XCB_NONE, root, 0, 0, 0, 0,
+                     int16_t(state.x + state.width / 2),
+                     int16_t(state.y + state.height / 2));
+    xcb_flush(conn);
+
+    auto deadline = Clock::now() + std::chrono::seconds(1);
+    while (focused != window && Clock::now() < deadline) {
+      wait_event(std::chrono::milliseconds(5));
+      while (auto *event = xcb_poll_for_event(conn)) {
+        handle(event, none);
+        free(event);
+      }
+    }
+    if (entered != window || focused != window) {
+      ++totals.enter_misses;
+      return;
+    }
+    totals.enter_to_focus.record(static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(focused_at -
+                                                             entered_at)
+            .count()));
+  }
+
+  void wait_event(Clock::duration timeout) {
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(timeout);
+    timespec ts = {static_cast<time_t>(ns.count() / 1000000000),
+                   static_cast<long>(ns.count() % 1000000000)};
+    pollfd pfd = {xcb_get_file_descriptor(conn), POLLIN, 0};
+    ppoll(&pfd, 1, &ts, nullptr);
+  }
+
+  xcb_connection_t *conn;
+  RequestCounter &requests;
+  xcb_window_t root;
+  std::string socket;
+  int ipc = -1;
+
+  Clock::time_point last_event;
+  xcb_window_t entered = XCB_NONE, focused = XCB_NONE;
+  Clock::time_point entered_at, focused_at;
+  uint64_t focus_ins = 0;
+};
+
+/**
+ * Waits until a window manager advertises itself on the root window.
+ *
+ * @return The resource ID base of its connection.
+ */
+uint32_t wait_for_wm(const std::string &display, Child &helios) {
+  xcb_connection_t *conn = xcb_connect(display.c_str(), nullptr);
+  if (xcb_connection_has_error(conn))
+    throw std::runtime_error("Unable to connect to " + display);
+  const xcb_setup_t *setup = xcb_get_setup(conn);
+  xcb_window_t root = xcb_setup_roots_iterator(setup).data->root;
+
+  const char name[] = "_NET_SUPPORTING_WM_CHECK";
+  auto *atom = xcb_intern_atom_reply(
+      conn, xcb_intern_atom(conn, 0, sizeof(name) - 1, name), nullptr);
+  xcb_atom_t check = atom ? atom->atom : XCB_NONE;
+  free(atom);
+
+  auto deadline = Clock::now() + TIMEOUT;
+  xcb_window_t window = XCB_NONE;
+  while (window == XCB_NONE) {
+    if (!helios.running())
+      throw std::runtime_error("helios exited");
+    if (Clock::now() > deadline)
+      throw std::runtime_error("helios did not start");
+
+    auto *reply = xcb_get_property_reply(
+        conn,
+        xcb_get_property(conn, 0, root, check, XCB_ATOM_WINDOW, 0, 1),
+        nullptr);
+    if (reply && xcb_get_property_value_length(reply) == 4) {
+      window = *static_cast<xcb_window_t *>(xcb_get_property_value(reply));
+    }
+    free(reply);
+    if (window == XCB_NONE) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  }
+
+  uint32_t base = window & ~setup->resource_id_mask;
+  xcb_disconnect(conn);
+  return base;
+}
+
+void print_text(unsigned count, unsigned rate, const Totals &t,
+                unsigned rounds) {
+  auto us = [](uint64_t ns) { return double(ns) / 1000; };
+  if (rate) {
+    std::printf("%u windows at %u/s:\n", count, rate);
+  } else {
+    std::printf("%u windows:\n", count);
+  }
+  std::printf("  map to tile us: p50=%.0f p90=%.0f p99=%.0f max=%.0f, "
+              "%.0f windows/s\n",
+              us(t.map_to_tile.percentile(50)), us(t.map_to_tile.percentile(90)),
+              us(t.map_to_tile.percentile(99)), us(t.map_to_tile.max()),
+              t.map_seconds > 0 ? double(t.windows) / t.map_seconds : 0.0);
+  std::printf("  enter to focus us: p50=%.0f p90=%.0f p99=%.0f max=%.0f "
+              "(%" PRIu64 " samples, %" PRIu64 " missed)\n",
+              us(t.enter_to_focus.percentile(50)),
+              us(t.enter_to_focus.percentile(90)),
+              us(t.enter_to_focus.percentile(99)),
+              us(t.enter_to_focus.max()), t.enter_to_focus.count(),
+              t.enter_misses);
+  std::printf("  requests per round: map=%" PRIu64 " (configure %" PRIu64
+              ") focus=%" PRIu64 " destroy=%" PRIu64 ", %.2f per window\n",
+              t.map_requests / rounds, t.configures / rounds,
+              t.focus_requests / rounds, t.destroy_requests / rounds,
+              double(t.map_requests + t.focus_requests + t.destroy_requests) /
+                  double(t.windows));
+  if (t.retiles) {
+    std::printf("  FocusIn per retile without a focus change: %.2f (%" PRIu64
+                " retiles)\n",
+                double(t.retile_focus_ins) / double(t.retiles), t.retiles);
+  }
+}
+
+void print_json(unsigned count, unsigned rate, const Totals &t,
+                unsigned rounds) {
+  auto histogram = [](const Histogram &h) {
+    char buffer[160];
+    std::snprintf(buffer, sizeof(buffer),
+                  "{\"count\":%" PRIu64 ",\"p50\":%" PRIu64 ",\"p90\":%" PRIu64
+                  ",\"p99\":%" PRIu64 ",\"max\":%" PRIu64 "}",
+                  h.count(), h.percentile(50), h.percentile(90),
+                  h.percentile(99), h.max());
+    return std::string(buffer);
+  };
+  std::printf("{\"windows\":%u,\"rate\":%u,\"rounds\":%u,"
+              "\"map_to_tile_ns\":%s,"
+              "\"windows_per_second\":%.0f,\"enter_to_focus_ns\":%s,"
+              "\"enter_misses\":%" PRIu64 ",\"retiles\":%" PRIu64
+              ",\"retile_focus_ins\":%" PRIu64 ",\"requests\":{\"map\":%" PRIu64
+              ",\"configure\":%" PRIu64 ",\"focus\":%" PRIu64
+              ",\"destroy\":%" PRIu64 "}}\n",
+              count, rate, rounds, histogram(t.map_to_tile).c_str(),
+              t.map_seconds > 0 ? double(t.windows) / t.map_seconds : 0.0,
+              histogram(t.enter_to_focus).c_str(), t.enter_misses, t.retiles,
+              t.retile_focus_ins, t.map_requests / rounds,
+              t.configures / rounds, t.focus_requests / rounds,
+              t.destroy_requests / rounds);
+}
+
+void print_switch_text(unsigned count, const SwitchTotals &t) {
+  auto us = [](uint64_t ns) { return double(ns) / 1000; };
+  std::printf("workspace switch, %u windows each:\n", count);
+  std::printf("  switch to shown us: p50=%.0f p90=%.0f p99=%.0f max=%.0f "
+              "(%" PRIu64 " switches)\n",
+              us(t.switch_to_shown.percentile(50)),
+              us(t.switch_to_shown.percentile(90)),
+              us(t.switch_to_shown.percentile(99)),
+              us(t.switch_to_shown.max()), t.switches);
+  std::printf("  requests per switch: %.2f\n",
+              double(t.requests) / double(t.switches));
+}
+
+void print_switch_json(unsigned count, const SwitchTotals &t) {
+  const Histogram &h = t.switch_to_shown;
+  std::printf("{\"switch_windows\":%u,\"switches\":%" PRIu64
+              ",\"switch_to_shown_ns\":{\"count\":%" PRIu64
+              ",\"p50\":%" PRIu64 ",\"p90\":%" PRIu64 ",\"p99\":%" PRIu64
+              ",\"max\":%" PRIu64 "},\"requests_per_switch\":%.2f}\n",
+              count, t.switches, h.count(), h.percentile(50),
+              h.percentile(90), h.percentile(99), h.max(),
+              double(t.requests) / double(t.switches));
+}
+
+} // namespace
+
+/**
+ * @brief The entry point of helios-e2e.
+ *
+ * helios runs in a temporary directory holding its config, so it neither
+ * reads the config of the user nor starts their programs.
+ *
+ * @return 0 on success, 1 if Xvfb or helios failed or a retile that kept the
+ * focus caused a FocusIn, 2 on a usage error.
+ */
+int main(int argc, char **argv) {
+  std::string self = argv[0];
+  std::string helios_path =
+      self.substr(0, self.find_last_of('/') + 1) + "helios";
+  std::string xvfb_path = "Xvfb";
+  unsigned rounds = 3;
+  unsigned rate = 0;
+  unsigned switch_windows = 50;
+  bool json = false;
+  std::vector<unsigned> counts;
+
+  for (int i = 1; i < argc; ++i) {
+    bool has_value = i + 1 < argc;
+    char *end = nullptr;
+    if (std::strcmp(argv[i], "--json") == 0) {
+      json = true;
+    } else if (std::strcmp(argv[i], "--helios") == 0 && has_value) {
+      helios_path = argv[++i];
+    } else if (std::strcmp(argv[i], "--xvfb") == 0 && has_value) {
+      xvfb_path = argv[++i];
+    } else if (std::strcmp(argv[i], "--rounds") == 0 && has_value) {
+      rounds = static_cast<unsigned>(std::strtoul(argv[++i], &end, 10));
+      if (*end != '\0' || rounds == 0) {
+        usage();
+        return 2;
+      }
+    } else if (std::strcmp(argv[i], "--rate") == 0 && has_value) {
+      unsigned long value = std::strtoul(argv[++i], &end, 10);
+      if (*end != '\0' || value == 0 || value > 1000000) {
+        usage();
+        return 2;
+      }
+      rate = static_cast<unsigned>(value);
+    } else if (std::strcmp(argv[i], "--switch") == 0 && has_value) {
+      unsigned long count = std::strtoul(argv[++i], &end, 10);
+      if (*end != '\0' || count > 65535) {
+        usage();
+        return 2;
+      }
+      switch_windows = static_cast<unsigned>(count);
+    } else {
+      unsigned long count = std::strtoul(argv[i], &end, 10);
+      if (argv[i][0] == '-' || *end != '\0' || count == 0 || count > 65535) {
+        usage();
+        return 2;
+      }
+      counts.push_back(static_cast<unsigned>(count));
+    }
+  }
+  if (counts.empty()) {
+    counts = {1, 10, 100, 1000};
+  }
+  if (helios_path.find('/') != std::string::npos) {
+    char *real = realpath(helios_path.c_str(), nullptr);
+    if (real) {
+      helios_path = real;
+      free(real);
+    }
+  }
+
+  char dir[] = "/tmp/helios-e2e-XXXXXX";
+  if (!mkdtemp(dir)) {
+    std::fprintf(stderr, "helios-e2e: mkdtemp: %s\n", std::strerror(errno));
+    return 1;
+  }
+  std::string config = std::string(dir) + "/config.toml";
+  // Inherited by helios, so that its socket is not that of the session.
+  std::string socket = std::string(dir) + "/helios.sock";
+  setenv("HELIOS_SOCKET", socket.c_str(), 1);
+
+  int status = 0;
+  try {
+    if (std::FILE *file = std::fopen(config.c_str(), "w")) {
+      std::fputs(CONFIG, file);
+      std::fclose(file);
+    } else {
+      throw std::runtime_error("Unable to write " + config);
+    }
+
+    std::unique_ptr<Child> xvfb;
+    std::string display = start_xvfb(xvfb_path, xvfb);
+    std::string env = "DISPLAY=" + display;
+    Child helios({helios_path}, dir, env.c_str(), -1, false);
+
+    RequestCounter counter(display, wait_for_wm(display, helios));
+    Client client(display, counter, socket);
+    for (unsigned count : counts) {
+      Totals totals;
+      for (unsigned round = 0; round < rounds; ++round) {
+        client.round(count, rate, totals);
+      }
+      if (json) {
+        print_json(count, rate, totals, rounds);
+      } else {
+        print_text(count, rate, totals, rounds);
+      }
+      std::fflush(stdout);
+      if (totals.retile_focus_ins) {
+        std::fprintf(stderr,
+                     "helios-e2e: helios set the focus again during a "
+                     "retile that did not move it\n");
+        status = 1;
+      }
+    }
+
+    if (switch_windows) {
+      SwitchTotals totals;
+      for (unsigned round = 0; round < rounds; ++round) {
+        client.switch_round(switch_windows, totals);
+      }
+      if (json) {
+        print_switch_json(switch_windows, totals);
+      } else {
+        print_switch_text(switch_windows, totals);
+      }
+    }
+  } catch (const std::exception &e) {
+    std::fprintf(stderr, "helios-e2e: %s\n", e.what());
+    status = 1;
+  }
+
+  for (const char *file : {"config.toml", "logs.txt", "helios.sock"}) {
+    std::remove((std::string(dir) + "/" + file).c_str());
+  }
+  rmdir(dir);
+  return status;
+}
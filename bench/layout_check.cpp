@@ -0,0 +1,60 @@
+#include "reference.h"
+#include <cstdio>
+#include <vector>
+
+/**
+ * @brief The entry point of helios-layout-check.
+ *
+ * Maps 1 to 120 windows, one at a time, into a Layout::Tree, and checks that
+ * after each the tree places every window where Reference::tile_windows()
+ * does, on a few screens and gaps.
+ *
+ * @return 0 if they agree, 1 otherwise.
+ */
+int main() {
+  constexpr size_t MAX_WINDOWS = 120;
+  const Layout::Rect areas[] = {
+      {0, 0, 1920, 1080}, {0, 0, 2560, 1440}, {0, 0, 1080, 1920}};
+  const int gaps[] = {0, 10, 30};
+
+  std::vector<Layout::Rect> expected(MAX_WINDOWS);
+  std::vector<Layout::Rect> actual(MAX_WINDOWS);
+  unsigned long mismatches = 0;
+
+  for (const Layout::Rect &area : areas) {
+    for (int gap : gaps) {
+      Layout::Tree tree;
+      tree.set_area(area, gap);
+      for (size_t count = 1; count <= MAX_WINDOWS; ++count) {
+        tree.insert(static_cast<xcb_window_t>(count));
+        tree.take_changes([&](xcb_window_t window, const Layout::Rect &rect) {
+          actual[window - 1] = rect;
+        });
+
+        Reference::tile_windows(area, gap, count, expected.data());
+        for (size_t i = 0; i < count; ++i) {
+          if (actual[i] == expected[i])
+            continue;
+          if (++mismatches <= 10) {
+            std::fprintf(stderr,
+                         "helios-layout-check: %dx%d gap %d, %zu windows: "
+                         "window %zu at %d,%d %dx%d instead of %d,%d %dx%d\n",
+                         area.width, area.height, gap, count, i + 1,
+                         actual[i].x, actual[i].y, actual[i].width,
+                         actual[i].height, expected[i].x, expected[i].y,
+                         expected[i].width, expected[i].height);
+          }
+        }
+      }
+    }
+  }
+
+  if (mismatches) {
+    std::fprintf(stderr, "helios-layout-check: %lu mismatches\n", mismatches);
+    return 1;
+  }
+  std::printf("Layout::Tree matches the reference dwindle layout at 1 to %zu "
+              "windows\n",
+              MAX_WINDOWS);
+  return 0;
+}
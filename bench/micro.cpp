@@ -0,0 +1,604 @@
+#include "../src/include/helios.h"
+#include "bench.h"
+#include "reference.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+void usage() {
+  std::fprintf(
+      stderr,
+      "Usage: helios-bench [--list] [--json] [--time MS] [--config FILE]\n"
+      "                    [--baseline FILE] [--threshold PERCENT] "
+      "[BENCHMARK...]\n"
+      "\n"
+      "Runs the named microbenchmarks, or all of them, and prints the time "
+      "per\n"
+      "operation. With --baseline, fails if the fastest sample of one is "
+      "slower than\n"
+      "in FILE, the --json output of an earlier run, by more than PERCENT "
+      "(20 by\n"
+      "default).\n");
+}
+
+/**
+ * The options every benchmark may need.
+ */
+struct Options {
+  double seconds = 0.2;         // Per sample.
+  const char *config = nullptr; // A real config.toml, for config/small.
+  std::string scratch = "/tmp"; // Where config/huge writes its file.
+};
+
+/**
+ * Runs the timed operation a number of times.
+ */
+using Body = std::function<void(unsigned long)>;
+
+/**
+ * A benchmark: its name, and a function that sets it up, returning what to
+ * time.
+ */
+struct Benchmark {
+  std::string name;
+  std::function<Body(const Options &)> setup;
+};
+
+/**
+ * What a benchmark measured.
+ */
+struct Result {
+  std::string name;
+  unsigned long iterations = 0; // Per sample.
+  double ns = 0;                // Median of the samples, per operation.
+  double min_ns = 0;            // Fastest sample, per operation.
+};
+
+constexpr int SAMPLES = 5;
+
+double time_ns(const Body &body, unsigned long iterations) {
+  auto start = std::chrono::steady_clock::now();
+  body(iterations);
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  return std::chrono::duration<double, std::nano>(elapsed).count();
+}
+
+/**
+ * Finds how many operations fill a sample, then takes SAMPLES of them.
+ */
+Result measure(const Benchmark &bench, const Options &options) {
+  Body body = bench.setup(options);
+
+  // Grow tenfold until a run takes a tenth of a sample, then scale.
+  unsigned long iterations = 1;
+  double target = options.seconds * 1e9;
+  double ns = time_ns(body, iterations);
+  while (ns < target / 10) {
+    iterations *= 10;
+    ns = time_ns(body, iterations);
+  }
+  iterations = std::max(1ul, static_cast<unsigned long>(iterations * target /
+                                                        std::max(ns, 1.0)));
+
+  double samples[SAMPLES];
+  for (double &sample : samples) {
+    sample = time_ns(body, iterations) / double(iterations);
+  }
+  std::sort(samples, samples + SAMPLES);
+  return {bench.name, iterations, samples[SAMPLES / 2], samples[0]};
+}
+
+/**
+ * A window manager on a fake server holding some windows, with one binding
+ * to walk the focus through them.
+ */
+struct Session {
+  static constexpr uint16_t FOCUS_MOD = XCB_MOD_MASK_4;
+  static constexpr xcb_keysym_t FOCUS_KEY = 0xff09; // XK_Tab
+
+  explicit Session(unsigned long windows) : wm(config()), server(wm.server()) {
+    for (unsigned long i = 0; i < windows; ++i) {
+      alive.push_back(server.create_window());
+      server.inject_map_request(alive.back());
+    }
+    wm.process_events();
+  }
+
+  static Config config() {
+    Config config = bench_config();
+    config.bindings.push_back({0xffeb, FOCUS_KEY, {"focus", "next"}});
+    return config;
+  }
+
+  BasicWindowManager<FakeBackend> wm;
+  FakeBackend &server;
+  std::vector<xcb_window_t> alive;
+};
+
+/**
+ * Fills a tree with windows, so that each operation relays all of them out,
+ * as a new screen size or gap does.
+ */
+Body tile(unsigned long windows) {
+  auto tree = std::make_shared<Layout::Tree>();
+  tree->set_area({0, 0, 1920, 1080}, 30);
+  for (unsigned long i = 0; i < windows; ++i) {
+    tree->insert(static_cast<xcb_window_t>(0x200000 + i));
+  }
+  tree->take_changes([](xcb_window_t, const Layout::Rect &) {});
+
+  return [tree](unsigned long n) {
+    for (unsigned long i = 0; i < n; ++i) {
+      tree->set_area({0, 0, 1920, 1080}, i % 2 ? 30 : 20);
+      tree->take_changes([](xcb_window_t window, const Layout::Rect &rect) {
+        asm volatile("" : : "r"(window), "r"(rect.width) : "memory");
+      });
+    }
+  };
+}
+
+/**
+ * Adds a window to a full tree and takes it out again, as mapping and
+ * closing one does.
+ */
+Body retile(unsigned long windows) {
+  auto tree = std::make_shared<Layout::Tree>();
+  tree->set_area({0, 0, 1920, 1080}, 30);
+  for (unsigned long i = 0; i < windows; ++i) {
+    tree->insert(static_cast<xcb_window_t>(0x200000 + i));
+  }
+  tree->take_changes([](xcb_window_t, const Layout::Rect &) {});
+
+  return [tree](unsigned long n) {
+    for (unsigned long i = 0; i < n; ++i) {
+      tree->insert(0x100000);
+      tree->remove(0x100000);
+      tree->take_changes([](xcb_window_t window, const Layout::Rect &rect) {
+        asm volatile("" : : "r"(window), "r"(rect.width) : "memory");
+      });
+    }
+  };
+}
+
+/**
+ * Lays windows out from scratch with the dwindle layout of the first
+ * tile_windows(), as it did on every retile, for tile/ to compare with.
+ */
+Body reference_tile(unsigned long windows) {
+  auto rects = std::make_shared<std::vector<Layout::Rect>>(windows);
+  return [rects](unsigned long n) {
+    for (unsigned long i = 0; i < n; ++i) {
+      Reference::tile_windows({0, 0, 1920, 1080}, i % 2 ? 30 : 20,
+                              rects->size(), rects->data());
+      asm volatile("" : : "r"(rects->data()) : "memory");
+    }
+  };
+}
+
+/**
+ * Maps a window next to others and closes it as the first tile_windows()
+ * did, laying all of them out from scratch both times, for retile/ to
+ * compare with.
+ */
+Body reference_retile(unsigned long windows) {
+  auto rects = std::make_shared<std::vector<Layout::Rect>>(windows + 1);
+  return [rects, windows](unsigned long n) {
+    for (unsigned long i = 0; i < n; ++i) {
+      Reference::tile_windows({0, 0, 1920, 1080}, 30, windows + 1,
+                              rects->data());
+      asm volatile("" : : "r"(rects->data()) : "memory");
+      Reference::tile_windows({0, 0, 1920, 1080}, 30, windows, rects->data());
+      asm volatile("" : : "r"(rects->data()) : "memory");
+    }
+  };
+}
+
+/**
+ * Lays 64 windows out with an engine, into a buffer made once, as retiling a
+ * workspace that does not use dwindle does.
+ */
+template <class Engine> Body arrange() {
+  auto rects = std::make_shared<std::vector<Layout::Rect>>(64);
+  return [rects](unsigned long n) {
+    for (unsigned long i = 0; i < n; ++i) {
+      Engine::arrange({0, 0, 1920, 1080}, i % 2 ? 30 : 20, rects->size(),
+                      rects->data());
+      asm volatile("" : : "r"(rects->data()) : "memory");
+    }
+  };
+}
+
+/**
+ * A bound key press, moving the focus to the next of 8 windows.
+ */
+Body key_bound() {
+  auto session = std::make_shared<Session>(8);
+  return [session](unsigned long n) {
+    for (unsigned long i = 0; i < n; ++i) {
+      session->server.inject_key_press(Session::FOCUS_MOD, Session::FOCUS_KEY);
+      session->wm.process_events();
+    }
+  };
+}
+
+/**
+ * A key press nothing is bound to.
+ */
+Body key_unbound() {
+  auto session = std::make_shared<Session>(8);
+  return [session](unsigned long n) {
+    for (unsigned long i = 0; i < n; ++i) {
+      session->server.inject_key_press(XCB_MOD_MASK_1, 'q');
+      session->wm.process_events();
+    }
+  };
+}
+
+/**
+ * A batch of 64 EnterNotify events over 8 windows, so the focus moves on
+ * every event and is committed once per batch.
+ */
+Body enter() {
+  auto session = std::make_shared<Session>(8);
+  return [session](unsigned long n) {
+    const auto &alive = session->alive;
+    for (unsigned long i = 0; i < n; ++i) {
+      for (size_t j = 0; j < 64; ++j) {
+        session->server.inject_enter_notify(alive[j % alive.size()]);
+      }
+      session->wm.process_events();
+    }
+  };
+}
+
+/**
+ * A batch of 64 events of a type nobody handles, to time the dispatch alone.
+ */
+Body unhandled() {
+  auto session = std::make_shared<Session>(8);
+  return [session](unsigned long n) {
+    xcb_generic_event_t event = {};
+    event.response_type = XCB_MOTION_NOTIFY;
+    for (unsigned long i = 0; i < n; ++i) {
+      for (size_t j = 0; j < 64; ++j) {
+        session->server.inject_event(event);
+      }
+      session->wm.process_events();
+    }
+  };
+}
+
+/**
+ * 64 events of a type nobody handles, dispatched without an event queue or a
+ * commit around them, to time the lookup of the handler alone.
+ */
+Body dispatch() {
+  auto session = std::make_shared<Session>(8);
+  return [session](unsigned long n) {
+    xcb_generic_event_t event = {};
+    event.response_type = XCB_MOTION_NOTIFY;
+    for (unsigned long i = 0; i < n; ++i) {
+      for (size_t j = 0; j < 64; ++j) {
+        session->wm.dispatch(&event);
+      }
+    }
+  };
+}
+
+/**
+ * event/dispatch64 through the map of the first run() instead of the window
+ * manager, with a handler, which does nothing, for each of the five event
+ * types it handled.
+ */
+Body reference_dispatch() {
+  auto handlers = std::make_shared<Reference::EventMap>();
+  for (uint32_t type : {XCB_MAP_REQUEST, XCB_UNMAP_NOTIFY, XCB_DESTROY_NOTIFY,
+                        XCB_ENTER_NOTIFY, XCB_KEY_PRESS}) {
+    (*handlers)[type] = [](xcb_generic_event_t *event) {
+      asm volatile("" : : "r"(event) : "memory");
+    };
+  }
+  return [handlers](unsigned long n) {
+    xcb_generic_event_t event = {};
+    event.response_type = XCB_MOTION_NOTIFY;
+    for (unsigned long i = 0; i < n; ++i) {
+      for (size_t j = 0; j < 64; ++j) {
+        Reference::dispatch(*handlers, &event);
+        asm volatile("" : : "r"(&event) : "memory");
+      }
+    }
+  };
+}
+
+/**
+ * A batch of 64 title changes of one of 8 windows, as a terminal printing
+ * its working directory causes: the title is read once per batch.
+ */
+Body title() {
+  auto session = std::make_shared<Session>(8);
+  return [session](unsigned long n) {
+    xcb_window_t window = session->alive.front();
+    for (unsigned long i = 0; i < n; ++i) {
+      for (size_t j = 0; j < 64; ++j) {
+        session->server.inject_property_notify(window, XCB_ATOM_WM_NAME);
+      }
+      session->wm.process_events();
+    }
+  };
+}
+
+/**
+ * Maps a window next to others, in a batch of its own, then destroys it in
+ * another: adoption, tiling, focus and retiling.
+ */
+Body adopt(unsigned long windows) {
+  auto session = std::make_shared<Session>(windows);
+  return [session](unsigned long n) {
+    FakeBackend &server = session->server;
+    for (unsigned long i = 0; i < n; ++i) {
+      xcb_window_t window = server.create_window();
+      server.inject_map_request(window);
+      session->wm.process_events();
+      server.destroy_window(window);
+      session->wm.process_events();
+    }
+  };
+}
+
+/**
+ * Parses a config file.
+ *
+ * @param temporary Whether to remove the file once the benchmark is done.
+ */
+Body parse(const std::string &path, bool temporary = false) {
+  std::shared_ptr<const std::string> file(
+      new std::string(path), [temporary](const std::string *name) {
+        if (temporary) {
+          std::remove(name->c_str());
+        }
+        delete name;
+      });
+  return [file](unsigned long n) {
+    for (unsigned long i = 0; i < n; ++i) {
+      Config config = loadConfig(*file);
+      asm volatile("" : : "r"(config.bindings.data()) : "memory");
+    }
+  };
+}
+
+/**
+ * Writes a config with 10000 bindings and 1000 startup programs, far more
+ * than anyone has, to find what grows with the size of the file.
+ */
+std::string write_huge_config(const Options &options) {
+  std::string path = options.scratch + "/helios-bench-" +
+                     std::to_string(getpid()) + ".toml";
+  std::ofstream out(path);
+  out << "[general]\nstartup = [\n";
+  for (int i = 0; i < 1000; ++i) {
+    out << "    \"st -e program" << i << " --some-flag\",\n";
+  }
+  out << "]\n\nbindings = [\n";
+  for (int i = 0; i < 10000; ++i) {
+    out << "    { mod = 0xffeb, keysym = " << 0x20 + i
+        << ", action = { type = \"run\", target = \"command" << i
+        << "\" } },\n";
+  }
+  out << "]\n\n[general.border]\nwidth = 2\nactive_color = 0xffeb231\n"
+         "inactive_color = 0x483D8B\nradius = 20\n\n[general.window]\n"
+         "gap = 30\n";
+  if (!out)
+    throw std::runtime_error("Unable to write " + path);
+  return path;
+}
+
+std::vector<Benchmark> benchmarks() {
+  std::vector<Benchmark> list;
+  for (unsigned long windows : {1, 4, 10, 16, 64, 100, 256, 1000}) {
+    list.push_back({"tile/" + std::to_string(windows),
+                    [windows](const Options &) { return tile(windows); }});
+  }
+  for (unsigned long windows : {1, 10, 16, 100, 256, 1000}) {
+    list.push_back({"retile/" + std::to_string(windows),
+                    [windows](const Options &) { return retile(windows); }});
+  }
+  for (unsigned long windows : {10, 100, 1000}) {
+    list.push_back({"reference/tile" + std::to_string(windows),
+                    [windows](const Options &) {
+                      return reference_tile(windows);
+                    }});
+    list.push_back({"reference/retile" + std::to_string(windows),
+                    [windows](const Options &) {
+                      return reference_retile(windows);
+                    }});
+  }
+  list.push_back({"arrange/master-stack64", [](const Options &) {
+                    return arrange<Layout::Engine<Layout::Kind::master_stack>>();
+                  }});
+  list.push_back({"arrange/grid64", [](const Options &) {
+                    return arrange<Layout::Engine<Layout::Kind::grid>>();
+                  }});
+  list.push_back({"key/bound", [](const Options &) { return key_bound(); }});
+  list.push_back(
+      {"key/unbound", [](const Options &) { return key_unbound(); }});
+  list.push_back({"event/enter64", [](const Options &) { return enter(); }});
+  list.push_back(
+      {"event/unhandled64", [](const Options &) { return unhandled(); }});
+  list.push_back({"event/title64", [](const Options &) { return title(); }});
+  list.push_back(
+      {"event/dispatch64", [](const Options &) { return dispatch(); }});
+  list.push_back({"reference/dispatch64",
+                  [](const Options &) { return reference_dispatch(); }});
+  for (unsigned long windows : {0, 16, 64}) {
+    list.push_back({"adopt/" + std::to_string(windows),
+                    [windows](const Options &) { return adopt(windows); }});
+  }
+  list.push_back({"config/small", [](const Options &options) {
+                    if (!options.config)
+                      throw std::runtime_error("config/small needs --config");
+                    return parse(options.config);
+                  }});
+  list.push_back({"config/huge", [](const Options &options) {
+                    return parse(write_huge_config(options), true);
+                  }});
+  return list;
+}
+
+/**
+ * Reads the min_ns_per_op of every benchmark in --json output.
+ */
+std::map<std::string, double> read_baseline(const char *path) {
+  std::ifstream in(path);
+  if (!in)
+    throw std::runtime_error(std::string("Unable to read ") + path);
+
+  std::map<std::string, double> baseline;
+  std::string line;
+  while (std::getline(in, line)) {
+    const std::string name_key = "{\"name\":\"",
+                      ns_key = "\"min_ns_per_op\":";
+    size_t name = line.find(name_key), ns = line.find(ns_key);
+    if (name != 0 || ns == std::string::npos)
+      continue;
+    name += name_key.size();
+    baseline[line.substr(name, line.find('"', name) - name)] =
+        std::strtod(line.c_str() + ns + ns_key.size(), nullptr);
+  }
+  return baseline;
+}
+
+} // namespace
+
+/**
+ * @brief The entry point of helios-bench.
+ *
+ * @return 0 on success, 1 if a benchmark failed or regressed, 2 on a usage
+ * error.
+ */
+int main(int argc, char **argv) {
+  Options options;
+  const char *baseline_path = nullptr;
+  double threshold = 20;
+  bool json = false, list = false;
+  std::vector<std::string> names;
+
+  for (int i = 1; i < argc; ++i) {
+    const char *arg = argv[i];
+    bool has_value = i + 1 < argc;
+    char *end = nullptr;
+    if (std::strcmp(arg, "--json") == 0) {
+      json = true;
+    } else if (std::strcmp(arg, "--list") == 0) {
+      list = true;
+    } else if (std::strcmp(arg, "--config") == 0 && has_value) {
+      options.config = argv[++i];
+    } else if (std::strcmp(arg, "--baseline") == 0 && has_value) {
+      baseline_path = argv[++i];
+    } else if (std::strcmp(arg, "--threshold") == 0 && has_value) {
+      threshold = std::strtod(argv[++i], &end);
+      if (*end != '\0' || threshold < 0) {
+        usage();
+        return 2;
+      }
+    } else if (std::strcmp(arg, "--time") == 0 && has_value) {
+      options.seconds = std::strtod(argv[++i], &end) / 1000;
+      if (*end != '\0' || options.seconds <= 0) {
+        usage();
+        return 2;
+      }
+    } else if (arg[0] == '-') {
+      usage();
+      return 2;
+    } else {
+      names.push_back(arg);
+    }
+  }
+  if (const char *tmp = std::getenv("TMPDIR")) {
+    options.scratch = tmp;
+  }
+
+  auto all = benchmarks();
+  if (list) {
+    for (const auto &bench : all) {
+      std::printf("%s\n", bench.name.c_str());
+    }
+    return 0;
+  }
+
+  std::vector<const Benchmark *> selected;
+  for (const auto &name : names) {
+    auto it = std::find_if(all.begin(), all.end(),
+                           [&](const Benchmark &b) { return b.name == name; });
+    if (it == all.end()) {
+      std::fprintf(stderr, "helios-bench: no benchmark named %s\n",
+                   name.c_str());
+      return 2;
+    }
+    selected.push_back(&*it);
+  }
+  if (names.empty()) {
+    for (const auto &bench : all) {
+      selected.push_back(&bench);
+    }
+  }
+
+  // The window managers log like the real one; keep that out of the way.
+  spdlog::set_level(spdlog::level::off);
+
+  int status = 0;
+  try {
+    std::map<std::string, double> baseline;
+    if (baseline_path) {
+      baseline = read_baseline(baseline_path);
+    }
+
+    for (const auto *bench : selected) {
+      Result result = measure(*bench, options);
+      auto it = baseline.find(result.name);
+      // The fastest sample is the least disturbed by the rest of the machine.
+      double ratio = it != baseline.end() ? result.min_ns / it->second : 0;
+      bool regressed = ratio > 1 + threshold / 100;
+      if (regressed) {
+        status = 1;
+      }
+
+      if (json) {
+        std::printf("{\"name\":\"%s\",\"iterations\":%lu,\"ns_per_op\":%.2f,"
+                    "\"min_ns_per_op\":%.2f",
+                    result.name.c_str(), result.iterations, result.ns,
+                    result.min_ns);
+        if (ratio) {
+          std::printf(",\"baseline_min_ns_per_op\":%.2f,\"ratio\":%.3f,"
+                      "\"regressed\":%s",
+                      it->second, ratio, regressed ? "true" : "false");
+        }
+        std::printf("}\n");
+      } else {
+        std::printf("%-20s %12.1f ns/op (min %.1f, %lu iterations)",
+                    result.name.c_str(), result.ns, result.min_ns,
+                    result.iterations);
+        if (ratio) {
+          std::printf(" %+.1f%%%s", (ratio - 1) * 100,
+                      regressed ? " REGRESSED" : "");
+        }
+        std::printf("\n");
+      }
+      std::fflush(stdout);
+    }
+  } catch (const std::exception &e) {
+    std::fprintf(stderr, "helios-bench: %s\n", e.what());
+    return 1;
+  }
+  return status;
+}
@@ -0,0 +1,91 @@
+#ifndef REFERENCE_H
+#define REFERENCE_H
+
+#include "../src/include/layout.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <xcb/xcb.h>
+
+/**
+ * @brief Copies of what helios did before it was optimized, for the
+ * benchmarks to measure the gain against and the tests to check the
+ * behaviour did not change.
+ */
+namespace Reference {
+
+/**
+ * @brief The dwindle layout as the first tile_windows() computed it, from
+ * scratch on every retile.
+ *
+ * @details
+ * Each window splits the one with the largest area, found by a linear scan,
+ * alternating between vertical and horizontal splits: O(n^2) for n windows.
+ * The first window fills the area minus the gap around it.
+ *
+ * @param area The area to tile, usually the screen.
+ * @param gap The gap between windows and around the area, in pixels.
+ * @param count The number of windows, in mapping order.
+ * @param out Where to write their rectangles, with room for count.
+ */
+inline void tile_windows(const Layout::Rect &area, int gap, size_t count,
+                         Layout::Rect *out) {
+  if (count == 0)
+    return;
+
+  out[0] = {area.x + gap, area.y + gap, area.width - 2 * gap,
+            area.height - 2 * gap};
+
+  bool split_horizontal = false;
+  for (size_t i = 1; i < count; i++) {
+    size_t largest_idx = i - 1;
+    int largest_area = 0;
+    for (size_t j = 0; j < i; j++) {
+      int rect_area = out[j].width * out[j].height;
+      if (rect_area > largest_area) {
+        largest_area = rect_area;
+        largest_idx = j;
+      }
+    }
+
+    Layout::Rect &to_split = out[largest_idx];
+    Layout::Rect &new_window = out[i];
+
+    if (split_horizontal) {
+      int new_height = (to_split.height - gap) / 2;
+      new_window = {to_split.x, to_split.y + new_height + gap, to_split.width,
+                    to_split.height - new_height - gap};
+      to_split.height = new_height;
+    } else {
+      int new_width = (to_split.width - gap) / 2;
+      new_window = {to_split.x + new_width + gap, to_split.y,
+                    to_split.width - new_width - gap, to_split.height};
+      to_split.width = new_width;
+    }
+
+    split_horizontal = !split_horizontal;
+  }
+}
+
+/**
+ * @brief The event handlers of the first run(): a std::function per response
+ * type, in a hash map.
+ */
+using EventHandler = std::function<void(xcb_generic_event_t *)>;
+using EventMap = std::unordered_map<uint32_t, EventHandler>;
+
+/**
+ * @brief Dispatches an event as the first run() did, except that the events
+ * without a handler are not logged as errors.
+ */
+inline void dispatch(const EventMap &handlers, xcb_generic_event_t *event) {
+  auto handler = handlers.find(event->response_type & ~0x80);
+  if (handler != handlers.end()) {
+    handler->second(event);
+  }
+}
+
+} // namespace Reference
+
+#endif
@@ -0,0 +1,259 @@
+#include "../src/include/helios.h"
+#include "bench.h"
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <xcb/randr.h>
+
+namespace {
+
+void usage() {
+  std::fprintf(stderr,
+               "Usage: helios-replay [--repeat N] [--config FILE] [--json] "
+               "TRACE\n"
+               "\n"
+               "Feeds a trace recorded with helios --record to the window "
+               "manager on a fake\n"
+               "X server, as fast as it goes, and prints the throughput, "
+               "the latency of\n"
+               "every batch and the requests it would have sent.\n");
+}
+
+/**
+ * Moves an extension event from the event base of the recorded server to
+ * that of the fake one, and points RandR events at the fake root.
+ */
+void rebase(xcb_generic_event_t &event, const Trace::Setup &setup,
+            xcb_window_t root) {
+  uint8_t type = event.response_type & 0x7f;
+  uint8_t sent = event.response_type & 0x80;
+
+  if (setup.shape_base && type == setup.shape_base) {
+    event.response_type = sent | FakeBackend::SHAPE_BASE;
+  } else if (setup.randr_base && type >= setup.randr_base &&
+             type < setup.randr_base + 2) {
+    uint8_t offset = type - setup.randr_base;
+    event.response_type = sent | (FakeBackend::RANDR_BASE + offset);
+    if (offset == XCB_RANDR_SCREEN_CHANGE_NOTIFY) {
+      auto &change =
+          reinterpret_cast<xcb_randr_screen_change_notify_event_t &>(event);
+      change.root = root;
+    }
+  }
+}
+
+/**
+ * What one replay of a trace took and caused.
+ */
+struct Totals {
+  uint64_t events = 0;
+  uint64_t batches = 0;
+  uint64_t trace_us = 0; // How long the recorded session lasted.
+  double seconds = 0;
+  Histogram batch;
+  std::array<uint64_t, FakeBackend::REQUEST_TYPES> requests = {};
+  Layout::Tree::MemoStats memo; // Full relayouts recalled or recomputed.
+};
+
+void replay(Trace::Player &player, const Config &config, bool json,
+            Totals &totals, std::string &handlers) {
+  BasicWindowManager<FakeBackend> wm(config);
+  FakeBackend &server = wm.server();
+
+  // The size of the recorded screen, then the trace as it was.
+  const Trace::Setup &setup = player.setup();
+  server.inject_screen_change(setup.width, setup.height);
+  wm.process_events();
+  server.synthesize(false);
+  server.reset_counts();
+
+  Trace::Record record;
+  player.rewind();
+  auto start = std::chrono::steady_clock::now();
+
+  while (player.next(record)) {
+    switch (record.type) {
+    case Trace::RECORD_EVENT:
+      rebase(record.event, setup, server.root());
+      server.inject_event(record.event);
+      ++totals.events;
+      break;
+    case Trace::RECORD_PROPERTIES:
+      // The atoms of the recorded server mean nothing to the fake one.
+      record.props.window_type =
+          record.tiled ? XCB_NONE : FakeBackend::TYPE_DOCK;
+      server.add_window(record.window, std::move(record.props),
+                        record.override_redirect);
+      record.props = {};
+      break;
+    case Trace::RECORD_REFRESH:
+      // What the client had changed when the window manager read it again,
+      // so that the next refresh reads the same. Titles the recorded window
+      // manager read after TITLE_DELAY are read by the replayed one, which
+      // has no timers, at the batch of their PropertyNotify, before this
+      // record: it sees them one change late.
+      if (ClientProperties *props = server.properties(record.window)) {
+        record.props.window_type = props->window_type;
+        *props = std::move(record.props);
+      }
+      record.props = {};
+      break;
+    case Trace::RECORD_COMMIT: {
+      auto batch_start = Stats::now();
+      wm.process_events();
+      Stats::record_since(totals.batch, batch_start);
+      ++totals.batches;
+      break;
+    }
+    }
+  }
+  wm.process_events();
+
+  totals.seconds += std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+  totals.trace_us += record.time;
+  for (int type = 0; type < FakeBackend::REQUEST_TYPES; ++type) {
+    totals.requests[type] +=
+        server.count(static_cast<FakeBackend::RequestType>(type));
+  }
+  Layout::Tree::MemoStats memo = wm.layout_memo();
+  totals.memo.hits += memo.hits;
+  totals.memo.misses += memo.misses;
+
+#ifdef HELIOS_STATS
+  handlers = json ? wm.statistics().json() : wm.statistics().text();
+#else
+  (void)json;
+  (void)handlers;
+#endif
+}
+
+/**
+ * The names of the FakeBackend::RequestType values, in order.
+ */
+const char *const request_names[] = {
+    "configure",  "border_color",   "map",   "unmap",
+    "focus",      "select_input",   "close", "current_desktop",
+    "wm_desktop", "get_properties", "raise", "flush"};
+static_assert(sizeof(request_names) / sizeof(*request_names) ==
+                  FakeBackend::REQUEST_TYPES,
+              "Every request type needs a name");
+
+void print_text(const Totals &t, unsigned long repeat,
+                const std::string &handlers) {
+  std::printf("%" PRIu64 " events in %" PRIu64 " batches, %.3f s recorded, "
+              "replayed %lu times\n",
+              t.events / repeat, t.batches / repeat,
+              double(t.trace_us) / repeat / 1e6, repeat);
+  std::printf("%.0f events/s, %.0fx real time\n", t.events / t.seconds,
+              t.trace_us / 1e6 / t.seconds);
+  std::printf("batch ns: mean=%.0f p50=%" PRIu64 " p90=%" PRIu64
+              " p99=%" PRIu64 " max=%" PRIu64 "\n",
+              t.batch.mean(), t.batch.percentile(50), t.batch.percentile(90),
+              t.batch.percentile(99), t.batch.max());
+
+  uint64_t total = 0;
+  std::printf("requests per replay:");
+  for (int type = 0; type < FakeBackend::REQUEST_TYPES; ++type) {
+    if (type != FakeBackend::FLUSH) {
+      total += t.requests[type];
+    }
+    if (t.requests[type]) {
+      std::printf(" %s=%" PRIu64, request_names[type],
+                  t.requests[type] / repeat);
+    }
+  }
+  std::printf("\nrequests per event: %.2f\n",
+              t.events ? double(total) / t.events : 0.0);
+
+  uint64_t relayouts = t.memo.hits + t.memo.misses;
+  std::printf("full relayouts per replay: %" PRIu64 ", %.1f%% recalled\n",
+              relayouts / repeat,
+              relayouts ? 100.0 * t.memo.hits / relayouts : 0.0);
+
+  if (handlers.empty()) {
+    std::printf("Handler latency: configure with -Dstats=true\n");
+  } else {
+    std::printf("%s", handlers.c_str());
+  }
+}
+
+void print_json(const Totals &t, unsigned long repeat,
+                const std::string &handlers) {
+  std::printf("{\"events\":%" PRIu64 ",\"batches\":%" PRIu64
+              ",\"repeat\":%lu,\"seconds\":%.6f,\"events_per_second\":%.0f,"
+              "\"batch_ns\":{\"mean\":%.1f,\"p50\":%" PRIu64 ",\"p90\":%" PRIu64
+              ",\"p99\":%" PRIu64 ",\"max\":%" PRIu64 "},\"requests\":{",
+              t.events / repeat, t.batches / repeat, repeat, t.seconds,
+              t.events / t.seconds, t.batch.mean(), t.batch.percentile(50),
+              t.batch.percentile(90), t.batch.percentile(99), t.batch.max());
+  for (int type = 0; type < FakeBackend::REQUEST_TYPES; ++type) {
+    std::printf("%s\"%s\":%" PRIu64, type ? "," : "", request_names[type],
+                t.requests[type] / repeat);
+  }
+  std::printf("},\"layout_memo\":{\"hits\":%" PRIu64 ",\"misses\":%" PRIu64
+              "},\"handlers\":%s}\n",
+              t.memo.hits / repeat, t.memo.misses / repeat,
+              handlers.empty() ? "null" : handlers.c_str());
+}
+
+} // namespace
+
+/**
+ * @brief The entry point of helios-replay.
+ *
+ * @return 0 on success, 1 if the trace or the config cannot be read, 2 on a
+ * usage error.
+ */
+int main(int argc, char **argv) {
+  unsigned long repeat = 1;
+  const char *config_path = nullptr;
+  bool json = false;
+
+  int i = 1;
+  for (; i < argc && argv[i][0] == '-'; ++i) {
+    if (std::strcmp(argv[i], "--json") == 0) {
+      json = true;
+    } else if (std::strcmp(argv[i], "--config") == 0 && i + 1 < argc) {
+      config_path = argv[++i];
+    } else if (std::strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+      char *end = nullptr;
+      repeat = std::strtoul(argv[++i], &end, 10);
+      if (*end != '\0' || repeat == 0) {
+        usage();
+        return 2;
+      }
+    } else {
+      usage();
+      return 2;
+    }
+  }
+  if (i + 1 != argc) {
+    usage();
+    return 2;
+  }
+
+  try {
+    Trace::Player player(argv[i]);
+    Config config = config_path ? loadConfig(config_path) : bench_config();
+
+    Totals totals;
+    std::string handlers;
+    for (unsigned long n = 0; n < repeat; ++n) {
+      replay(player, config, json, totals, handlers);
+    }
+
+    if (json) {
+      print_json(totals, repeat, handlers);
+    } else {
+      print_text(totals, repeat, handlers);
+    }
+  } catch (const std::exception &e) {
+    std::fprintf(stderr, "helios-replay: %s\n", e.what());
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,178 @@
+#include "include/backend.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <xcb/randr.h>
+#include <xcb/shape.h>
+
+#include "../wm.def.h"
+
+XcbBackend::XcbBackend(std::shared_ptr<spdlog::logger> logger,
+                       uint32_t root_event_mask)
+    : logger(std::move(logger)) {
+  if (!(conn = xcb_connect(nullptr, nullptr)) || xcb_connection_has_error(conn)) {
+    this->logger->error("Could not connect to the X server");
+    if (conn)
+      xcb_disconnect(conn);
+    throw std::runtime_error("X server connection failed");
+  }
+
+  xcb_screen_iterator_t iter = xcb_setup_roots_iterator(xcb_get_setup(conn));
+  if (!(screen = iter.data)) {
+    this->logger->error("Unable to access screen information. Ensure the X "
+                        "server is running and is accessible");
+    xcb_disconnect(conn);
+    throw std::runtime_error("No screen");
+  }
+
+  if (!(ewmh_cookie = xcb_ewmh_init_atoms(conn, &ewmh))) {
+    this->logger->error("EWMH cookie initialization failed");
+    xcb_disconnect(conn);
+    throw std::runtime_error("EWMH cookie initialization failed");
+  }
+
+  delete_cookie = xcb_intern_atom(conn, 0, strlen("WM_DELETE_WINDOW"),
+                                  "WM_DELETE_WINDOW");
+
+  xcb_prefetch_extension_data(conn, &xcb_shape_id);
+  xcb_prefetch_extension_data(conn, &xcb_randr_id);
+
+  xcb_change_window_attributes(conn, screen->root, XCB_CW_EVENT_MASK,
+                               &root_event_mask);
+
+  check_window = xcb_generate_id(conn);
+  xcb_create_window(conn, XCB_WINDOW_CLASS_COPY_FROM_PARENT, check_window,
+                    screen->root, 0, 0, 1, 1, 0, XCB_WINDOW_CLASS_INPUT_OUTPUT,
+                    screen->root_visual, {}, {});
+
+  keys = std::make_unique<Keyboard>(conn, screen->root);
+  xcb_flush(conn);
+}
+
+XcbBackend::~XcbBackend() {
+  if (cursor != XCB_CURSOR_NONE) {
+    xcb_free_cursor(conn, cursor);
+  }
+  if (check_window != XCB_NONE) {
+    xcb_destroy_window(conn, check_window);
+  }
+  keys.reset();
+
+  // Clients keep running, so leave focus where the next window manager, or
+  // none, expects it.
+  xcb_set_input_focus(conn, XCB_INPUT_FOCUS_POINTER_ROOT,
+                      XCB_INPUT_FOCUS_POINTER_ROOT, XCB_CURRENT_TIME);
+  xcb_flush(conn);
+  xcb_disconnect(conn);
+
+  if (cursor_context) {
+    xcb_cursor_context_free(cursor_context);
+  }
+}
+
+/**
+ * Collects the replies, in the order the requests were sent, then publishes
+ * the EWMH support of the window manager on the root window.
+ */
+void XcbBackend::finish_setup(uint32_t desktops) {
+  xcb_generic_error_t *error = nullptr;
+  if (!xcb_ewmh_init_atoms_replies(&ewmh, ewmh_cookie, &error)) {
+    if (error) {
+      logger->error("EWMH initialization failed: {}", error->major_code);
+      free(error);
+    } else {
+      logger->error(
+          "EWMH initialization failed with no error details available");
+    }
+    throw std::runtime_error("EWMH connection initialization failed");
+  }
+
+  auto *delete_reply = xcb_intern_atom_reply(conn, delete_cookie, nullptr);
+  wm_delete_window = delete_reply ? delete_reply->atom : XCB_NONE;
+  free(delete_reply);
+
+  xcb_atom_t supported[] = {ewmh._NET_SUPPORTED,
+                            ewmh._NET_SUPPORTING_WM_CHECK,
+                            ewmh._NET_ACTIVE_WINDOW,
+                            ewmh._NET_CLIENT_LIST,
+                            ewmh._NET_CURRENT_DESKTOP,
+                            ewmh._NET_DESKTOP_NAMES,
+                            ewmh._NET_NUMBER_OF_DESKTOPS,
+                            ewmh._NET_WM_NAME,
+                            ewmh._NET_WM_STATE,
+                            ewmh._NET_WM_STATE_FULLSCREEN,
+                            ewmh._NET_WM_WINDOW_TYPE,
+                            ewmh._NET_WM_WINDOW_TYPE_DIALOG,
+                            ewmh._NET_WM_WINDOW_TYPE_DOCK,
+                            ewmh._NET_WM_WINDOW_TYPE_DESKTOP};
+
+  xcb_window_t root = screen->root;
+  xcb_ewmh_set_supported(&ewmh, 0, sizeof(supported) / sizeof(*supported),
+                         supported);
+  xcb_ewmh_set_supporting_wm_check(&ewmh, root, check_window);
+  xcb_ewmh_set_wm_name(&ewmh, root, strlen(WM_NAME), "" WM_NAME);
+  xcb_ewmh_set_supporting_wm_check(&ewmh, root, root);
+  xcb_ewmh_set_number_of_desktops(&ewmh, 0, desktops);
+  xcb_ewmh_set_current_desktop(&ewmh, 0, 0);
+  xcb_ewmh_set_active_window(&ewmh, 0, root);
+
+  const xcb_query_extension_reply_t *shape_ext =
+      xcb_get_extension_data(conn, &xcb_shape_id);
+  if (shape_ext && shape_ext->present) {
+    shape_base = shape_ext->first_event;
+  }
+
+  const xcb_query_extension_reply_t *randr_ext =
+      xcb_get_extension_data(conn, &xcb_randr_id);
+  if (randr_ext && randr_ext->present) {
+    randr_base = randr_ext->first_event;
+    xcb_randr_select_input(conn, root, XCB_RANDR_NOTIFY_MASK_SCREEN_CHANGE);
+  }
+}
+
+void XcbBackend::load_cursor() {
+  if (xcb_cursor_context_new(conn, screen, &cursor_context) != 0) {
+    logger->error("Unable to create cursor context");
+    cursor_context = nullptr;
+    throw std::runtime_error("Cursor context creation failed");
+  }
+
+  cursor = xcb_cursor_load_cursor(cursor_context, "left_ptr");
+  if (cursor == XCB_CURSOR_NONE) {
+    logger->error("Failed to load cursor");
+    throw std::runtime_error("Unable to create cursor context");
+  }
+
+  xcb_change_window_attributes(conn, screen->root, XCB_CW_CURSOR, &cursor);
+  xcb_flush(conn);
+}
+
+void XcbBackend::select_client_input(xcb_window_t window) {
+  uint32_t values[] = {XCB_EVENT_MASK_ENTER_WINDOW |
+                       XCB_EVENT_MASK_FOCUS_CHANGE |
+                       XCB_EVENT_MASK_PROPERTY_CHANGE};
+  xcb_change_window_attributes(conn, window, XCB_CW_EVENT_MASK, values);
+  if (shape_base) {
+    xcb_shape_select_input(conn, window, 1);
+  }
+}
+
+void XcbBackend::close(xcb_window_t window, const ClientProperties &props) {
+  const auto &protocols = props.protocols;
+  if (wm_delete_window == XCB_NONE ||
+      std::find(protocols.begin(), protocols.end(), wm_delete_window) ==
+          protocols.end()) {
+    xcb_kill_client(conn, window);
+    return;
+  }
+
+  xcb_client_message_event_t msg = {};
+  msg.response_type = XCB_CLIENT_MESSAGE;
+  msg.format = 32;
+  msg.window = window;
+  msg.type = ewmh.WM_PROTOCOLS;
+  msg.data.data32[0] = wm_delete_window;
+  msg.data.data32[1] = XCB_CURRENT_TIME;
+  xcb_send_event(conn, 0, window, XCB_EVENT_MASK_NO_EVENT,
+                 reinterpret_cast<const char *>(&msg));
+}
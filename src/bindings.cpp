@@ -0,0 +1,105 @@
+#include "include/bindings.h"
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+/**
+ * Splits a command line into words, honouring single quotes, double quotes
+ * and backslashes the way a shell would.
+ *
+ * @return false if the command uses anything else from the shell, such as
+ * pipes, redirections, variables or globs, in which case it has to be run
+ * through /bin/sh.
+ */
+bool tokenize(const std::string &command, std::vector<std::string> &words) {
+  std::string word;
+  bool in_word = false;
+  char quote = '\0';
+
+  for (size_t i = 0; i < command.size(); ++i) {
+    char c = command[i];
+
+    if (quote) {
+      if (quote == '"' && (c == '$' || c == '`'))
+        return false;
+      if (c == quote) {
+        quote = '\0';
+      } else if (c == '\\' && quote == '"' && i + 1 < command.size()) {
+        word += command[++i];
+      } else {
+        word += c;
+      }
+      continue;
+    }
+
+    if (c == ' ' || c == '\t') {
+      if (in_word) {
+        words.push_back(std::move(word));
+        word.clear();
+        in_word = false;
+      }
+      continue;
+    }
+
+    if (std::strchr("|&;<>()$`*?[]~#\n{}", c))
+      return false;
+
+    in_word = true;
+    if (c == '\'' || c == '"') {
+      quote = c;
+    } else if (c == '\\' && i + 1 < command.size()) {
+      word += command[++i];
+    } else {
+      word += c;
+    }
+  }
+
+  if (quote)
+    return false;
+  if (in_word)
+    words.push_back(std::move(word));
+  return !words.empty();
+}
+
+} // namespace
+
+bool Bindings::parse(const WMConfig::Action &action, BoundAction &out) {
+  using WMConfig::ActionType;
+
+  if (action.type == "run") {
+    out.type = ActionType::run;
+    if (!tokenize(action.target, out.args)) {
+      if (action.target.empty())
+        return false;
+      out.args = {"/bin/sh", "-c", action.target};
+    }
+  } else if (action.type == "ch") {
+    out.type = ActionType::ch;
+    char *end = nullptr;
+    out.index = std::strtoul(action.target.c_str(), &end, 10);
+    if (action.target.empty() || *end != '\0')
+      return false;
+  } else if (action.type == "focus") {
+    out.type = ActionType::focus;
+    if (action.target == "next") {
+      out.index = BoundAction::FOCUS_NEXT;
+    } else if (action.target == "prev") {
+      out.index = BoundAction::FOCUS_PREV;
+    } else {
+      out.index = BoundAction::FOCUS_CLASS;
+      out.target = action.target;
+    }
+  } else if (action.type == "close") {
+    out.type = ActionType::close;
+  } else if (action.type == "toggle") {
+    out.type = ActionType::toggle;
+    out.target = action.target;
+    if (out.target.empty())
+      return false;
+  } else {
+    return false;
+  }
+
+  return true;
+}
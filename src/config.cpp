@@ -1,4 +1,5 @@
 #include "include/config.h"
+#include <algorithm>
 #include <cstdint>
 #include <iostream>
 
@@ -46,6 +47,14 @@ Config loadConfig(const std::string &filename) {
         if (auto windowTable = generalTable->get("window")->as_table()) {
             // Load the window gap from the table
             generalConfig.window.gap = windowTable->get("gap")->value_or(0);
+
+            // Attempt to get the "layouts" array, one name per workspace. It is
+            // optional, so look it up with get_as, which is null if it is missing
+            if (auto layoutsArray = windowTable->get_as<toml::array>("layouts")) {
+                for (const auto &layout : *layoutsArray) {
+                    generalConfig.window.layouts.push_back(layout.value_or(""));
+                }
+            }
         }
 
         // Attempt to get the "bindings" array from the general table, and load it into a vector
@@ -75,6 +84,48 @@ Config loadConfig(const std::string &filename) {
     return generalConfig;
 }
 
+/**
+ * Compare two configurations, field by field.
+ *
+ * @param old The configuration in use.
+ * @param next The configuration that replaces it.
+ * @return The parts that differ, as WMConfig::Changes flags.
+ */
+uint32_t WMConfig::diff(const WMConfig::General &old, const WMConfig::General &next) {
+    uint32_t changes = CHANGED_NONE;
+
+    if (old.startup != next.startup) {
+        changes |= CHANGED_STARTUP;
+    }
+
+    if (old.border.width != next.border.width) {
+        changes |= CHANGED_BORDER_WIDTH;
+    }
+    if (old.border.active_color != next.border.active_color ||
+        old.border.inactive_color != next.border.inactive_color) {
+        changes |= CHANGED_BORDER_COLORS;
+    }
+
+    if (old.window.gap != next.window.gap) {
+        changes |= CHANGED_GAP;
+    }
+    if (old.window.layouts != next.window.layouts) {
+        changes |= CHANGED_LAYOUTS;
+    }
+
+    // Bindings are compared in order, so moving one around counts as a change
+    auto same_binding = [](const Keybind &a, const Keybind &b) {
+        return a.mod == b.mod && a.keysym == b.keysym &&
+               a.action.type == b.action.type && a.action.target == b.action.target;
+    };
+    if (!std::equal(old.bindings.begin(), old.bindings.end(),
+                    next.bindings.begin(), next.bindings.end(), same_binding)) {
+        changes |= CHANGED_BINDINGS;
+    }
+
+    return changes;
+}
+
 /**
  * Print the configuration to the console.
  *
@@ -97,6 +148,9 @@ void WMConfig::debugConfig(const WMConfig::General &config) {
     // Print the window gap
     std::cout << "Window settings:\n"
               << " Gap: " << config.window.gap << '\n';
+    for (size_t i = 0; i < config.window.layouts.size(); ++i) {
+        std::cout << " Layout of workspace " << i << ": " << config.window.layouts[i] << '\n';
+    }
 
     // Print the keybindings
     std::cout << "Keybindings:\n";
@@ -0,0 +1,221 @@
+#include "include/event_loop.h"
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+namespace {
+
+/**
+ * How many ready descriptors one epoll_wait() returns at most. More stay
+ * ready for the next one.
+ */
+constexpr int MAX_EVENTS = 32;
+
+std::runtime_error system_error(const std::string &what) {
+  return std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+} // namespace
+
+EventLoop::EventLoop() {
+  sigemptyset(&signals);
+
+  epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd < 0)
+    throw system_error("epoll_create1 failed");
+
+  // steady_clock is CLOCK_MONOTONIC, so deadlines can be armed as they are.
+  timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+  if (timer_fd < 0 || signal_fd < 0) {
+    auto error = system_error("Unable to create the loop descriptors");
+    if (timer_fd >= 0)
+      close(timer_fd);
+    if (signal_fd >= 0)
+      close(signal_fd);
+    close(epoll_fd);
+    throw error;
+  }
+
+  add(timer_fd, EPOLLIN, [this](uint32_t) { run_timers(); });
+  add(signal_fd, EPOLLIN, [this](uint32_t) { read_signals(); });
+}
+
+EventLoop::~EventLoop() {
+  for (int fd : wakeup_fds) {
+    close(fd);
+  }
+  close(signal_fd);
+  close(timer_fd);
+  close(epoll_fd);
+}
+
+void EventLoop::add(int fd, uint32_t events, IoCallback callback) {
+  auto watch = std::make_unique<Watch>(Watch{fd, std::move(callback)});
+  epoll_event event = {};
+  event.events = events;
+  event.data.ptr = watch.get();
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0)
+    throw system_error("Unable to watch fd " + std::to_string(fd));
+  watches[fd] = std::move(watch);
+}
+
+void EventLoop::modify(int fd, uint32_t events) {
+  auto it = watches.find(fd);
+  if (it == watches.end())
+    return;
+  epoll_event event = {};
+  event.events = events;
+  event.data.ptr = it->second.get();
+  epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &event);
+}
+
+void EventLoop::remove(int fd) {
+  auto it = watches.find(fd);
+  if (it == watches.end())
+    return;
+  epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+
+  // The watch may be the one running, or further down the current batch.
+  if (dispatching) {
+    it->second->removed = true;
+    removed.push_back(std::move(it->second));
+  }
+  watches.erase(it);
+}
+
+void EventLoop::on_signal(int signal, Callback callback) {
+  sigaddset(&signals, signal);
+  pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+  if (signalfd(signal_fd, &signals, 0) < 0)
+    throw system_error("Unable to handle signal " + std::to_string(signal));
+  signal_handlers[signal] = std::move(callback);
+}
+
+EventLoop::TimerId EventLoop::schedule(Clock::time_point deadline,
+                                       Callback callback) {
+  TimerId id = next_timer++;
+  timers.emplace(std::make_pair(deadline, id), std::move(callback));
+  deadlines.emplace(id, deadline);
+  if (timers.begin()->first.second == id) {
+    arm_timer();
+  }
+  return id;
+}
+
+void EventLoop::cancel(TimerId id) {
+  auto it = deadlines.find(id);
+  if (it == deadlines.end())
+    return;
+  bool first = timers.begin()->first.second == id;
+  timers.erase({it->second, id});
+  deadlines.erase(it);
+  if (first) {
+    arm_timer();
+  }
+}
+
+std::function<void()> EventLoop::add_wakeup(Callback callback) {
+  int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (fd < 0)
+    throw system_error("Unable to create an eventfd");
+  wakeup_fds.push_back(fd);
+
+  add(fd, EPOLLIN, [fd, callback = std::move(callback)](uint32_t) {
+    uint64_t count;
+    if (read(fd, &count, sizeof(count)) == sizeof(count)) {
+      callback();
+    }
+  });
+  return [fd] {
+    uint64_t one = 1;
+    // Only fails if the counter would overflow, when a wakeup is pending.
+    (void)!write(fd, &one, sizeof(one));
+  };
+}
+
+/**
+ * Arms the timerfd for the earliest timer, or disarms it if there is none.
+ */
+void EventLoop::arm_timer() {
+  itimerspec spec = {};
+  if (!timers.empty()) {
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                  timers.begin()->first.first.time_since_epoch())
+                  .count();
+    // A zero it_value would disarm the timer instead.
+    if (ns <= 0)
+      ns = 1;
+    spec.it_value.tv_sec = ns / 1000000000;
+    spec.it_value.tv_nsec = ns % 1000000000;
+  }
+  timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, nullptr);
+}
+
+void EventLoop::run_timers() {
+  uint64_t expirations;
+  (void)!read(timer_fd, &expirations, sizeof(expirations));
+
+  // Timers scheduled by the callbacks run on a later wakeup, even if due.
+  auto now = Clock::now();
+  while (!timers.empty() && timers.begin()->first.first <= now) {
+    auto node = timers.extract(timers.begin());
+    deadlines.erase(node.key().second);
+    node.mapped()();
+  }
+  arm_timer();
+}
+
+void EventLoop::read_signals() {
+  // Signals of the same number coalesce anyway, so each handler runs once
+  // however many were queued.
+  sigset_t seen;
+  sigemptyset(&seen);
+
+  signalfd_siginfo info;
+  while (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+    sigaddset(&seen, static_cast<int>(info.ssi_signo));
+  }
+
+  for (auto &[signal, handler] : signal_handlers) {
+    if (sigismember(&seen, signal)) {
+      handler();
+    }
+  }
+}
+
+void EventLoop::run() {
+  epoll_event events[MAX_EVENTS];
+  running = true;
+
+  while (running) {
+    if (prepare) {
+      prepare();
+      if (!running)
+        break;
+    }
+
+    int n = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      running = false;
+      throw system_error("epoll_wait failed");
+    }
+
+    dispatching = true;
+    for (int i = 0; i < n; ++i) {
+      auto *watch = static_cast<Watch *>(events[i].data.ptr);
+      if (!watch->removed) {
+        watch->callback(events[i].events);
+      }
+    }
+    dispatching = false;
+    removed.clear();
+  }
+}
@@ -0,0 +1,177 @@
+#include "include/fake_backend.h"
+#include <cstdlib>
+#include <cstring>
+#include <xcb/randr.h>
+
+FakeBackend::FakeBackend(std::shared_ptr<spdlog::logger>, uint32_t) {}
+
+FakeBackend::~FakeBackend() {
+  for (auto *event : events) {
+    free(event);
+  }
+}
+
+template <class Event> Event *FakeBackend::push_event(uint8_t type) {
+  static_assert(sizeof(Event) <= sizeof(xcb_generic_event_t),
+                "X events are 32 bytes");
+  auto *event = static_cast<Event *>(calloc(1, sizeof(xcb_generic_event_t)));
+  event->response_type = type;
+  events.push_back(reinterpret_cast<xcb_generic_event_t *>(event));
+  return event;
+}
+
+xcb_generic_event_t *FakeBackend::next_event() {
+  if (events.empty())
+    return nullptr;
+  auto *event = events.front();
+  events.pop_front();
+  return event;
+}
+
+void FakeBackend::push_unmap_notify(xcb_window_t window) {
+  if (!synthesizing)
+    return;
+  auto *event = push_event<xcb_unmap_notify_event_t>(XCB_UNMAP_NOTIFY);
+  event->event = window;
+  event->window = window;
+}
+
+void FakeBackend::map(xcb_window_t window) {
+  record(MAP, window);
+  auto it = windows.find(window);
+  if (it != windows.end()) {
+    it->second.mapped = true;
+  }
+}
+
+void FakeBackend::unmap(xcb_window_t window) {
+  record(UNMAP, window);
+  auto it = windows.find(window);
+  if (it != windows.end() && it->second.mapped) {
+    it->second.mapped = false;
+    push_unmap_notify(window);
+  }
+}
+
+bool FakeBackend::collect_properties(const Cookies &window,
+                                     ClientProperties &props,
+                                     bool &override_redirect) {
+  auto it = windows.find(window);
+  if (it == windows.end())
+    return false;
+  props = it->second.props;
+  override_redirect = it->second.override_redirect;
+  return true;
+}
+
+void FakeBackend::collect_fields(const Cookies &window,
+                                 ClientProperties &props) {
+  auto it = windows.find(window);
+  if (it != windows.end()) {
+    props = it->second.props;
+  }
+}
+
+uint8_t FakeBackend::property_field(xcb_atom_t atom) const {
+  switch (atom) {
+  case XCB_ATOM_WM_NAME:
+  case NET_WM_NAME:
+    return ClientProperties::FIELD_TITLE;
+  case XCB_ATOM_WM_CLASS:
+    return ClientProperties::FIELD_CLASS;
+  case XCB_ATOM_WM_HINTS:
+    return ClientProperties::FIELD_HINTS;
+  case XCB_ATOM_WM_NORMAL_HINTS:
+    return ClientProperties::FIELD_NORMAL_HINTS;
+  case NET_WM_WINDOW_TYPE:
+    return ClientProperties::FIELD_TYPE;
+  case NET_WM_STATE:
+    return ClientProperties::FIELD_STATE;
+  case WM_PROTOCOLS:
+    return ClientProperties::FIELD_PROTOCOLS;
+  default:
+    return 0;
+  }
+}
+
+xcb_window_t FakeBackend::create_window(ClientProperties props,
+                                        bool override_redirect) {
+  xcb_window_t window = next_window++;
+  add_window(window, std::move(props), override_redirect);
+  return window;
+}
+
+void FakeBackend::add_window(xcb_window_t window, ClientProperties props,
+                             bool override_redirect) {
+  windows[window] = {std::move(props), override_redirect, false};
+}
+
+void FakeBackend::destroy_window(xcb_window_t window) {
+  auto it = windows.find(window);
+  if (it == windows.end())
+    return;
+  if (it->second.mapped) {
+    push_unmap_notify(window);
+  }
+  windows.erase(it);
+  if (!synthesizing)
+    return;
+
+  auto *event = push_event<xcb_destroy_notify_event_t>(XCB_DESTROY_NOTIFY);
+  event->event = window;
+  event->window = window;
+}
+
+void FakeBackend::inject_map_request(xcb_window_t window) {
+  auto *event = push_event<xcb_map_request_event_t>(XCB_MAP_REQUEST);
+  event->parent = ROOT;
+  event->window = window;
+}
+
+void FakeBackend::inject_enter_notify(xcb_window_t window) {
+  auto *event = push_event<xcb_enter_notify_event_t>(XCB_ENTER_NOTIFY);
+  event->root = ROOT;
+  event->event = window;
+  event->mode = XCB_NOTIFY_MODE_NORMAL;
+}
+
+void FakeBackend::inject_property_notify(xcb_window_t window,
+                                         xcb_atom_t atom) {
+  auto *event = push_event<xcb_property_notify_event_t>(XCB_PROPERTY_NOTIFY);
+  event->window = window;
+  event->atom = atom;
+  event->state = XCB_PROPERTY_NEW_VALUE;
+}
+
+void FakeBackend::inject_screen_change(uint16_t width, uint16_t height) {
+  auto *event = push_event<xcb_randr_screen_change_notify_event_t>(
+      RANDR_BASE + XCB_RANDR_SCREEN_CHANGE_NOTIFY);
+  event->rotation = XCB_RANDR_ROTATION_ROTATE_0;
+  event->root = ROOT;
+  event->request_window = ROOT;
+  event->width = width;
+  event->height = height;
+}
+
+void FakeBackend::inject_event(const xcb_generic_event_t &event) {
+  auto *copy = push_event<xcb_generic_event_t>(event.response_type);
+  std::memcpy(copy, &event, sizeof(event));
+}
+
+void FakeBackend::inject_key_press(uint16_t state, xcb_keysym_t keysym) {
+  auto *event = push_event<xcb_key_press_event_t>(XCB_KEY_PRESS);
+  event->detail = FakeKeyboard::keycode(keysym);
+  event->root = ROOT;
+  event->event = ROOT;
+  event->state = state;
+}
+
+uint64_t FakeBackend::requests() const {
+  uint64_t total = 0;
+  for (int type = 0; type < REQUEST_TYPES; ++type) {
+    if (type != FLUSH) {
+      total += counts[type];
+    }
+  }
+  return total;
+}
@@ -1,303 +1,537 @@
 #include "include/helios.h"
+#include <cstdio>
+#include <csignal>
+#include <unistd.h>
 #include <sys/types.h>
 #include <xcb/xcb.h>
 #include <xcb/xproto.h>
 
 /**
- * @brief Construct a new WindowManager object
+ * @brief Construct a new window manager
  *
  * This function initializes a window manager, setting up the necessary
  * XCB connections, loading the configuration, and preparing the window
  * manager for use.
  *
+ * Startup is pipelined: the backend sends every request that does not depend
+ * on a reply first, the config file is parsed while the X server works
+ * through them, and only then are the replies collected. Requests whose only
+ * reply could be an error are not checked here; their errors arrive in the
+ * event loop and are reported by handle_error().
+ *
+ * With a fake backend the window manager only has its state: no signals are
+ * handled, no programs started, and nothing but process_events() runs it.
+ *
+ * @param preset The config to use instead of reading config_path.
  * @throw std::runtime_error if unable to connect to the X server
+ * @throw std::runtime_error if unable to access the screen
  * @throw std::runtime_error if unable to initialize ewmh cookie for connection
  * @throw std::runtime_error if unable to initialize ewmh connection with cookie
  * @throw std::runtime_error if cursor context initialization fails
  * @throw srd::runtime_error if cursor context creation fails
  */
-WindowManager::WindowManager()
-    : values(std::make_unique<uint32_t[]>(1)), atoms(nullptr) {
-  logger->flush_on(spdlog::level::info);
-  if (!(conn = xcb_connect(nullptr, nullptr))) {
-    logger->error("Could not connect to the X server");
-    throw std::runtime_error("X server connection failed");
+template <class Backend>
+BasicWindowManager<Backend>::BasicWindowManager(std::optional<Config> preset)
+    : backend(logger, event_mask) {
+  launcher = std::make_unique<Launcher>(logger);
+
+  // Before any thread is started, so that they all block these signals.
+  if constexpr (Backend::live) {
+    watch_signals();
   }
 
-  config = loadConfig("config.toml");
+  root = backend.root();
+  screen_area = backend.screen_area();
 
-  const xcb_setup_t *setup = xcb_get_setup(conn);
+  // Parse the config while the X server is busy.
+  config = preset ? std::move(*preset) : loadConfig(config_path);
+  set_layouts();
 
-  if (xcb_connection_has_error(conn)) {
-    logger->error(
-        "The Connection has an error and other stuff could not be proceeded");
-    exit(EXIT_FAILURE);
+  // Startup programs can start right away: their windows wait in the event
+  // queue until the loop runs.
+  if constexpr (Backend::live) {
+    launcher->spawn_all(config.startup);
   }
 
-  xcb_screen_iterator_t iter = xcb_setup_roots_iterator(setup);
-  if (!(screen = iter.data)) {
-    logger->error("Unable to access screen information. Ensure the X server is "
-                  "running and is accessible");
-  }
+  backend.finish_setup(NUM_WORKSPACES);
 
-  xcb_flush(conn);
-  root = screen->root;
+  // Waits for the keyboard and modifier mappings requested above.
+  grab_bindings();
 
-  xcb_intern_atom_cookie_t *ewmh_cookie = new xcb_intern_atom_cookie_t;
-
-  ewmh_cookie = xcb_ewmh_init_atoms(conn, &ewmh);
-  if (!ewmh_cookie) {
-    logger->error("EWMH cookie initialization failed");
-    throw std::runtime_error("EWMH cookie initialization failed");
+  if (uint8_t base = backend.shape_event_base()) {
+    extension_handlers[0].first_event = base;
+    extension_handlers[0].events = XCB_SHAPE_NOTIFY + 1;
+    extension_handlers[0].handlers[XCB_SHAPE_NOTIFY] =
+        &BasicWindowManager::handle_shape_notify;
   }
 
-  xcb_generic_error_t *error = nullptr;
-  if (!xcb_ewmh_init_atoms_replies(&ewmh, ewmh_cookie, &error)) {
-    if (error) {
-      logger->error("EWMH initialization failed: {}", error->major_code);
-      free(error);
-    } else {
-      logger->error(
-          "EWMH initialization failed with no error details available");
-    }
-    throw std::runtime_error("EWMH connection initialization failed");
+  if (uint8_t base = backend.randr_event_base()) {
+    extension_handlers[1].first_event = base;
+    extension_handlers[1].events = XCB_RANDR_NOTIFY + 1;
+    extension_handlers[1].handlers[XCB_RANDR_SCREEN_CHANGE_NOTIFY] =
+        &BasicWindowManager::handle_screen_change;
   }
 
-  supported_atoms = {ewmh._NET_SUPPORTED,
-                     ewmh._NET_SUPPORTING_WM_CHECK,
-                     ewmh._NET_ACTIVE_WINDOW,
-                     ewmh._NET_CLIENT_LIST,
-                     ewmh._NET_CURRENT_DESKTOP,
-                     ewmh._NET_DESKTOP_NAMES,
-                     ewmh._NET_NUMBER_OF_DESKTOPS,
-                     ewmh._NET_WM_NAME,
-                     ewmh._NET_WM_STATE,
-                     ewmh._NET_WM_STATE_FULLSCREEN,
-                     ewmh._NET_WM_WINDOW_TYPE,
-                     ewmh._NET_WM_WINDOW_TYPE_DIALOG,
-                     ewmh._NET_WM_WINDOW_TYPE_DOCK,
-                     ewmh._NET_WM_WINDOW_TYPE_DESKTOP};
+  WMConfig::debugConfig(config);
 
-  atoms = std::make_unique<xcb_atom_t[]>(supported_atoms.size());
+  if constexpr (Backend::live) {
+    // The X connection is drained by process_events() before every wait, so
+    // its callback has nothing left to do.
+    loop.add(backend.fd(), EPOLLIN, [](uint32_t) {});
+    loop.set_prepare([this] { process_events(); });
+
+    // The watcher thread wakes the event loop up through an eventfd.
+    try {
+      watcher = std::make_unique<ConfigWatcher>(
+          config_path, logger, loop.add_wakeup([this] { reload_config(); }));
+    } catch (const std::exception &e) {
+      logger->warn("Config hot-reload disabled: {}", e.what());
+    }
 
-  std::copy(supported_atoms.begin(), supported_atoms.end(), atoms.get());
+    try {
+      ipc = std::make_unique<Ipc::Server>(
+          loop, Ipc::socket_path(),
+          [this](uint16_t type, uint16_t flags, std::string_view payload,
+                 std::string &reply) {
+            return handle_ipc(type, flags, payload, reply);
+          });
+    } catch (const std::exception &e) {
+      logger->warn("IPC disabled: {}", e.what());
+    }
+  }
 
-  auto window = xcb_generate_id(conn);
+  // Loading a cursor takes round trips of its own inside xcb-cursor, so it
+  // comes last, once everything else is on its way.
+  backend.load_cursor();
 
-  xcb_create_window(conn, XCB_WINDOW_CLASS_COPY_FROM_PARENT, window, root, 0, 0,
-                    1, 1, 0, XCB_WINDOW_CLASS_INPUT_OUTPUT, screen->root_visual,
-                    {}, {});
+  logger->info("WM initialized, ready to go!");
+}
 
-  xcb_ewmh_set_supported(&ewmh, 0, supported_atoms.size(), atoms.get());
-  xcb_ewmh_set_supporting_wm_check(&ewmh, root, window);
-  xcb_ewmh_set_wm_name(&ewmh, root, strlen(WM_NAME), "" WM_NAME);
-  xcb_ewmh_set_supporting_wm_check(&ewmh, root, root);
-  xcb_ewmh_set_number_of_desktops(&ewmh, 0, 9);
-  xcb_ewmh_set_current_desktop(&ewmh, 0, 1);
-  xcb_ewmh_set_active_window(&ewmh, 0, root);
+/**
+ * @brief Pushes the tiles of the windows whose geometry changed to the X
+ * server.
+ *
+ * The kind of layout is switched on once per retile, and each kind has a
+ * tiling function of its own, so placing the windows makes no indirect call.
+ * Retiling never touches the input focus, that is left to commit_focus().
+ */
+template <class Backend>
+void BasicWindowManager<Backend>::tile_windows() {
+  using Layout::Engine;
+  using Layout::Kind;
+
+  switch (ws().kind) {
+  case Kind::dwindle:
+    tile_dwindle();
+    break;
+  case Kind::master_stack:
+    tile_with<Engine<Kind::master_stack>>();
+    break;
+  case Kind::monocle:
+    tile_with<Engine<Kind::monocle>>();
+    break;
+  case Kind::grid:
+    tile_with<Engine<Kind::grid>>();
+    break;
+  }
+}
 
-  windows = {};
+/**
+ * The dwindle layout of each workspace is kept in its own tree, which is
+ * updated incrementally as windows come and go:
+ *
+ * 1. The first window fills the screen, minus the gap.
+ * 2. Every subsequent window splits the window with the largest area in half,
+ *    alternating between vertical and horizontal splits, and takes the
+ *    newly created space.
+ *
+ * Only windows whose rectangle moved since the last retile are configured.
+ */
+template <class Backend>
+void BasicWindowManager<Backend>::tile_dwindle() {
+  Layout::Tree &layout = ws().layout;
+  layout.set_area(screen_area, config.window.gap);
 
-  for (auto kbd : config.bindings) {
-    grab_key(conn, kbd.mod, kbd.keysym, root);
-  }
+  auto border_width = static_cast<uint32_t>(config.border.width);
 
-  for (auto wrkspce = 0; wrkspce < 10; ++wrkspce) {
-    grab_key(conn, XK_Super_L, XK_0 + wrkspce, root);
-  }
+  layout.take_changes([&](xcb_window_t window, const Layout::Rect &rect) {
+    if (auto *client = clients.find(window)) {
+      configure_client(*client, rect, border_width);
+    }
+  });
+}
 
-  *values.get() = event_mask;
-  xcb_void_cookie_t event_mask_cookie =
-      xcb_change_window_attributes(conn, root, XCB_CW_EVENT_MASK, values.get());
-  xcb_generic_error_t *em_error = xcb_request_check(conn, event_mask_cookie);
-  if (!em_error) {
-    logger->info("Request Completed Successfully");
+/**
+ * Lays the tiled clients of the current workspace out in mapping order, into
+ * buffers that only grow, and configures those whose rectangle differs from
+ * the one the X server has.
+ *
+ * Engines that only show the focused window place it alone, and raise it
+ * unless it was the last window raised, so moving the focus costs a restack
+ * and at most one ConfigureWindow whatever the number of windows.
+ */
+template <class Backend>
+template <class Engine>
+void BasicWindowManager<Backend>::tile_with() {
+  Workspace &workspace = ws();
+
+  tile_order.clear();
+  if constexpr (Engine::focused_only) {
+    if (Client *client = clients.find(current_window);
+        client && workspace.layout.contains(current_window)) {
+      tile_order.push_back(client);
+    }
   } else {
-    auto code = em_error->error_code;
-    logger->error("Error in Request: Code {}", code);
+    for (auto *client = clients.find(workspace.windows.head); client;
+         client = clients.find(client->order.next)) {
+      if (workspace.layout.contains(client->window)) {
+        tile_order.push_back(client);
+      }
+    }
   }
-  xcb_flush(conn);
 
-  WMConfig::debugConfig(config);
+  tile_rects.resize(tile_order.size());
+  Engine::arrange(screen_area, config.window.gap, tile_order.size(),
+                  tile_rects.data());
 
-  for (std::string &program : config.startup) {
-    spawn(program.c_str());
+  auto border_width = static_cast<uint32_t>(config.border.width);
+  for (size_t i = 0; i < tile_order.size(); ++i) {
+    configure_client(*tile_order[i], tile_rects[i], border_width);
   }
 
-  if (xcb_cursor_context_new(conn, screen, &cursor_context) != 0) {
-    logger->error("Unable to create cursor context");
-    throw std::runtime_error("Cursor context creation failed");
-  }
+  // The tree is only kept for going back to dwindle, which marks every
+  // window anyway, so what it queued is of no use.
+  workspace.layout.take_changes([](xcb_window_t, const Layout::Rect &) {});
 
-  cursor = xcb_cursor_load_cursor(cursor_context, "left_ptr");
-  if (cursor == XCB_CURSOR_NONE) {
-    logger->error("Failed to load cursor");
-    xcb_cursor_context_free(cursor_context);
-    throw std::runtime_error("Unable to create cursor context");
+  if constexpr (Engine::focused_only) {
+    if (!tile_order.empty() && workspace.raised != current_window) {
+      backend.raise(current_window);
+      workspace.raised = current_window;
+    }
   }
+}
 
-  xcb_void_cookie_t cursor_cookie =
-      xcb_change_window_attributes(conn, root, XCB_CW_CURSOR, &cursor);
-  xcb_generic_error_t *c_error = xcb_request_check(conn, cursor_cookie);
-  if (!c_error) {
-    logger->info("Request Completed Successfully");
-  } else {
-    auto code = c_error->error_code;
-    logger->error("Error in Request: Code {}", code);
-  }
-  xcb_flush(conn);
+/**
+ * Parses the layout names of the config, falling back to dwindle for the
+ * workspaces it names none or an unknown one for. A workspace whose kind
+ * changes gets retiled when it is next shown, the current one right away.
+ */
+template <class Backend>
+void BasicWindowManager<Backend>::set_layouts() {
+  const auto &names = config.window.layouts;
+  for (uint32_t i = 0; i < NUM_WORKSPACES; ++i) {
+    Layout::Kind kind = Layout::Kind::dwindle;
+    if (i < names.size() && !Layout::parse_kind(names[i], kind)) {
+      logger->warn("Unknown layout \"{}\" for workspace {}, using dwindle",
+                   names[i], i);
+    }
 
-  logger->info("WM initialized, ready to go!");
+    Workspace &workspace = workspaces[i];
+    if (workspace.kind == kind)
+      continue;
+
+    workspace.kind = kind;
+    workspace.raised = XCB_NONE;
+    if (kind == Layout::Kind::dwindle) {
+      // The tree still has the rectangles of before the other layout.
+      workspace.layout.mark_all();
+    }
+    if (i == current_workspace) {
+      mark_dirty(DIRTY_LAYOUT);
+    }
+  }
 }
 
 /**
- * @brief  Tile all windows in the list in a non-overlapping manner across the
- * screen. The tiling algorithm is as follows:
+ * Moves, resizes and sets the border width of a client with a single
+ * ConfigureWindow request that carries only the values the X server does not
+ * already have. Nothing is sent if they are all up to date. Shaped clients
+ * always get a border width of 0, as the border would ignore their shape.
  *
- * 1. Split the screen in half horizontally.
- * 2. Place the first window in the top half of the screen.
- * 3. For each subsequent window:
- *    a. Find the window with the largest area.
- *    b. Split that window in half, either horizontally or vertically,
- *       depending on the previous split direction.
- *    c. Place the new window in the newly created space.
- *    d. Switch the split direction.
+ * @param client The client to configure.
+ * @param rect The geometry to give it.
+ * @param border_width The border width to give it.
  */
-void WindowManager::tile_windows() {
-  int num_windows = windows.size();
-  if (num_windows == 0)
-    return;
+template <class Backend>
+void BasicWindowManager<Backend>::configure_client(Client &client,
+                                                   const Layout::Rect &rect,
+                                                   uint32_t border_width) {
+  if (client.shaped) {
+    border_width = 0;
+  }
 
-  int screen_width = screen->width_in_pixels;
-  int screen_height = screen->height_in_pixels;
-  int gap = config.window.gap;
-  int border_width = config.border.width;
-
-  if (num_windows == 1) {
-    uint32_t values[4] = {static_cast<uint32_t>(gap),
-                          static_cast<uint32_t>(gap),
-                          static_cast<uint32_t>(screen_width - 2 * gap),
-                          static_cast<uint32_t>(screen_height - 2 * gap)};
-
-    uint32_t border_values[1] = {static_cast<uint32_t>(border_width)};
-    xcb_configure_window(conn, windows[0], XCB_CONFIG_WINDOW_BORDER_WIDTH,
-                         border_values);
-    xcb_configure_window(conn, windows[0],
-                         XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y |
-                             XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT,
-                         values);
-    xcb_set_input_focus(conn, XCB_INPUT_FOCUS_POINTER_ROOT, windows[0],
-                        XCB_CURRENT_TIME);
-    xcb_flush(conn);
-    return;
+  bool geometry_known = client.known & Client::KNOWN_GEOMETRY;
+  bool border_known = client.known & Client::KNOWN_BORDER_WIDTH;
+
+  uint16_t mask = 0;
+  uint32_t values[5];
+  int n = 0;
+
+  if (!geometry_known || client.geometry.x != rect.x) {
+    mask |= XCB_CONFIG_WINDOW_X;
+    values[n++] = static_cast<uint32_t>(rect.x);
+  }
+  if (!geometry_known || client.geometry.y != rect.y) {
+    mask |= XCB_CONFIG_WINDOW_Y;
+    values[n++] = static_cast<uint32_t>(rect.y);
+  }
+  if (!geometry_known || client.geometry.width != rect.width) {
+    mask |= XCB_CONFIG_WINDOW_WIDTH;
+    values[n++] = static_cast<uint32_t>(rect.width);
+  }
+  if (!geometry_known || client.geometry.height != rect.height) {
+    mask |= XCB_CONFIG_WINDOW_HEIGHT;
+    values[n++] = static_cast<uint32_t>(rect.height);
+  }
+  if (!border_known || client.border_width != border_width) {
+    mask |= XCB_CONFIG_WINDOW_BORDER_WIDTH;
+    values[n++] = border_width;
   }
 
-  struct WindowRect {
-    int x, y, width, height;
-  };
-  std::vector<WindowRect> window_rects(num_windows);
+  client.geometry = rect;
+  client.border_width = border_width;
+  client.known |= Client::KNOWN_GEOMETRY | Client::KNOWN_BORDER_WIDTH;
 
-  window_rects[0] = {gap, gap, screen_width - 2 * gap, screen_height - 2 * gap};
+  if (!mask) {
+    ++stats.requests_saved;
+    return;
+  }
 
-  bool split_horizontal = false;
-  for (int i = 1; i < num_windows; i++) {
+  backend.configure(client.window, mask, values);
+  HELIOS_STAT(++metrics.counters.configures);
+}
 
-    int largest_idx = i - 1;
-    int largest_area = 0;
-    for (int j = 0; j < i; j++) {
-      int area = window_rects[j].width * window_rects[j].height;
-      if (area > largest_area) {
-        largest_area = area;
-        largest_idx = j;
-      }
+/**
+ * Sets the border color of a window, unless it already has that color.
+ *
+ * @param window The X window for which to set the border color.
+ * @param color The color to set the border to, in 32-bit ARGB format.
+ */
+template <class Backend>
+void BasicWindowManager<Backend>::set_window_border_color(xcb_window_t window,
+                                                          uint32_t color) {
+  if (auto *client = clients.find(window)) {
+    Client &c = *client;
+    if (c.known & Client::KNOWN_BORDER_PIXEL && c.border_pixel == color) {
+      ++stats.requests_saved;
+      return;
     }
+    c.border_pixel = color;
+    c.known |= Client::KNOWN_BORDER_PIXEL;
+  }
 
-    WindowRect &to_split = window_rects[largest_idx];
-    WindowRect &new_window = window_rects[i];
-
-    if (split_horizontal) {
+  backend.set_border_color(window, color);
+}
 
-      int new_height = (to_split.height - gap) / 2;
-      new_window = {to_split.x, to_split.y + new_height + gap, to_split.width,
-                    to_split.height - new_height - gap};
-      to_split.height = new_height;
-    } else {
+/**
+ * Sets the focus to a given window.
+ *
+ * @param window The window to set the focus to.
+ */
+template <class Backend>
+void BasicWindowManager<Backend>::set_focus(xcb_window_t window) {
+  update_focus(window);
+}
 
-      int new_width = (to_split.width - gap) / 2;
-      new_window = {to_split.x + new_width + gap, to_split.y,
-                    to_split.width - new_width - gap, to_split.height};
-      to_split.width = new_width;
-    }
+template <class Backend>
+void BasicWindowManager<Backend>::update_focus(xcb_window_t window) {
+  auto *client = clients.find(window);
+  if (!client)
+    return;
 
-    split_horizontal = !split_horizontal;
+  auto &history = workspaces[client->workspace].history;
+  if (history.head != window) {
+    clients.unlink(history, &Client::history, *client);
+    clients.push_front(history, &Client::history, *client);
   }
 
-  for (int i = 0; i < num_windows; i++) {
-    const auto &rect = window_rects[i];
-    uint32_t values[4] = {
-        static_cast<uint32_t>(rect.x), static_cast<uint32_t>(rect.y),
-        static_cast<uint32_t>(rect.width), static_cast<uint32_t>(rect.height)};
+  current_window = window;
+  mark_dirty(DIRTY_FOCUS | DIRTY_BORDERS);
 
-    uint32_t border_values[1] = {static_cast<uint32_t>(border_width)};
-    xcb_configure_window(conn, windows[i], XCB_CONFIG_WINDOW_BORDER_WIDTH,
-                         border_values);
-    xcb_configure_window(conn, windows[i],
-                         XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y |
-                             XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT,
-                         values);
-    xcb_set_input_focus(conn, XCB_INPUT_FOCUS_POINTER_ROOT, windows[i],
-                        XCB_CURRENT_TIME);
+  // The focused window is the one monocle shows.
+  if (workspaces[client->workspace].kind == Layout::Kind::monocle) {
+    mark_dirty(DIRTY_LAYOUT);
   }
+}
 
-  xcb_flush(conn);
+/**
+ * Moves the focus to the most recently focused window of the current
+ * workspace that is still tiled, after the focused window went away.
+ */
+template <class Backend>
+void BasicWindowManager<Backend>::focus_fallback() {
+  const Workspace &workspace = ws();
+  for (auto *client = clients.find(workspace.history.head); client;
+       client = clients.find(client->history.next)) {
+    if (workspace.layout.contains(client->window)) {
+      update_focus(client->window);
+      return;
+    }
+  }
 }
 
 /**
- * Sets the border color of a window.
+ * Reconciles the focus and the active border with current_window.
  *
- * @param window The X window for which to set the border color.
- * @param color The color to set the border to, in 32-bit ARGB format.
+ * This is the only place that sets the input focus. Only the final focus
+ * target of a batch reaches the X server, and only if it differs from what
+ * the server already has, so mapping a burst of windows or retiling sends at
+ * most one SetInputFocus and paints one active border.
  */
-void WindowManager::set_window_border_color(xcb_window_t window,
-                                            uint32_t color) {
-  xcb_change_window_attributes(conn, window, XCB_CW_BORDER_PIXEL, &color);
-  xcb_flush(conn);
+template <class Backend>
+void BasicWindowManager<Backend>::commit_focus() {
+  if (dirty & DIRTY_BORDERS && committed_focus != current_window) {
+    if (committed_focus != XCB_NONE) {
+      set_window_border_color(committed_focus, config.border.inactive_color);
+    }
+    if (current_window != XCB_NONE) {
+      set_window_border_color(current_window, config.border.active_color);
+    }
+  }
+
+  if (dirty & DIRTY_FOCUS && current_window != XCB_NONE &&
+      current_window != committed_focus) {
+    backend.focus(current_window);
+  }
+
+  committed_focus = current_window;
 }
 
 /**
- * Sets the focus to a given window.
+ * Records that some state must be pushed to the X server once the current
+ * batch of events has been handled.
  *
- * @param window The window to set the focus to.
+ * @param flags The DirtyFlags to set.
  */
-void WindowManager::set_focus(xcb_window_t window) {
-  xcb_set_input_focus(conn, XCB_INPUT_FOCUS_POINTER_ROOT, window,
-                      XCB_CURRENT_TIME);
-  update_focus(window);
-  xcb_flush(conn);
+template <class Backend>
+void BasicWindowManager<Backend>::mark_dirty(uint8_t flags) {
+  if (flags & dirty & DIRTY_LAYOUT) {
+    ++stats.retiles_coalesced;
+  }
+  dirty |= flags;
 }
 
-void WindowManager::update_focus(xcb_window_t window) {
-  if (current_window != XCB_NONE && current_window != window) {
-    set_window_border_color(current_window, config.border.inactive_color);
+/**
+ * Commits everything marked dirty during the batch: the adoption of the
+ * windows mapped during it, then at most one retile, one focus change and
+ * one flush, no matter how many events asked for them.
+ */
+template <class Backend>
+void BasicWindowManager<Backend>::commit() {
+  HELIOS_STAT(bool adopting = !pending_adoptions.empty());
+  if (!pending_adoptions.empty()) {
+    adopt_pending();
+  }
+
+  if (dirty & DIRTY_PROPERTIES) {
+    refresh_properties();
+  }
+
+  if (dirty & DIRTY_LAYOUT) {
+    tile_windows();
+    ++stats.retiles;
+    HELIOS_STAT(++metrics.counters.retiles);
+  }
+
+  HELIOS_STAT(bool focus_moved = false);
+  if (dirty & (DIRTY_FOCUS | DIRTY_BORDERS)) {
+    HELIOS_STAT(focus_moved = committed_focus != current_window);
+    commit_focus();
   }
 
-  if (window != XCB_NONE) {
-    current_window = window;
-    set_window_border_color(window, config.border.active_color);
-    xcb_set_input_focus(conn, XCB_INPUT_FOCUS_POINTER_ROOT, window,
-                        XCB_CURRENT_TIME);
+  dirty = DIRTY_NONE;
+  ++stats.batches;
+  backend.flush();
+  if (recorder) {
+    recorder->commit();
   }
+
+#ifdef HELIOS_STATS
+  ++metrics.counters.flushes;
+  if (input_start && focus_moved) {
+    Stats::record_since(metrics.input_to_focus, *input_start);
+  }
+  if (map_start && adopting) {
+    Stats::record_since(metrics.map_to_tile, *map_start);
+  }
+  input_start.reset();
+  map_start.reset();
+  metrics.next_batch();
+#endif
 }
 
 /**
  * Switches to the workspace with the given index.
  *
+ * The windows of the new workspace are mapped and those of the old one
+ * unmapped in the same batch. The UnmapNotify events this generates are
+ * expected by the clients and ignored. The focus goes back to the window
+ * that had it when the workspace was left. Both layouts are left untouched, and
+ * the geometry the X server has for every window is still the one in the
+ * client shadow, so switching back and forth sends no ConfigureWindow.
+ *
  * @param i The index of the workspace to switch to.
  */
-void WindowManager::switch_workspace(uint32_t i) {
-  uint32_t data[] = {i};
-  xcb_ewmh_set_current_desktop(&ewmh, 0, data[0]);
-  xcb_flush(conn);
+template <class Backend>
+void BasicWindowManager<Backend>::switch_workspace(uint32_t i) {
+  if (i == current_workspace || i >= NUM_WORKSPACES)
+    return;
+
+  Workspace &outgoing = ws();
+  Workspace &incoming = workspaces[i];
+
+  for (auto *client = clients.find(incoming.windows.head); client;
+       client = clients.find(client->order.next)) {
+    if (incoming.layout.contains(client->window)) {
+      backend.map(client->window);
+    }
+  }
+
+  for (auto *client = clients.find(outgoing.windows.head); client;
+       client = clients.find(client->order.next)) {
+    if (outgoing.layout.contains(client->window)) {
+      ++client->ignore_unmaps;
+      backend.unmap(client->window);
+    }
+  }
+
+  current_workspace = i;
+  backend.set_current_desktop(i);
+
+  current_window = XCB_NONE;
+  focus_fallback();
+  mark_dirty(DIRTY_LAYOUT);
+}
+
+/**
+ * Appends a client to the window list of a workspace. The caller decides
+ * whether it gets a tile.
+ *
+ * @param client The client to attach.
+ * @param workspace The index of the workspace.
+ */
+template <class Backend>
+void BasicWindowManager<Backend>::attach(Client &client, uint32_t workspace) {
+  client.workspace = workspace;
+  clients.push_back(workspaces[workspace].windows, &Client::order, client);
+  backend.set_wm_desktop(client.window, workspace);
+}
+
+/**
+ * Removes a client from its workspace and its focus history, giving its tile
+ * to its neighbour.
+ *
+ * @param client The client to detach.
+ */
+template <class Backend>
+void BasicWindowManager<Backend>::detach(Client &client) {
+  Workspace &workspace = workspaces[client.workspace];
+  clients.unlink(workspace.windows, &Client::order, client);
+  clients.unlink(workspace.history, &Client::history, client);
+  workspace.layout.remove(client.window);
+  if (workspace.raised == client.window) {
+    workspace.raised = XCB_NONE;
+  }
 }
 
 /**
@@ -306,157 +540,996 @@ void WindowManager::switch_workspace(uint32_t i) {
  * @param window The window which generated the EnterNotify event.
  *
  */
-void WindowManager::handle_enter_notify(xcb_generic_event_t *ev) {
+template <class Backend>
+void BasicWindowManager<Backend>::handle_enter_notify(xcb_generic_event_t *ev) {
   auto event = (xcb_enter_notify_event_t *)ev;
   auto window = event->event;
   if (window == XCB_WINDOW_NONE)
     return;
 
-  if (std::find(windows.begin(), windows.end(), window) == windows.end())
+  if (!ws().layout.contains(window))
     return;
 
   if (current_window != window) {
     update_focus(window);
-    xcb_flush(conn);
   }
 }
 
 /**
- * Handles a KeyPress event by switching to the workspace that corresponds
- * to the number key that was pressed (0-9). If the key press is not a number
- * key with the Mod4 modifier, the function does nothing.
+ * Only notes which fields of the client went stale. They are read again at
+ * the end of the batch, together with those of every other client, except
+ * titles: a live window manager waits TITLE_DELAY for them, so that the
+ * titles a terminal sets as fast as it prints are read once.
+ */
+template <class Backend>
+void BasicWindowManager<Backend>::handle_property_notify(
+    xcb_generic_event_t *ev) {
+  auto event = (xcb_property_notify_event_t *)ev;
+  uint8_t field = backend.property_field(event->atom);
+  if (!field)
+    return;
+
+  Client *client = clients.find(event->window);
+  if (!client)
+    return;
+
+  if (!client->stale) {
+    stale_clients.push_back(client->window);
+  }
+  client->stale |= field;
+
+  if constexpr (Backend::live) {
+    if (field == ClientProperties::FIELD_TITLE) {
+      if (!title_refresh_scheduled) {
+        title_refresh_scheduled = true;
+        loop.schedule(TITLE_DELAY, [this] {
+          title_refresh_scheduled = false;
+          mark_dirty(DIRTY_PROPERTIES);
+        });
+      }
+      return;
+    }
+  }
+  mark_dirty(DIRTY_PROPERTIES);
+}
+
+/**
+ * Sends the requests for every stale client before waiting for any reply,
+ * like adopt_pending().
+ */
+template <class Backend>
+void BasicWindowManager<Backend>::refresh_properties() {
+  size_t count = 0;
+  for (xcb_window_t window : stale_clients) {
+    Client *client = clients.find(window);
+    if (!client || !client->stale)
+      continue;
+    refresh_cookies.push_back(backend.request_fields(window, client->stale));
+    refresh_fields.push_back(client->stale);
+    client->stale = 0;
+    stale_clients[count++] = window;
+  }
+
+  if (count) {
+    HELIOS_STAT(++metrics.counters.round_trips);
+  }
+  for (size_t i = 0; i < count; ++i) {
+    if (Client *client = clients.find(stale_clients[i])) {
+      backend.collect_fields(refresh_cookies[i], client->props);
+      if (recorder) {
+        recorder->refresh(client->window, refresh_fields[i], client->props);
+      }
+    }
+  }
+
+  stale_clients.clear();
+  refresh_cookies.clear();
+  refresh_fields.clear();
+}
+
+/**
+ * All key bindings: the ones from the config file, followed by Mod4 plus a
+ * digit to switch to the workspace of that number.
+ */
+template <class Backend>
+std::vector<WMConfig::Keybind>
+BasicWindowManager<Backend>::key_bindings() const {
+  auto binds = config.bindings;
+  for (uint32_t wrkspce = 0; wrkspce < 10; ++wrkspce) {
+    binds.push_back({XCB_MOD_MASK_4, XK_0 + wrkspce,
+                     {"ch", std::to_string(wrkspce)}});
+  }
+  return binds;
+}
+
+/**
+ * Grabs every key binding and compiles the table handle_key_press() looks
+ * key presses up in.
+ */
+template <class Backend>
+void BasicWindowManager<Backend>::grab_bindings() {
+  auto binds = key_bindings();
+  auto &keyboard = backend.keyboard();
+
+  keyboard.ungrab_all();
+  for (const auto &kbd : binds) {
+    if (!keyboard.grab(modifier_mask(kbd.mod), kbd.keysym)) {
+      logger->warn("No key produces keysym {:#x}, binding not grabbed",
+                   kbd.keysym);
+    }
+  }
+
+  for (auto i : bindings.compile(binds, keyboard)) {
+    logger->warn("Ignoring binding with invalid action \"{}\" \"{}\"",
+                 binds[i].action.type, binds[i].action.target);
+  }
+}
+
+/**
+ * Moves the key grabs from one set of bindings to the current one. Key
+ * combinations bound in both keep their grab, whatever their action, so
+ * editing one binding sends a handful of requests instead of regrabbing
+ * every key.
+ *
+ * @param old The bindings before the config changed.
+ */
+template <class Backend>
+void BasicWindowManager<Backend>::regrab_bindings(
+    const std::vector<WMConfig::Keybind> &old) {
+  auto binds = key_bindings();
+
+  auto combos = [](const std::vector<WMConfig::Keybind> &list) {
+    std::vector<std::pair<uint16_t, xcb_keysym_t>> set;
+    for (const auto &kbd : list) {
+      set.emplace_back(modifier_mask(kbd.mod), kbd.keysym);
+    }
+    std::sort(set.begin(), set.end());
+    set.erase(std::unique(set.begin(), set.end()), set.end());
+    return set;
+  };
+  auto before = combos(old);
+  auto after = combos(binds);
+
+  std::vector<std::pair<uint16_t, xcb_keysym_t>> removed, added;
+  std::set_difference(before.begin(), before.end(), after.begin(), after.end(),
+                      std::back_inserter(removed));
+  std::set_difference(after.begin(), after.end(), before.begin(), before.end(),
+                      std::back_inserter(added));
+
+  auto &keyboard = backend.keyboard();
+  for (const auto &[mods, keysym] : removed) {
+    keyboard.ungrab(mods, keysym);
+  }
+  for (const auto &[mods, keysym] : added) {
+    if (!keyboard.grab(mods, keysym)) {
+      logger->warn("No key produces keysym {:#x}, binding not grabbed", keysym);
+    }
+  }
+
+  for (auto i : bindings.compile(binds, keyboard)) {
+    logger->warn("Ignoring binding with invalid action \"{}\" \"{}\"",
+                 binds[i].action.type, binds[i].action.target);
+  }
+  logger->info("Bindings reloaded: {} grabs removed, {} added", removed.size(),
+               added.size());
+}
+
+/**
+ * Applies the config parsed by the watcher, if there is one.
+ */
+template <class Backend>
+void BasicWindowManager<Backend>::reload_config() {
+  if (!watcher)
+    return;
+  if (auto next = watcher->take()) {
+    apply_config(std::move(*next));
+  }
+}
+
+/**
+ * Handles SIGHUP by asking the watcher thread to parse the config file
+ * again, whether or not it can watch it. The result comes back through
+ * reload_config(), like that of a saved file, so the event loop never waits
+ * for the parse.
+ */
+template <class Backend>
+void BasicWindowManager<Backend>::reread_config() {
+  if (!watcher) {
+    logger->warn("Config reload unavailable, ignoring SIGHUP");
+    return;
+  }
+  watcher->request();
+}
+
+/**
+ * Switches to a new config. Only the parts that changed are pushed to the X
+ * server: new bindings are grabbed, new colors repainted and a new gap or
+ * border width retiled. Everything else, the layouts included, is kept.
+ */
+template <class Backend>
+void BasicWindowManager<Backend>::apply_config(Config next) {
+  uint32_t changes = WMConfig::diff(config, next);
+  auto old_bindings = key_bindings();
+  config = std::move(next);
+  logger->info("Config reloaded, changes {:#x}", changes);
+
+  if (changes & WMConfig::CHANGED_BINDINGS) {
+    regrab_bindings(old_bindings);
+  }
+
+  if (changes & WMConfig::CHANGED_BORDER_COLORS) {
+    for (const auto &client : clients) {
+      set_window_border_color(client.window, client.window == committed_focus
+                                                 ? config.border.active_color
+                                                 : config.border.inactive_color);
+    }
+  }
+
+  if (changes & WMConfig::CHANGED_BORDER_WIDTH) {
+    auto border_width = static_cast<uint32_t>(config.border.width);
+    for (auto &client : clients) {
+      if (client.known & Client::KNOWN_GEOMETRY) {
+        configure_client(client, client.geometry, border_width);
+      }
+    }
+  }
+
+  if (changes & WMConfig::CHANGED_GAP) {
+    mark_dirty(DIRTY_LAYOUT);
+  }
+
+  if (changes & WMConfig::CHANGED_LAYOUTS) {
+    set_layouts();
+  }
+}
+
+/**
+ * Handles a KeyPress event by running the action bound to the key, if any.
+ * The lookup is a single hash lookup on the modifiers and keycode, and the
+ * action was parsed when the bindings were compiled.
  *
  * @param key_press The KeyPress event to handle.
  */
-void WindowManager::handle_key_press(xcb_generic_event_t *ev) {
+template <class Backend>
+void BasicWindowManager<Backend>::handle_key_press(xcb_generic_event_t *ev) {
   auto key_press = (xcb_key_press_event_t *)ev;
-  for (int i = 0; i <= 9; ++i) {
-    if (key_press->state == XK_Alt_L && key_press->detail == XK_0 + i) {
-      switch_workspace(i);
+  const BoundAction *action = bindings.find(
+      backend.keyboard().clean_mask(key_press->state), key_press->detail);
+  if (action) {
+    run_action(*action);
+  }
+}
+
+/**
+ * Runs a compiled key binding action.
+ *
+ * @param action The action to run.
+ */
+template <class Backend>
+void BasicWindowManager<Backend>::run_action(const BoundAction &action) {
+  using WMConfig::ActionType;
+
+  switch (action.type) {
+  case ActionType::run:
+    // A fake server has no display for programs to show up on.
+    if constexpr (Backend::live) {
+      launcher->spawn(action.argv.data());
+    }
+    break;
+  case ActionType::ch:
+    switch_workspace(action.index);
+    break;
+  case ActionType::focus:
+    if (action.index == BoundAction::FOCUS_CLASS) {
+      if (auto *client = find_by_class(action.target)) {
+        if (ws().layout.contains(client->window)) {
+          update_focus(client->window);
+        }
+      }
+    } else {
+      cycle_focus(action.index == BoundAction::FOCUS_NEXT ? 1 : -1);
+    }
+    break;
+  case ActionType::close:
+    if (current_window != XCB_NONE) {
+      close_window(current_window);
+    }
+    break;
+  case ActionType::toggle:
+    if (auto *client = find_by_class(action.target)) {
+      toggle_window(client->window);
+    }
+    break;
+  }
+}
+
+/**
+ * Moves the focus to the next or previous tiled window, in mapping order.
+ *
+ * @param step 1 for the next window, -1 for the previous one.
+ */
+template <class Backend>
+void BasicWindowManager<Backend>::cycle_focus(int step) {
+  const Workspace &workspace = ws();
+  const auto &list = workspace.windows;
+  if (list.head == XCB_NONE)
+    return;
+
+  auto step_from = [&](xcb_window_t window) {
+    const Client *client = clients.find(window);
+    xcb_window_t next = client ? (step > 0 ? client->order.next
+                                           : client->order.prev)
+                               : XCB_NONE;
+    if (next == XCB_NONE) {
+      next = step > 0 ? list.head : list.tail;
+    }
+    return next;
+  };
+
+  const Client *focused = clients.find(current_window);
+  xcb_window_t start = focused && focused->workspace == current_workspace
+                           ? current_window
+                           : XCB_NONE;
+
+  xcb_window_t window = start;
+  for (size_t i = 0; i < clients.size(); ++i) {
+    window = step_from(window);
+    if (workspace.layout.contains(window)) {
+      update_focus(window);
       return;
     }
   }
 }
 
 /**
- * Handles a MapRequest event by adding the window to the list of windows,
- * mapping the window, setting the border width and color, setting the input
- * focus to the window, and re-tiling the windows.
+ * Finds a client by its WM_CLASS class or instance name, on any workspace.
+ *
+ * @param name The name to look for.
+ * @return A matching client, or nullptr.
+ */
+template <class Backend>
+Client *BasicWindowManager<Backend>::find_by_class(const std::string &name) {
+  for (auto &client : clients) {
+    if (client.props.class_name == name || client.props.instance == name) {
+      return &client;
+    }
+  }
+  return nullptr;
+}
+
+/**
+ * Asks a window to close with WM_DELETE_WINDOW if it supports it, and
+ * disconnects its client otherwise.
+ *
+ * @param window The window to close.
+ */
+template <class Backend>
+void BasicWindowManager<Backend>::close_window(xcb_window_t window) {
+  const Client *client = clients.find(window);
+  if (!client)
+    return;
+
+  backend.close(window, client->props);
+}
+
+/**
+ * Hides a window tiled on the current workspace, or brings the window to the
+ * current workspace, shows and focuses it.
+ *
+ * A hidden window stays managed, but has no tile. The UnmapNotify caused by
+ * hiding it is ignored.
+ *
+ * @param window The window to toggle.
+ */
+template <class Backend>
+void BasicWindowManager<Backend>::toggle_window(xcb_window_t window) {
+  Client *found = clients.find(window);
+  if (!found)
+    return;
+  Client &client = *found;
+
+  if (client.workspace == current_workspace && ws().layout.contains(window)) {
+    ++client.ignore_unmaps;
+    backend.unmap(window);
+    ws().layout.remove(window);
+    if (window == current_window) {
+      current_window = XCB_NONE;
+      focus_fallback();
+    }
+    mark_dirty(DIRTY_LAYOUT);
+    return;
+  }
+
+  detach(client);
+  attach(client, current_workspace);
+
+  backend.map(window);
+  ws().layout.insert(window);
+  update_focus(window);
+  mark_dirty(DIRTY_LAYOUT);
+}
+
+/**
+ * Handles a MapRequest event by queueing the window for adoption. The
+ * window is adopted when the batch is committed, together with every other
+ * window that asked to be mapped in the same batch.
  *
  * @param window The window to handle.
  */
-void WindowManager::handle_map_request(xcb_generic_event_t *ev) {
+template <class Backend>
+void BasicWindowManager<Backend>::handle_map_request(xcb_generic_event_t *ev) {
   auto event = (xcb_map_request_event_t *)ev;
   auto window = event->window;
-  windows.push_back(window);
 
-  auto cookie = xcb_get_window_attributes(conn, window);
-  xcb_generic_error_t **e = nullptr;
-  auto _attr_reply = xcb_get_window_attributes_reply(conn, cookie, e);
+  if (std::find(pending_adoptions.begin(), pending_adoptions.end(), window) ==
+      pending_adoptions.end()) {
+    pending_adoptions.push_back(window);
+  }
+}
+
+/**
+ * Adopts every window queued by handle_map_request().
+ *
+ * The requests for the properties of all queued windows are sent before any
+ * reply is waited for, so adopting a whole burst of windows costs a single
+ * round trip.
+ */
+template <class Backend>
+void BasicWindowManager<Backend>::adopt_pending() {
+  adoption_cookies.clear();
+  for (auto window : pending_adoptions) {
+    adoption_cookies.push_back(backend.request_properties(window));
+  }
+  HELIOS_STAT(++metrics.counters.round_trips);
+
+  for (size_t i = 0; i < pending_adoptions.size(); ++i) {
+    manage(pending_adoptions[i], adoption_cookies[i]);
+  }
+
+  pending_adoptions.clear();
+
+  if (startup_bench) {
+    auto elapsed = std::chrono::steady_clock::now() - *startup_bench;
+    std::printf(
+        "startup: first MapRequest handled after %.3f ms\n",
+        std::chrono::duration<double, std::milli>(elapsed).count());
+    std::fflush(stdout);
+    startup_bench.reset();
+  }
+}
 
-  if (_attr_reply->override_redirect) {
-    delete _attr_reply;
-    delete e;
+/**
+ * Starts managing a window whose properties have been requested: maps it,
+ * sets its border color, gives it a tile and the focus. Override-redirect
+ * windows are left alone, and docks and desktop windows are mapped without
+ * being tiled.
+ *
+ * @param window The window to manage.
+ * @param cookies The cookies of its property requests.
+ */
+template <class Backend>
+void BasicWindowManager<Backend>::manage(
+    xcb_window_t window, const typename Backend::Cookies &cookies) {
+  ClientProperties props;
+  bool override_redirect = false;
+
+  if (!backend.collect_properties(cookies, props, override_redirect))
     return;
+  if (recorder) {
+    recorder->properties(window, props, override_redirect,
+                         backend.wants_tile(props));
   }
+  if (override_redirect)
+    return;
 
-  uint32_t values[] = {XCB_EVENT_MASK_ENTER_WINDOW |
-                       XCB_EVENT_MASK_FOCUS_CHANGE |
-                       XCB_EVENT_MASK_PROPERTY_CHANGE};
-  xcb_change_window_attributes(conn, window, XCB_CW_EVENT_MASK, values);
+  if (!backend.wants_tile(props)) {
+    backend.map(window);
+    return;
+  }
 
-  xcb_map_window(conn, window);
+  bool known = clients.contains(window);
+  Client &client = clients.insert(window);
+  client.props = std::move(props);
+  client.stale = 0;
 
-  auto border_width = static_cast<uint32_t>(config.border.width);
-  uint32_t border_values[2] = {border_width, border_width};
+  if (known) {
+    detach(client);
+  }
+  attach(client, current_workspace);
 
-  xcb_configure_window(conn, window, XCB_CONFIG_WINDOW_BORDER_WIDTH,
-                       border_values);
+  backend.select_client_input(window);
+  backend.map(window);
 
   set_window_border_color(window, config.border.inactive_color);
 
+  // New windows are stacked above the others.
+  ws().raised = XCB_NONE;
+  ws().layout.insert(window);
   update_focus(window);
-
-  xcb_flush(conn);
-  tile_windows();
-
-  delete _attr_reply;
-  delete e;
+  mark_dirty(DIRTY_LAYOUT);
 }
 
 /**
  * Handles a DestroyNotify event by destroying the window, removing it from
- * the list of windows, re-tiling the windows, and setting the input focus to
- * the last window in the list.
+ * the list of windows, moving the focus to the last window in the list if the
+ * destroyed window had it, and marking the layout dirty.
  *
  * @param window The window to handle.
  */
-void WindowManager::handle_destroy_notify(xcb_generic_event_t *ev) {
+template <class Backend>
+void BasicWindowManager<Backend>::handle_destroy_notify(
+    xcb_generic_event_t *ev) {
   auto event = (xcb_destroy_notify_event_t *)ev;
   auto window = event->window;
+  bool was_focused = window == current_window;
 
-  if (window == current_window) {
+  if (was_focused) {
     current_window = XCB_NONE;
   }
+  if (window == committed_focus) {
+    committed_focus = XCB_NONE;
+  }
+
+  // The window is already gone from the server, only our records of it
+  // are left.
+  pending_adoptions.erase(std::remove(pending_adoptions.begin(),
+                                      pending_adoptions.end(), window),
+                          pending_adoptions.end());
 
-  xcb_destroy_window(conn, window);
-  auto new_end = std::remove(windows.begin(), windows.end(), window);
-  windows.erase(new_end, windows.end());
+  if (auto *client = clients.find(window)) {
+    detach(*client);
+    clients.erase(window);
+  }
 
-  if (!windows.empty()) {
-    update_focus(windows.back());
+  if (was_focused) {
+    focus_fallback();
   }
 
-  xcb_flush(conn);
-  tile_windows();
+  mark_dirty(DIRTY_LAYOUT);
 }
 
 /**
- * Handles an UnmapNotify event by un-mapping the window, setting the input
- * focus to the last window in the list, and re-tiling the windows.
+ * Handles an UnmapNotify event. A client that unmaps itself is withdrawn,
+ * so it is forgotten: its tile goes to its neighbour, the focus goes back to
+ * the previously focused window if the client had it, and the layout is
+ * marked dirty. Unmaps done by the window manager itself are ignored.
  *
  * @param window The window to handle.
  */
-void WindowManager::handle_unmap_request(xcb_generic_event_t *ev) {
+template <class Backend>
+void BasicWindowManager<Backend>::handle_unmap_request(
+    xcb_generic_event_t *ev) {
   auto event = (xcb_unmap_notify_event_t *)ev;
   auto window = event->window;
 
-  if (window == current_window) {
+  auto *client = clients.find(window);
+  if (!client)
+    return;
+  if (client->ignore_unmaps > 0) {
+    --client->ignore_unmaps;
+    return;
+  }
+
+  bool was_focused = window == current_window;
+
+  if (was_focused) {
     current_window = XCB_NONE;
   }
-  xcb_unmap_window(conn, window);
+  if (window == committed_focus) {
+    committed_focus = XCB_NONE;
+  }
+  detach(*client);
+  clients.erase(window);
 
-  if (!windows.empty()) {
-    update_focus(windows.back());
+  if (was_focused) {
+    focus_fallback();
   }
 
-  xcb_flush(conn);
-  tile_windows();
+  mark_dirty(DIRTY_LAYOUT);
 }
 
 /**
- * Destructor for the WindowManager class.
+ * Destructor for the window manager.
  *
  * Cleans up and releases all resources associated with the window manager.
- * This includes clearing supported atoms, destroying all managed windows,
- * freeing the cursor, destroying the root window, disconnecting from the
- * X server, and freeing the cursor context if it exists. Logs a message
- * indicating that the window manager has stopped.
+ * Managed windows are left alone, so that clients survive a restart or
+ * another window manager taking over; the backend then hands focus back to
+ * PointerRoot and disconnects from the X server. Logs a message indicating
+ * that the window manager has stopped.
+ */
+template <class Backend>
+BasicWindowManager<Backend>::~BasicWindowManager() {
+  watcher.reset();
+  ipc.reset();
+  clients.clear();
+  logger->info("Handled {} events in {} batches: {} retiles, {} coalesced",
+               stats.events, stats.batches, stats.retiles,
+               stats.retiles_coalesced);
+  logger->info("Skipped {} redundant requests", stats.requests_saved);
+  logger->info("WM stopped");
+
+  // So that benchmarks can create another window manager.
+  spdlog::drop(logger->name());
+}
+
+/**
+ * Handles a ShapeNotify event. A client that gets a bounding shape loses its
+ * border, and gets it back when the shape is removed.
+ *
+ * @param ev The ShapeNotify event to handle.
  */
-WindowManager::~WindowManager() {
-  supported_atoms.clear();
-  for (auto wdow : windows) {
-    xcb_destroy_window(conn, wdow);
+template <class Backend>
+void BasicWindowManager<Backend>::handle_shape_notify(xcb_generic_event_t *ev) {
+  auto event = (xcb_shape_notify_event_t *)ev;
+  if (event->shape_kind != XCB_SHAPE_SK_BOUNDING)
+    return;
+
+  auto *found = clients.find(event->affected_window);
+  if (!found)
+    return;
+
+  Client &client = *found;
+  client.shaped = event->shaped;
+  if (client.known & Client::KNOWN_GEOMETRY) {
+    configure_client(client, client.geometry,
+                     static_cast<uint32_t>(config.border.width));
   }
-  windows.clear();
-  xcb_free_cursor(conn, cursor);
-  xcb_destroy_window(conn, root);
-  xcb_disconnect(conn);
+}
 
-  if (cursor_context) {
-    xcb_cursor_context_free(cursor_context);
+/**
+ * Handles a RandR ScreenChangeNotify event by adopting the new screen size
+ * and re-tiling.
+ *
+ * @param ev The ScreenChangeNotify event to handle.
+ */
+template <class Backend>
+void BasicWindowManager<Backend>::handle_screen_change(
+    xcb_generic_event_t *ev) {
+  auto event = (xcb_randr_screen_change_notify_event_t *)ev;
+  if (event->root != root)
+    return;
+
+  uint16_t width = event->width, height = event->height;
+  if (event->rotation &
+      (XCB_RANDR_ROTATION_ROTATE_90 | XCB_RANDR_ROTATION_ROTATE_270)) {
+    std::swap(width, height);
   }
-  logger->info("WM stopped");
+
+  screen_area.width = width;
+  screen_area.height = height;
+  mark_dirty(DIRTY_LAYOUT);
+}
+
+/**
+ * Handles a MappingNotify event by reloading the keyboard mapping, moving
+ * the grabs whose keys changed and recompiling the bindings if any did.
+ *
+ * @param ev The MappingNotify event to handle.
+ */
+template <class Backend>
+void BasicWindowManager<Backend>::handle_mapping_notify(
+    xcb_generic_event_t *ev) {
+  auto event = (xcb_mapping_notify_event_t *)ev;
+  HELIOS_STAT(++metrics.counters.round_trips);
+  if (backend.keyboard().refresh(event)) {
+    // Invalid actions were already reported by grab_bindings().
+    bindings.compile(key_bindings(), backend.keyboard());
+  }
+}
+
+/**
+ * Hands the signals that control the window manager to the event loop.
+ * SIGCHLD reaps children, SIGTERM and SIGINT end the loop so that the
+ * destructor runs, SIGHUP reads the config again, SIGUSR1 cycles the log
+ * level and SIGUSR2 dumps the event loop statistics.
+ */
+template <class Backend>
+void BasicWindowManager<Backend>::watch_signals() {
+  loop.on_signal(SIGCHLD, [this] { launcher->reap(); });
+  for (int signal : {SIGTERM, SIGINT}) {
+    loop.on_signal(signal, [this] {
+      logger->info("Shutting down");
+      loop.stop();
+    });
+  }
+  loop.on_signal(SIGHUP, [this] { reread_config(); });
+  loop.on_signal(SIGUSR1, [this] {
+    auto level = cycle_log_level(*logger);
+    logger->log(level, "Log level set to {}",
+                spdlog::level::to_string_view(level));
+  });
+  loop.on_signal(SIGUSR2, [this] { dump_stats(); });
+}
+
+/**
+ * Writes the statistics of the event loop to stats.txt and stats.json.
+ */
+template <class Backend>
+void BasicWindowManager<Backend>::dump_stats() {
+#ifdef HELIOS_STATS
+  const std::pair<const char *, std::string> dumps[] = {
+      {"stats.txt", metrics.text()}, {"stats.json", metrics.json() + "\n"}};
+  for (const auto &[path, contents] : dumps) {
+    std::FILE *file = std::fopen(path, "w");
+    if (!file) {
+      logger->error("Unable to write {}: {}", path, strerror(errno));
+      continue;
+    }
+    std::fwrite(contents.data(), 1, contents.size(), file);
+    std::fclose(file);
+  }
+  logger->info("Statistics written to stats.txt and stats.json");
+#else
+  logger->warn("Built without statistics, configure with -Dstats=true");
+#endif
+}
+
+/**
+ * Answers a request on the IPC socket. Actions go through the same parser and
+ * the same run_action() as key bindings, and queries are answered from the
+ * client registry and its shadow geometry, without asking the X server.
+ */
+template <class Backend>
+Ipc::Status BasicWindowManager<Backend>::handle_ipc(uint16_t type,
+                                                    uint16_t flags,
+                                                    std::string_view payload,
+                                                    std::string &reply) {
+  bool json = flags & Ipc::FLAG_JSON;
+
+  switch (type) {
+  case Ipc::REQUEST_ACTION: {
+    Ipc::Reader in(payload);
+    WMConfig::Action request;
+    request.type = in.str();
+    request.target = in.str();
+
+    BoundAction action;
+    if (!in.ok() || !in.done() || !Bindings::parse(request, action)) {
+      logger->warn("IPC: invalid action {} {}", request.type, request.target);
+      return Ipc::STATUS_INVALID;
+    }
+    if (action.type == WMConfig::ActionType::run) {
+      action.link_argv();
+    }
+    logger->debug("IPC: {} {}", request.type, request.target);
+    run_action(action);
+    return Ipc::STATUS_OK;
+  }
+  case Ipc::REQUEST_CLIENTS:
+    describe_clients(json, reply);
+    return Ipc::STATUS_OK;
+  case Ipc::REQUEST_LAYOUT:
+    describe_layout(json, reply);
+    return Ipc::STATUS_OK;
+  case Ipc::REQUEST_LOG_LEVEL: {
+    auto level = cycle_log_level(*logger);
+    auto name = spdlog::level::to_string_view(level);
+    std::string_view text(name.data(), name.size());
+    logger->log(level, "Log level set to {}", text);
+    if (json) {
+      reply = Ipc::json_string(text);
+    } else {
+      Ipc::Writer out;
+      out.str(text);
+      reply = std::move(out.data());
+    }
+    return Ipc::STATUS_OK;
+  }
+  default:
+    return Ipc::STATUS_UNKNOWN_REQUEST;
+  }
+}
+
+template <class Backend>
+void BasicWindowManager<Backend>::describe_clients(bool json,
+                                                   std::string &reply) {
+  Ipc::Writer out;
+  if (json) {
+    reply = "[";
+  } else {
+    out.u32(static_cast<uint32_t>(clients.size()));
+  }
+
+  for (const auto &client : clients) {
+    uint32_t flags = 0;
+    if (client.window == current_window)
+      flags |= Ipc::CLIENT_FOCUSED;
+    if (workspaces[client.workspace].layout.contains(client.window))
+      flags |= Ipc::CLIENT_TILED;
+    if (client.props.urgent)
+      flags |= Ipc::CLIENT_URGENT;
+    const Layout::Rect &g = client.geometry;
+
+    if (json) {
+      if (reply.size() > 1)
+        reply += ',';
+      reply += fmt::format(
+          "{{\"window\":{},\"workspace\":{},\"x\":{},\"y\":{},"
+          "\"width\":{},\"height\":{},\"focused\":{},\"tiled\":{},"
+          "\"urgent\":{},\"instance\":{},\"class\":{},\"title\":{}}}",
+          client.window, client.workspace, g.x, g.y, g.width, g.height,
+          bool(flags & Ipc::CLIENT_FOCUSED), bool(flags & Ipc::CLIENT_TILED),
+          bool(flags & Ipc::CLIENT_URGENT),
+          Ipc::json_string(client.props.instance),
+          Ipc::json_string(client.props.class_name),
+          Ipc::json_string(client.props.title));
+    } else {
+      for (uint32_t value :
+           {client.window, client.workspace, static_cast<uint32_t>(g.x),
+            static_cast<uint32_t>(g.y), static_cast<uint32_t>(g.width),
+            static_cast<uint32_t>(g.height), flags}) {
+        out.u32(value);
+      }
+      out.str(client.props.instance);
+      out.str(client.props.class_name);
+      out.str(client.props.title);
+    }
+  }
+
+  if (json) {
+    reply += ']';
+  } else {
+    reply = std::move(out.data());
+  }
+}
+
+template <class Backend>
+void BasicWindowManager<Backend>::describe_layout(bool json,
+                                                  std::string &reply) {
+  const Workspace &workspace = ws();
+
+  // Tiles in mapping order, with the geometry last sent to the X server.
+  std::vector<const Client *> tiles;
+  for (xcb_window_t window = workspace.windows.head; window != XCB_NONE;) {
+    const Client *client = clients.find(window);
+    if (!client)
+      break;
+    if (workspace.layout.contains(window))
+      tiles.push_back(client);
+    window = client->order.next;
+  }
+
+  if (json) {
+    reply = fmt::format(
+        "{{\"workspace\":{},\"layout\":\"{}\",\"focused\":{},\"tiles\":[",
+        current_workspace, Layout::kind_name(workspace.kind), current_window);
+    for (size_t i = 0; i < tiles.size(); ++i) {
+      const Layout::Rect &g = tiles[i]->geometry;
+      reply += fmt::format(
+          "{}{{\"window\":{},\"x\":{},\"y\":{},\"width\":{},"
+          "\"height\":{}}}",
+          i ? "," : "", tiles[i]->window, g.x, g.y, g.width, g.height);
+    }
+    reply += "]}";
+    return;
+  }
+
+  Ipc::Writer out;
+  out.u32(current_workspace);
+  out.str(Layout::kind_name(workspace.kind));
+  out.u32(current_window);
+  out.u32(static_cast<uint32_t>(tiles.size()));
+  for (const Client *client : tiles) {
+    const Layout::Rect &g = client->geometry;
+    for (uint32_t value :
+         {client->window, static_cast<uint32_t>(g.x),
+          static_cast<uint32_t>(g.y), static_cast<uint32_t>(g.width),
+          static_cast<uint32_t>(g.height)}) {
+      out.u32(value);
+    }
+  }
+  reply = std::move(out.data());
+}
+
+/**
+ * Handles an X error. Requests are sent unchecked, so their errors arrive
+ * here, between the events.
+ *
+ * Errors about windows that went away before a request for them arrived are
+ * expected and only logged at debug level. Failing to select
+ * SubstructureRedirect on the root window means another window manager is
+ * running, which is fatal.
+ *
+ * @param ev The error to handle.
+ */
+template <class Backend>
+void BasicWindowManager<Backend>::handle_error(xcb_generic_event_t *ev) {
+  auto error = (xcb_generic_error_t *)ev;
+
+  if (error->error_code == XCB_ACCESS &&
+      error->major_code == XCB_CHANGE_WINDOW_ATTRIBUTES &&
+      error->resource_id == root) {
+    logger->error("Another window manager is already running");
+    exit(EXIT_FAILURE);
+  }
+
+  if (error->error_code == XCB_WINDOW || error->error_code == XCB_DRAWABLE) {
+    logger->debug("Request {}.{} on gone window {:#x}", error->major_code,
+                  error->minor_code, error->resource_id);
+    return;
+  }
+
+  logger->error("Error in Request {}.{}: Code {}, resource {:#x}",
+                error->major_code, error->minor_code, error->error_code,
+                error->resource_id);
+}
+
+template <class Backend>
+constexpr typename BasicWindowManager<Backend>::DispatchTable
+BasicWindowManager<Backend>::make_dispatch_table() {
+  DispatchTable table = {};
+  table[0] = &BasicWindowManager::handle_error;
+  table[XCB_MAP_REQUEST] = &BasicWindowManager::handle_map_request;
+  table[XCB_UNMAP_NOTIFY] = &BasicWindowManager::handle_unmap_request;
+  table[XCB_DESTROY_NOTIFY] = &BasicWindowManager::handle_destroy_notify;
+  table[XCB_ENTER_NOTIFY] = &BasicWindowManager::handle_enter_notify;
+  table[XCB_KEY_PRESS] = &BasicWindowManager::handle_key_press;
+  table[XCB_PROPERTY_NOTIFY] = &BasicWindowManager::handle_property_notify;
+  table[XCB_MAPPING_NOTIFY] = &BasicWindowManager::handle_mapping_notify;
+  return table;
+}
+
+template <class Backend>
+const typename BasicWindowManager<Backend>::DispatchTable
+    BasicWindowManager<Backend>::dispatch_table = make_dispatch_table();
+
+/**
+ * Routes a single event to the handler registered for its type.
+ *
+ * Core events are looked up directly in dispatch_table. Anything without a
+ * core handler is matched against the event bases of the extensions we
+ * listen to. Events nobody handles are dropped silently.
+ *
+ * @param event The event to dispatch.
+ */
+template <class Backend>
+void BasicWindowManager<Backend>::dispatch(xcb_generic_event_t *event) {
+  if (recorder) {
+    recorder->event(event);
+  }
+
+  uint8_t type = event->response_type & ~0x80;
+  EventHandler handler = dispatch_table[type];
+
+  if (!handler) {
+    for (const auto &ext : extension_handlers) {
+      uint8_t offset = type - ext.first_event;
+      if (ext.first_event && offset < ext.events) {
+        handler = ext.handlers[offset];
+        break;
+      }
+    }
+  }
+
+#ifdef HELIOS_STATS
+  // The clock is only read in sampled batches, see Stats.
+  bool timed = false;
+  Stats::Clock::time_point start;
+  if (metrics.sampling_batch()) {
+    timed = metrics.time_handler();
+    bool input =
+        (type == XCB_KEY_PRESS || type == XCB_ENTER_NOTIFY) && !input_start;
+    bool map = type == XCB_MAP_REQUEST && !map_start;
+    if (timed || input || map) {
+      start = Stats::now();
+      if (input)
+        input_start = start;
+      if (map)
+        map_start = start;
+    }
+  }
+#endif
+
+  if (handler) {
+    (this->*handler)(event);
+  }
+  ++stats.events;
+
+#ifdef HELIOS_STATS
+  if (timed) {
+    metrics.record_event(type, start);
+  }
+#endif
 }
 
 /**
@@ -474,27 +1547,71 @@ WindowManager::~WindowManager() {
  *  5. KeyPress - Switches to the specified workspace when a number key with
  *     the Mod4 modifier is pressed.
  *
- * If the event is not one of the above, the window manager will log an error
- * message and break out of the main loop.
+ * The loop sleeps in epoll on the X connection, the IPC sockets, a timerfd
+ * and a signalfd. After every wakeup, everything queued by xcb is drained
+ * from the backend before the batch is committed, so a burst of
+ * events costs one retile and one flush.
+ *
+ * RandR screen changes and SHAPE notifications are handled as well. Any other
+ * event is ignored.
  *
- * The window manager will also log an error message if the event is invalid.
+ * The loop ends on SIGTERM or SIGINT, or when the connection to the X server
+ * is lost.
  */
-void WindowManager::run() {
-  for (;;) {
-    xcb_generic_event_t *event = xcb_wait_for_event(conn);
+template <class Backend>
+void BasicWindowManager<Backend>::run() {
+  try {
+    loop.run();
+  } catch (const std::exception &e) {
+    logger->error("Event loop failed: {}", e.what());
+  }
+}
 
-    if (!event) {
-      logger->error("Event is invalid");
-      break;
+/**
+ * Starts recording into a trace. The trace starts with what its events refer
+ * to: the root window, the screen size and the event bases of the
+ * extensions.
+ */
+template <class Backend>
+void BasicWindowManager<Backend>::record(const std::string &path) {
+  Trace::Setup setup;
+  setup.root = root;
+  setup.width = static_cast<uint16_t>(screen_area.width);
+  setup.height = static_cast<uint16_t>(screen_area.height);
+  setup.shape_base = extension_handlers[0].first_event;
+  setup.randr_base = extension_handlers[1].first_event;
+  recorder = std::make_unique<Trace::Recorder>(path, setup);
+  logger->info("Recording into {}", path);
+}
+
+/**
+ * Runs before every wait of the event loop: dispatches every X event xcb
+ * has, then commits the batch.
+ */
+template <class Backend>
+void BasicWindowManager<Backend>::process_events() {
+  xcb_generic_event_t *event;
+  for (;;) {
+    while ((event = backend.poll_event())) {
+      dispatch(event);
+      free(event);
     }
 
-    auto ev = event->response_type & ~0x80;
-    auto handler = evH.find(ev);
-    if (handler != evH.end()) {
-      handler->second((xcb_generic_event_t *)event);
-    } else {
-      logger->error("Invalid Event Type!");
+    if (backend.has_error()) {
+      logger->error("Lost the connection to the X server");
+      loop.stop();
+      return;
     }
-    delete event;
+    commit();
+
+    // Replies waited for during the commit may have brought events along,
+    // which epoll cannot see as they are already read from the socket.
+    if (!(event = backend.poll_queued_event()))
+      return;
+    dispatch(event);
+    free(event);
   }
-}
\ No newline at end of file
+}
+
+template class BasicWindowManager<XcbBackend>;
+template class BasicWindowManager<FakeBackend>;
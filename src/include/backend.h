@@ -0,0 +1,249 @@
+#ifndef BACKEND_H
+#define BACKEND_H
+
+#include <cstdint>
+#include <memory>
+#include <spdlog/spdlog.h>
+#include <vector>
+#include <xcb/xcb.h>
+#include <xcb/xcb_cursor.h>
+#include <xcb/xcb_ewmh.h>
+#include <xcb/xproto.h>
+
+#include "client.h"
+#include "key.h"
+#include "layout.h"
+#include "properties.h"
+
+/**
+ * @class XcbBackend
+ *
+ * @brief The X server, as the window manager talks to it.
+ *
+ * @details
+ * Every request the window manager makes goes through one of the methods
+ * below, which is what BasicWindowManager is parameterized on. The backend is
+ * a template parameter rather than an interface, so these calls are resolved
+ * at compile time and inlined in production. FakeBackend implements the same
+ * methods in memory, for benchmarks that need no X server.
+ *
+ * Events keep their XCB layout: they are plain structs, which the fake
+ * backend builds itself.
+ *
+ * Requests are sent unchecked and queued on the connection until flush().
+ */
+class XcbBackend {
+public:
+  using Keyboard = ::Keyboard;
+  using Cookies = Properties::Cookies;
+
+  /**
+   * @brief Whether this is a real display, with signals, startup programs,
+   * a config watcher and an IPC socket around the window manager.
+   */
+  static constexpr bool live = true;
+
+  /**
+   * @brief Connects to the X server and sends every startup request that
+   * does not depend on a reply, without waiting for any.
+   *
+   * @param logger Where failures are logged.
+   * @param root_event_mask The events to select on the root window. Fails
+   * with BadAccess, in the event queue, if another window manager runs.
+   * @throw std::runtime_error if the connection or the screen is missing.
+   */
+  XcbBackend(std::shared_ptr<spdlog::logger> logger, uint32_t root_event_mask);
+
+  /**
+   * @brief Frees the cursor, the check window and the keyboard, resets focus
+   * to PointerRoot and disconnects. Client windows are left mapped.
+   */
+  ~XcbBackend();
+
+  XcbBackend(const XcbBackend &) = delete;
+  XcbBackend &operator=(const XcbBackend &) = delete;
+
+  /**
+   * @brief Collects the replies to the startup requests and publishes the
+   * EWMH properties of the window manager.
+   *
+   * @param desktops The number of workspaces.
+   * @throw std::runtime_error if the EWMH atoms cannot be interned.
+   */
+  void finish_setup(uint32_t desktops);
+
+  /**
+   * @brief Loads the cursor of the root window. Loading takes round trips of
+   * its own inside xcb-cursor, so it comes last.
+   *
+   * @throw std::runtime_error if the cursor cannot be loaded.
+   */
+  void load_cursor();
+
+  /**
+   * @brief The file descriptor of the connection, to wait on.
+   */
+  int fd() const { return xcb_get_file_descriptor(conn); }
+
+  /**
+   * @brief The next event or error, reading the socket if the queue is
+   * empty. nullptr if there is none. The caller frees it.
+   */
+  xcb_generic_event_t *poll_event() { return xcb_poll_for_event(conn); }
+
+  /**
+   * @brief The next event or error already read from the socket, or nullptr.
+   */
+  xcb_generic_event_t *poll_queued_event() {
+    return xcb_poll_for_queued_event(conn);
+  }
+
+  bool has_error() const { return xcb_connection_has_error(conn); }
+  void flush() { xcb_flush(conn); }
+
+  xcb_window_t root() const { return screen->root; }
+
+  /**
+   * @brief The size of the screen when the connection was made.
+   */
+  Layout::Rect screen_area() const {
+    return {0, 0, screen->width_in_pixels, screen->height_in_pixels};
+  }
+
+  /**
+   * @brief The first event code of SHAPE and RandR, 0 if the server lacks
+   * the extension. Valid after finish_setup().
+   */
+  uint8_t shape_event_base() const { return shape_base; }
+  uint8_t randr_event_base() const { return randr_base; }
+
+  Keyboard &keyboard() { return *keys; }
+
+  /**
+   * @brief Sends a ConfigureWindow request.
+   *
+   * @param window The window to configure.
+   * @param mask The XCB_CONFIG_WINDOW_* values that follow.
+   * @param values One value per bit of mask, in bit order.
+   */
+  void configure(xcb_window_t window, uint16_t mask, const uint32_t *values) {
+    xcb_configure_window(conn, window, mask, values);
+  }
+
+  void set_border_color(xcb_window_t window, uint32_t color) {
+    xcb_change_window_attributes(conn, window, XCB_CW_BORDER_PIXEL, &color);
+  }
+
+  void map(xcb_window_t window) { xcb_map_window(conn, window); }
+  void unmap(xcb_window_t window) { xcb_unmap_window(conn, window); }
+
+  /**
+   * @brief Puts a window above its siblings.
+   */
+  void raise(xcb_window_t window) {
+    uint32_t mode = XCB_STACK_MODE_ABOVE;
+    xcb_configure_window(conn, window, XCB_CONFIG_WINDOW_STACK_MODE, &mode);
+  }
+
+  void focus(xcb_window_t window) {
+    xcb_set_input_focus(conn, XCB_INPUT_FOCUS_POINTER_ROOT, window,
+                        XCB_CURRENT_TIME);
+  }
+
+  /**
+   * @brief Selects the events the window manager wants from a client.
+   */
+  void select_client_input(xcb_window_t window);
+
+  /**
+   * @brief Asks a window to close with WM_DELETE_WINDOW if it supports it,
+   * and disconnects its client otherwise.
+   *
+   * @param window The window to close.
+   * @param props Its properties, for WM_PROTOCOLS.
+   */
+  void close(xcb_window_t window, const ClientProperties &props);
+
+  void set_current_desktop(uint32_t desktop) {
+    xcb_ewmh_set_current_desktop(&ewmh, 0, desktop);
+  }
+
+  void set_wm_desktop(xcb_window_t window, uint32_t desktop) {
+    xcb_ewmh_set_wm_desktop(&ewmh, window, desktop);
+  }
+
+  /**
+   * @brief Sends the requests for the properties of a window, without
+   * waiting. See Properties::request().
+   */
+  Cookies request_properties(xcb_window_t window) {
+    return Properties::request(&ewmh, window);
+  }
+
+  /**
+   * @brief Waits for the properties requested by request_properties(). See
+   * Properties::collect().
+   */
+  bool collect_properties(const Cookies &cookies, ClientProperties &props,
+                          bool &override_redirect) {
+    return Properties::collect(&ewmh, cookies, props, override_redirect);
+  }
+
+  /**
+   * @brief Sends the requests for some of the properties of a window,
+   * without waiting. See Properties::request().
+   */
+  Cookies request_fields(xcb_window_t window, uint8_t fields) {
+    return Properties::request(&ewmh, window, fields);
+  }
+
+  /**
+   * @brief Waits for the properties requested by request_fields(). See
+   * Properties::update().
+   */
+  void collect_fields(const Cookies &cookies, ClientProperties &props) {
+    Properties::update(&ewmh, cookies, props);
+  }
+
+  /**
+   * @brief The ClientProperties::Field a property belongs to, 0 if it is
+   * not kept.
+   */
+  uint8_t property_field(xcb_atom_t atom) const {
+    return Properties::field_of(&ewmh, atom);
+  }
+
+  /**
+   * @brief Whether a window of this type is tiled. Docks and desktop
+   * windows are only mapped.
+   */
+  bool wants_tile(const ClientProperties &props) const {
+    return props.window_type != ewmh._NET_WM_WINDOW_TYPE_DOCK &&
+           props.window_type != ewmh._NET_WM_WINDOW_TYPE_DESKTOP;
+  }
+
+private:
+  std::shared_ptr<spdlog::logger> logger;
+
+  xcb_connection_t *conn = nullptr;
+  xcb_screen_t *screen = nullptr;
+  xcb_ewmh_connection_t ewmh;
+
+  xcb_intern_atom_cookie_t *ewmh_cookie = nullptr;
+  xcb_intern_atom_cookie_t delete_cookie;
+  xcb_atom_t wm_delete_window = XCB_NONE;
+
+  /**
+   * @brief The _NET_SUPPORTING_WM_CHECK window.
+   */
+  xcb_window_t check_window = XCB_NONE;
+
+  std::unique_ptr<Keyboard> keys;
+  uint8_t shape_base = 0;
+  uint8_t randr_base = 0;
+
+  xcb_cursor_context_t *cursor_context = nullptr;
+  xcb_cursor_t cursor = XCB_CURSOR_NONE;
+};
+
+#endif
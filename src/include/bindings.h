@@ -0,0 +1,142 @@
+#ifndef BINDINGS_H
+#define BINDINGS_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <xcb/xproto.h>
+
+#include "config.h"
+#include "key.h"
+
+/**
+ * @brief A key binding action, parsed once when the bindings are compiled so
+ * that running it needs no string parsing or allocation.
+ */
+struct BoundAction {
+  /**
+   * @brief What a focus action moves the focus to.
+   */
+  enum FocusTarget : uint32_t { FOCUS_NEXT, FOCUS_PREV, FOCUS_CLASS };
+
+  WMConfig::ActionType type = WMConfig::ActionType::run;
+
+  std::vector<std::string> args; // run: the tokenized command line.
+  std::vector<char *> argv;      // run: args as a NULL-terminated argv.
+
+  uint32_t index = 0; // ch: the workspace; focus: a FocusTarget.
+  std::string target; // focus, toggle: the WM_CLASS to look for.
+
+  /**
+   * @brief Points argv at args. Must be called again whenever the action
+   * moves, as moving a short string moves its characters.
+   */
+  void link_argv() {
+    argv.clear();
+    for (auto &arg : args) {
+      argv.push_back(arg.data());
+    }
+    argv.push_back(nullptr);
+  }
+};
+
+/**
+ * @class Bindings
+ *
+ * @brief The key bindings, compiled into a hash table keyed by the modifier
+ * mask and the keycode of a key press.
+ *
+ * @details
+ * The bindings of the config are given as keysyms, so the table has to be
+ * compiled again whenever the keyboard mapping changes. Looking a key press
+ * up is a single hash lookup on an integer.
+ */
+class Bindings {
+public:
+  Bindings() = default;
+  Bindings(Bindings &&) = default;
+  Bindings &operator=(Bindings &&) = default;
+  Bindings(const Bindings &) = delete;
+  Bindings &operator=(const Bindings &) = delete;
+
+  /**
+   * @brief Compiles key bindings, replacing the current table.
+   *
+   * @param binds The bindings to compile.
+   * @param keyboard The keyboard used to turn keysyms into keycodes, a
+   * Keyboard or the FakeKeyboard of the fake backend.
+   * @return The indices, in binds, of the bindings whose action could not be
+   * parsed. Those bindings are left out.
+   */
+  template <class Keymap>
+  std::vector<size_t> compile(const std::vector<WMConfig::Keybind> &binds,
+                              const Keymap &keyboard);
+
+  /**
+   * @brief Finds the action bound to a key press.
+   *
+   * @param mods The modifier mask, already cleaned of Lock and Num Lock.
+   * @param keycode The keycode that was pressed.
+   * @return The action, or nullptr if the key is not bound.
+   */
+  const BoundAction *find(uint16_t mods, xcb_keycode_t keycode) const {
+    auto it = table.find(key(mods, keycode));
+    return it == table.end() ? nullptr : &actions[it->second];
+  }
+
+  /**
+   * @brief Parses the action of a binding.
+   *
+   * @param action The action, as read from the config file.
+   * @param out Where to store the parsed action.
+   * @return false if the action type or its target is invalid.
+   */
+  static bool parse(const WMConfig::Action &action, BoundAction &out);
+
+private:
+  static uint32_t key(uint16_t mods, xcb_keycode_t keycode) {
+    return uint32_t(mods) << 8 | keycode;
+  }
+
+  std::vector<BoundAction> actions;
+  std::unordered_map<uint32_t, uint32_t> table; // key() -> index in actions.
+};
+
+template <class Keymap>
+std::vector<size_t>
+Bindings::compile(const std::vector<WMConfig::Keybind> &binds,
+                  const Keymap &keyboard) {
+  std::vector<size_t> rejected;
+  std::vector<BoundAction> compiled;
+  std::unordered_map<uint32_t, uint32_t> compiled_table;
+
+  for (size_t i = 0; i < binds.size(); ++i) {
+    BoundAction action;
+    if (!parse(binds[i].action, action)) {
+      rejected.push_back(i);
+      continue;
+    }
+
+    auto index = static_cast<uint32_t>(compiled.size());
+    compiled.push_back(std::move(action));
+
+    uint16_t mods = modifier_mask(binds[i].mod);
+    for (auto code : keyboard.keycodes(binds[i].keysym)) {
+      compiled_table[key(mods, code)] = index;
+    }
+  }
+
+  // The argv pointers are only taken once the actions stopped moving.
+  for (auto &action : compiled) {
+    if (action.type == WMConfig::ActionType::run) {
+      action.link_argv();
+    }
+  }
+
+  actions = std::move(compiled);
+  table = std::move(compiled_table);
+  return rejected;
+}
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef CLIENT_H
+#define CLIENT_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <xcb/xproto.h>
+
+#include "layout.h"
+
+/**
+ * @brief The ICCCM and EWMH properties of a client that the window manager
+ * cares about, read when the client was adopted and kept up to date from
+ * PropertyNotify.
+ */
+struct ClientProperties {
+  /**
+   * @brief The groups of properties that are read again together when one
+   * of their properties changes.
+   */
+  enum Field : uint8_t {
+    FIELD_TITLE = 1 << 0,        // _NET_WM_NAME, or WM_NAME without it.
+    FIELD_CLASS = 1 << 1,        // WM_CLASS.
+    FIELD_TYPE = 1 << 2,         // _NET_WM_WINDOW_TYPE.
+    FIELD_STATE = 1 << 3,        // _NET_WM_STATE.
+    FIELD_HINTS = 1 << 4,        // WM_HINTS.
+    FIELD_NORMAL_HINTS = 1 << 5, // WM_NORMAL_HINTS.
+    FIELD_PROTOCOLS = 1 << 6,    // WM_PROTOCOLS.
+    FIELD_ALL = (1 << 7) - 1,
+  };
+
+  std::string title;      // _NET_WM_NAME, or WM_NAME without it.
+  std::string instance;   // The first string of WM_CLASS.
+  std::string class_name; // The second string of WM_CLASS.
+
+  xcb_atom_t window_type = XCB_NONE; // The preferred _NET_WM_WINDOW_TYPE.
+  std::vector<xcb_atom_t> state;     // The atoms in _NET_WM_STATE.
+  std::vector<xcb_atom_t> protocols; // The atoms in WM_PROTOCOLS.
+
+  bool input = true;   // WM_HINTS: whether the client wants input focus.
+  bool urgent = false; // WM_HINTS: whether the urgency hint is set.
+
+  int min_width = 0, min_height = 0; // WM_NORMAL_HINTS minimum, 0 if unset.
+  int max_width = 0, max_height = 0; // WM_NORMAL_HINTS maximum, 0 if unset.
+};
+
+/**
+ * @brief A window managed by the window manager.
+ *
+ * @details
+ * Besides the window ID, a client keeps a shadow of the attributes the window
+ * manager last sent to the X server. Clients are redirected, so nobody else
+ * changes these behind our back, and a request that would set an attribute to
+ * the value it already has can be skipped.
+ */
+struct Client {
+  /**
+   * @brief The neighbours of a client in one of the lists of its workspace.
+   * Neighbours are named by window ID, which unlike slots never move.
+   */
+  struct Link {
+    xcb_window_t prev = XCB_NONE;
+    xcb_window_t next = XCB_NONE;
+  };
+
+  /**
+   * @brief Which of the shadowed attributes hold a value the server has.
+   */
+  enum Known : uint8_t {
+    KNOWN_GEOMETRY = 1 << 0,
+    KNOWN_BORDER_WIDTH = 1 << 1,
+    KNOWN_BORDER_PIXEL = 1 << 2,
+  };
+
+  xcb_window_t window = XCB_NONE;
+
+  uint8_t known = 0;                    // A combination of Known flags.
+  Layout::Rect geometry = {0, 0, 0, 0}; // Last X/Y/W/H sent.
+  uint32_t border_width = 0;            // Last border width sent.
+  uint32_t border_pixel = 0;            // Last border color sent.
+
+  bool shaped = false; // Has a bounding shape, so it is drawn borderless.
+
+  uint32_t workspace = 0;     // The workspace the client lives on.
+  uint32_t ignore_unmaps = 0; // UnmapNotify events we caused ourselves.
+
+  Link order;   // Neighbours in the mapping order of the workspace.
+  Link history; // Neighbours in the focus history, most recent first.
+
+  ClientProperties props; // Read when the client was adopted.
+  uint8_t stale = 0;       // The ClientProperties::Field of props to reread.
+};
+
+/**
+ * @brief The two ends of a list of clients linked through one of their
+ * Client::Link members.
+ */
+struct ClientList {
+  xcb_window_t head = XCB_NONE;
+  xcb_window_t tail = XCB_NONE;
+};
+
+#endif
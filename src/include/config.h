@@ -24,20 +24,25 @@ typedef struct Border {
 
 /**
  * This struct represents the window settings. It contains the gap
- * between windows, in pixels.
+ * between windows, in pixels, and the layout of each workspace.
  */
 typedef struct Window {
   int gap; // The gap between windows, in pixels.
+  std::vector<std::string>
+      layouts; // The layout of each workspace, by number: "dwindle",
+               // "master-stack", "monocle" or "grid". Workspaces past the
+               // end of the list use "dwindle".
 } Window;
 /**
  * @breif This enum represents the type of action that can be performed when a
  * key is pressed. It can be one of the following:
  *   - run: Run a command.
- *   - ch: Change the currently focused window to the window with the specified
- *   target.
- *   - focus: Focus the window with the specified target.
+ *   - ch: Change to the workspace whose number is the target.
+ *   - focus: Focus the next ("next") or previous ("prev") window, or the
+ *   window whose class or instance name is the target.
  *   - close: Close the currently focused window.
- *   - toggle: Toggle the visibility of the window with the specified target.
+ *   - toggle: Toggle the visibility of the window whose class or instance
+ *   name is the target.
  */
 typedef enum class ActionType { run, ch, focus, close, toggle } ActionType;
 /**
@@ -86,6 +91,30 @@ typedef struct General {
       bindings; // The keybindings, as a vector of Keybind structs.
 } General;
 
+/**
+ * @brief This enum represents the parts of the config that differ between two
+ * versions of it, as a bitfield. Each part is applied on its own when the
+ * config file is reloaded.
+ */
+enum Changes : uint32_t {
+  CHANGED_NONE = 0,
+  CHANGED_STARTUP = 1 << 0,       // Only read at startup, never applied.
+  CHANGED_BORDER_WIDTH = 1 << 1,  // Every client needs a new border width.
+  CHANGED_BORDER_COLORS = 1 << 2, // Every border needs repainting.
+  CHANGED_GAP = 1 << 3,           // The layout needs retiling.
+  CHANGED_BINDINGS = 1 << 4,      // Some keys need regrabbing.
+  CHANGED_LAYOUTS = 1 << 5,       // Some workspaces need a new layout.
+};
+
+/**
+ * @brief Function for comparing two configs
+ *
+ * @param old the config in use
+ * @param next the config that replaces it
+ * @return uint32_t The Changes between the two, or'ed together
+ */
+uint32_t diff(const General &old, const General &next);
+
 /**
  * @brief Function for showing the config
  * 
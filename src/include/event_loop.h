@@ -0,0 +1,171 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <sys/epoll.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * @class EventLoop
+ *
+ * @brief An epoll loop over file descriptors, timers and signals.
+ *
+ * @details
+ * Everything the window manager waits for is a file descriptor in one epoll
+ * set: the X connection, the IPC sockets, a timerfd armed for the earliest
+ * timer, and a signalfd for the signals handled with on_signal(). Callbacks
+ * run on the thread that calls run(), one after the other, so they never
+ * need locks. The only thread-safe entry point is the function returned by
+ * add_wakeup().
+ *
+ * Before each wait the prepare callback runs. The window manager uses it to
+ * drain the X events that XCB already read and to commit the batch, since
+ * epoll cannot see events sitting in the XCB queue.
+ */
+class EventLoop {
+public:
+  using Clock = std::chrono::steady_clock;
+  using Callback = std::function<void()>;
+  using IoCallback = std::function<void(uint32_t events)>;
+  using TimerId = uint64_t;
+
+  /**
+   * @brief Creates the epoll set, the timerfd and the signalfd.
+   *
+   * @throw std::runtime_error if any of them cannot be created.
+   */
+  EventLoop();
+
+  /**
+   * @brief Closes the loop's own descriptors. Registered ones are left to
+   * their owners.
+   */
+  ~EventLoop();
+
+  EventLoop(const EventLoop &) = delete;
+  EventLoop &operator=(const EventLoop &) = delete;
+
+  /**
+   * @brief Watches a file descriptor.
+   *
+   * @param fd The descriptor, which the caller keeps owning.
+   * @param events The epoll events to wait for, EPOLLIN and/or EPOLLOUT.
+   * @param callback Called with the ready events.
+   * @throw std::runtime_error if epoll refuses the descriptor.
+   */
+  void add(int fd, uint32_t events, IoCallback callback);
+
+  /**
+   * @brief Changes the events a watched descriptor waits for.
+   */
+  void modify(int fd, uint32_t events);
+
+  /**
+   * @brief Stops watching a descriptor. Safe to call from its own callback.
+   */
+  void remove(int fd);
+
+  /**
+   * @brief Handles a signal on the loop instead of asynchronously.
+   *
+   * The signal is blocked in the calling thread, so this must be called
+   * before any other thread is started for them to inherit the mask.
+   *
+   * @param signal The signal number.
+   * @param callback Called once per batch of queued signals of this number.
+   */
+  void on_signal(int signal, Callback callback);
+
+  /**
+   * @brief Runs a callback once, at or soon after a deadline.
+   *
+   * @return An ID for cancel().
+   */
+  TimerId schedule(Clock::time_point deadline, Callback callback);
+
+  /**
+   * @brief Runs a callback once, after a delay.
+   *
+   * @return An ID for cancel().
+   */
+  TimerId schedule(Clock::duration delay, Callback callback) {
+    return schedule(Clock::now() + delay, std::move(callback));
+  }
+
+  /**
+   * @brief Cancels a timer that has not fired yet. Unknown IDs are ignored.
+   */
+  void cancel(TimerId id);
+
+  /**
+   * @brief Registers a callback that other threads can ask the loop to run.
+   *
+   * @param callback Run on the loop after one or more wakeups.
+   * @return A function that any thread may call to wake the loop.
+   * @throw std::runtime_error if the eventfd cannot be created.
+   */
+  std::function<void()> add_wakeup(Callback callback);
+
+  /**
+   * @brief Sets the callback that runs before every wait.
+   */
+  void set_prepare(Callback callback) { prepare = std::move(callback); }
+
+  /**
+   * @brief Dispatches callbacks until stop() is called.
+   *
+   * @throw std::runtime_error if waiting fails.
+   */
+  void run();
+
+  /**
+   * @brief Makes run() return once the current callbacks are done.
+   */
+  void stop() { running = false; }
+
+private:
+  /**
+   * @brief A watched descriptor. Watches live on the heap so that epoll can
+   * point at them, and a watch removed while its batch is dispatched stays
+   * alive, flagged, until the batch is over.
+   */
+  struct Watch {
+    int fd;
+    IoCallback callback;
+    bool removed = false;
+  };
+
+  void arm_timer();
+  void run_timers();
+  void read_signals();
+
+  int epoll_fd = -1;
+  int timer_fd = -1;
+  int signal_fd = -1;
+
+  std::unordered_map<int, std::unique_ptr<Watch>> watches;
+  std::vector<std::unique_ptr<Watch>> removed; // Freed after each batch.
+  bool dispatching = false;
+
+  // Timers by deadline, with the ID breaking ties in scheduling order.
+  std::map<std::pair<Clock::time_point, TimerId>, Callback> timers;
+  std::unordered_map<TimerId, Clock::time_point> deadlines;
+  TimerId next_timer = 1;
+
+  sigset_t signals;
+  std::unordered_map<int, Callback> signal_handlers;
+
+  std::vector<int> wakeup_fds; // eventfds owned by the loop.
+
+  Callback prepare;
+  bool running = false;
+};
+
+#endif
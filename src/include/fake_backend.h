@@ -0,0 +1,363 @@
+#ifndef FAKE_BACKEND_H
+#define FAKE_BACKEND_H
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <spdlog/spdlog.h>
+#include <unordered_map>
+#include <vector>
+#include <xcb/xcb.h>
+#include <xcb/xproto.h>
+
+#include "client.h"
+#include "layout.h"
+
+/**
+ * @class FakeKeyboard
+ *
+ * @brief A keyboard where every keysym is produced by exactly one keycode,
+ * known without asking anyone.
+ */
+class FakeKeyboard {
+public:
+  bool grab(uint16_t, xcb_keysym_t) { return true; }
+  void ungrab(uint16_t, xcb_keysym_t) {}
+  void ungrab_all() {}
+  bool refresh(xcb_mapping_notify_event_t *) { return false; }
+
+  /**
+   * @brief Strips Lock and the mouse buttons from a modifier state. There is
+   * no Num Lock.
+   */
+  uint16_t clean_mask(uint16_t state) const {
+    return state & ~XCB_MOD_MASK_LOCK &
+           (XCB_MOD_MASK_SHIFT | XCB_MOD_MASK_CONTROL | XCB_MOD_MASK_1 |
+            XCB_MOD_MASK_2 | XCB_MOD_MASK_3 | XCB_MOD_MASK_4 | XCB_MOD_MASK_5);
+  }
+
+  std::vector<xcb_keycode_t> keycodes(xcb_keysym_t keysym) const {
+    return {keycode(keysym)};
+  }
+
+  /**
+   * @brief The keycode of a keysym, in the 8-255 range X allows.
+   */
+  static xcb_keycode_t keycode(xcb_keysym_t keysym) {
+    return static_cast<xcb_keycode_t>(8 + keysym % 248);
+  }
+};
+
+/**
+ * @class FakeBackend
+ *
+ * @brief An X server in memory, for benchmarks and tests of the window
+ * manager logic.
+ *
+ * @details
+ * Implements the methods of XcbBackend without a connection. Requests are
+ * counted by type instead of being sent, and can also be kept in a log.
+ * Windows are created with create_window(), and the events a client or the
+ * user would cause are queued with the inject_* methods, to be taken by
+ * BasicWindowManager::process_events() like events read from a socket.
+ *
+ * Requests have the effects the window manager relies on: unmapping a mapped
+ * window queues an UnmapNotify, and destroying or closing a window queues the
+ * UnmapNotify and DestroyNotify a real server would send. Nothing else
+ * happens, so a run is deterministic. When a recorded trace is replayed, the
+ * trace already holds those events, and synthesize(false) stops queueing
+ * them.
+ */
+class FakeBackend {
+public:
+  using Keyboard = FakeKeyboard;
+  using Cookies = xcb_window_t; // Properties are looked up when collected.
+
+  static constexpr bool live = false;
+
+  /**
+   * @brief The atoms create_window() takes as window types of docks and
+   * desktop windows.
+   */
+  static constexpr xcb_atom_t TYPE_DOCK = 1;
+  static constexpr xcb_atom_t TYPE_DESKTOP = 2;
+
+  /**
+   * @brief The atoms of the EWMH properties kept in ClientProperties, which
+   * a real server interns. The ICCCM ones are predefined, so they are those
+   * of every server.
+   */
+  static constexpr xcb_atom_t NET_WM_NAME = 0x100;
+  static constexpr xcb_atom_t NET_WM_WINDOW_TYPE = 0x101;
+  static constexpr xcb_atom_t NET_WM_STATE = 0x102;
+  static constexpr xcb_atom_t WM_PROTOCOLS = 0x103;
+
+  /**
+   * @brief The first event codes of SHAPE and RandR, those of Xorg.
+   */
+  static constexpr uint8_t SHAPE_BASE = 64;
+  static constexpr uint8_t RANDR_BASE = 89;
+
+  /**
+   * @brief The requests the window manager can make.
+   */
+  enum RequestType : uint8_t {
+    CONFIGURE,
+    BORDER_COLOR,
+    MAP,
+    UNMAP,
+    FOCUS,
+    SELECT_INPUT,
+    CLOSE,
+    CURRENT_DESKTOP,
+    WM_DESKTOP,
+    GET_PROPERTIES,
+    RAISE,
+    FLUSH,
+    REQUEST_TYPES,
+  };
+
+  /**
+   * @brief One request, as kept in the log.
+   */
+  struct Request {
+    RequestType type;
+    xcb_window_t window;
+    uint32_t value; // CONFIGURE: the mask; BORDER_COLOR: the color;
+                    // the desktops: the desktop.
+  };
+
+  /**
+   * @param logger Unused, for the signature of XcbBackend.
+   * @param root_event_mask Unused, for the signature of XcbBackend.
+   */
+  FakeBackend(std::shared_ptr<spdlog::logger> logger,
+              uint32_t root_event_mask);
+
+  /**
+   * @brief Frees the events nobody took.
+   */
+  ~FakeBackend();
+
+  FakeBackend(const FakeBackend &) = delete;
+  FakeBackend &operator=(const FakeBackend &) = delete;
+
+  void finish_setup(uint32_t) {}
+  void load_cursor() {}
+
+  xcb_generic_event_t *poll_event() { return next_event(); }
+  xcb_generic_event_t *poll_queued_event() { return next_event(); }
+  bool has_error() const { return false; }
+  void flush() { record(FLUSH, XCB_NONE); }
+
+  xcb_window_t root() const { return ROOT; }
+  Layout::Rect screen_area() const { return area; }
+  uint8_t shape_event_base() const { return SHAPE_BASE; }
+  uint8_t randr_event_base() const { return RANDR_BASE; }
+  Keyboard &keyboard() { return keys; }
+
+  void configure(xcb_window_t window, uint16_t mask, const uint32_t *) {
+    record(CONFIGURE, window, mask);
+  }
+  void set_border_color(xcb_window_t window, uint32_t color) {
+    record(BORDER_COLOR, window, color);
+  }
+  void map(xcb_window_t window);
+  void unmap(xcb_window_t window);
+  void raise(xcb_window_t window) { record(RAISE, window); }
+  void focus(xcb_window_t window) { record(FOCUS, window); }
+  void select_client_input(xcb_window_t window) {
+    record(SELECT_INPUT, window);
+  }
+
+  /**
+   * @brief Closes a window. Fake clients obey at once.
+   */
+  void close(xcb_window_t window, const ClientProperties &) {
+    record(CLOSE, window);
+    destroy_window(window);
+  }
+
+  void set_current_desktop(uint32_t desktop) {
+    record(CURRENT_DESKTOP, ROOT, desktop);
+  }
+  void set_wm_desktop(xcb_window_t window, uint32_t desktop) {
+    record(WM_DESKTOP, window, desktop);
+  }
+
+  Cookies request_properties(xcb_window_t window) {
+    record(GET_PROPERTIES, window);
+    return window;
+  }
+
+  /**
+   * @brief Copies the properties given to create_window().
+   *
+   * @return false if the window does not exist.
+   */
+  bool collect_properties(const Cookies &window, ClientProperties &props,
+                          bool &override_redirect);
+
+  Cookies request_fields(xcb_window_t window, uint8_t) {
+    record(GET_PROPERTIES, window);
+    return window;
+  }
+
+  /**
+   * @brief Copies the properties of a window, all of them since they are
+   * the same in the fields that were not asked for.
+   */
+  void collect_fields(const Cookies &window, ClientProperties &props);
+
+  uint8_t property_field(xcb_atom_t atom) const;
+
+  bool wants_tile(const ClientProperties &props) const {
+    return props.window_type != TYPE_DOCK && props.window_type != TYPE_DESKTOP;
+  }
+
+  /**
+   * @brief Creates an unmapped window, as a client would.
+   *
+   * @param props What collect_properties() answers for it.
+   * @param override_redirect Whether the window manager should ignore it.
+   * @return The window ID.
+   */
+  xcb_window_t create_window(ClientProperties props = {},
+                             bool override_redirect = false);
+
+  /**
+   * @brief Creates an unmapped window with a given ID, as recorded in a
+   * trace. An existing window of that ID is replaced.
+   */
+  void add_window(xcb_window_t window, ClientProperties props,
+                  bool override_redirect);
+
+  /**
+   * @brief Destroys a window as its client would, queueing an UnmapNotify
+   * if it was mapped, then a DestroyNotify. Unknown windows are ignored.
+   */
+  void destroy_window(xcb_window_t window);
+
+  /**
+   * @brief Queues the MapRequest of a client mapping a window.
+   */
+  void inject_map_request(xcb_window_t window);
+
+  /**
+   * @brief Queues the EnterNotify of the pointer entering a window.
+   */
+  void inject_enter_notify(xcb_window_t window);
+
+  /**
+   * @brief Changes what collect_properties() and collect_fields() answer
+   * for a window, as its client would, without queueing anything.
+   *
+   * @return The properties, or nullptr if the window does not exist.
+   */
+  ClientProperties *properties(xcb_window_t window) {
+    auto it = windows.find(window);
+    return it == windows.end() ? nullptr : &it->second.props;
+  }
+
+  /**
+   * @brief Queues the PropertyNotify of a client changing a property.
+   */
+  void inject_property_notify(xcb_window_t window, xcb_atom_t atom);
+
+  /**
+   * @brief Queues the RandR ScreenChangeNotify of a new screen size.
+   */
+  void inject_screen_change(uint16_t width, uint16_t height);
+
+  /**
+   * @brief Queues a copy of any event.
+   */
+  void inject_event(const xcb_generic_event_t &event);
+
+  /**
+   * @brief Whether requests queue the events they would cause on a real
+   * server. On by default.
+   */
+  void synthesize(bool enable) { synthesizing = enable; }
+
+  /**
+   * @brief Queues the KeyPress of a key combination.
+   *
+   * @param state The modifier mask.
+   * @param keysym The keysym, turned into a keycode by FakeKeyboard.
+   */
+  void inject_key_press(uint16_t state, xcb_keysym_t keysym);
+
+  /**
+   * @brief Whether a window exists and is mapped.
+   */
+  bool is_mapped(xcb_window_t window) const {
+    auto it = windows.find(window);
+    return it != windows.end() && it->second.mapped;
+  }
+
+  /**
+   * @brief The events waiting to be taken.
+   */
+  size_t pending() const { return events.size(); }
+
+  /**
+   * @brief The number of requests of one type since the last
+   * reset_counts().
+   */
+  uint64_t count(RequestType type) const { return counts[type]; }
+
+  /**
+   * @brief The number of requests of all types, flushes excluded.
+   */
+  uint64_t requests() const;
+
+  void reset_counts() { counts = {}; }
+
+  /**
+   * @brief Starts or stops keeping every request in log().
+   */
+  void keep_log(bool keep) { logging = keep; }
+  std::vector<Request> &log() { return request_log; }
+
+private:
+  static constexpr xcb_window_t ROOT = 1;
+
+  struct Window {
+    ClientProperties props;
+    bool override_redirect = false;
+    bool mapped = false;
+  };
+
+  void record(RequestType type, xcb_window_t window, uint32_t value = 0) {
+    ++counts[type];
+    if (logging) {
+      request_log.push_back({type, window, value});
+    }
+  }
+
+  /**
+   * @brief Queues a zeroed event of a given type, allocated with malloc()
+   * like the events of xcb, since the caller frees it.
+   */
+  template <class Event> Event *push_event(uint8_t type);
+
+  void push_unmap_notify(xcb_window_t window);
+  xcb_generic_event_t *next_event();
+
+  Layout::Rect area = {0, 0, 1920, 1080};
+  FakeKeyboard keys;
+
+  std::unordered_map<xcb_window_t, Window> windows;
+  xcb_window_t next_window = 0x200000;
+
+  std::deque<xcb_generic_event_t *> events;
+  bool synthesizing = true;
+
+  std::array<uint64_t, REQUEST_TYPES> counts = {};
+  std::vector<Request> request_log;
+  bool logging = false;
+};
+
+#endif
@@ -1,14 +1,16 @@
 #ifndef HELIOS_H
 #define HELIOS_H
 
+#include <array>
 #include <cerrno>
+#include <chrono>
 #include <cstdint>
-#include <functional>
 #include <memory>
-#include <spdlog/sinks/basic_file_sink.h>
+#include <optional>
 #include <spdlog/spdlog.h>
 #include <unordered_map>
 #include <vector>
+#include <xcb/randr.h>
 #include <xcb/shape.h>
 #include <xcb/xcb.h>
 #include <xcb/xcb_cursor.h>
@@ -19,53 +21,119 @@
 #include <X11/keysym.h>
 
 #include "../wm.def.h"
+#include "backend.h"
+#include "bindings.h"
+#include "client.h"
 #include "config.h"
+#include "event_loop.h"
+#include "fake_backend.h"
+#include "ipc.h"
 #include "key.h"
-#include "spawn.h"
-
-using EventHandler = std::function<void(xcb_generic_event_t *)>;
+#include "layout.h"
+#include "properties.h"
+#include "registry.h"
+#include "stats.h"
+#include "trace.h"
+#include "launcher.h"
+#include "log.h"
+#include "watcher.h"
+#include "workspace.h"
 
 /**
- * @class WindowManager
+ * @class BasicWindowManager
  *
  * This class implements a window manager. It is responsible for managing the
  * windows on the screen and handling events such as key presses.
+ *
+ * @details
+ * Every request to the X server goes through the Backend: XcbBackend in
+ * production, FakeBackend to run the window manager logic in memory. Both
+ * instantiations are compiled in helios.cpp.
+ *
+ * @tparam Backend XcbBackend or FakeBackend.
  */
-class WindowManager {
+template <class Backend> class BasicWindowManager {
 private:
   /**
-   * @brief The XCB connection to the X server.
+   * @brief The root window of the X server.
    *
-   * This is the connection that the window manager uses to communicate with
-   * the X server.
+   * The root window is the parent window of all other windows on the X server.
    */
-  xcb_connection_t *conn;
+  xcb_window_t root;
 
   /**
-   * @brief The screen structure for the screen that the window manager is
-   *        managing.
-   *
-   * This structure contains information about the screen such as its width and
-   * height.
+   * @brief The size of the screen, which the layouts fill.
    */
-  xcb_screen_t *screen;
+  Layout::Rect screen_area;
 
   /**
-   * @brief The root window of the X server.
+   * @brief The number of workspaces.
+   */
+  static constexpr uint32_t NUM_WORKSPACES = 10;
+
+  /**
+   * @brief The workspaces, each with its own clients and layout.
+   */
+  std::array<Workspace, NUM_WORKSPACES> workspaces;
+
+  /**
+   * @brief The index of the workspace on screen.
+   */
+  uint32_t current_workspace = 0;
+
+  /**
+   * @brief The workspace on screen.
+   */
+  Workspace &ws() { return workspaces[current_workspace]; }
+
+  /**
+   * @brief The clients managed by the window manager, by window ID.
    *
-   * The root window is the parent window of all other windows on the X server.
+   * Each client remembers the geometry, border width and border color last
+   * sent to the X server, so unchanged values are not sent again.
    */
-  xcb_window_t root;
+  ClientRegistry clients;
 
   /**
-   * @brief A vector of window IDs that the window manager is currently
-   *        managing.
+   * @brief Windows that asked to be mapped during the current batch.
    *
-   * This vector contains the IDs of all windows that the window manager has
-   * been asked to manage. The window manager will receive events for these
-   * windows and will be able to control them.
+   * They are adopted together when the batch is committed, so that their
+   * property requests share one round trip.
+   */
+  std::vector<xcb_window_t> pending_adoptions;
+
+  /**
+   * @brief The property cookies of pending_adoptions, kept between batches
+   * so that adopting does not allocate once a batch as large was seen.
+   */
+  std::vector<typename Backend::Cookies> adoption_cookies;
+
+  /**
+   * @brief Clients with a property that changed since it was read, in the
+   * order of their first change, and the cookies of the requests reading
+   * them again. A window can appear more than once, only the first is read.
+   */
+  std::vector<xcb_window_t> stale_clients;
+  std::vector<typename Backend::Cookies> refresh_cookies;
+  std::vector<uint8_t> refresh_fields; // What each cookie asked for.
+
+  /**
+   * @brief How long a title that changed waits before it is read again, so
+   * that a client retitling itself many times a second costs one read.
    */
-  std::vector<xcb_window_t> windows;
+  static constexpr std::chrono::milliseconds TITLE_DELAY{100};
+
+  /**
+   * @brief Whether a timer will read the titles that changed.
+   */
+  bool title_refresh_scheduled = false;
+
+  /**
+   * @brief The clients and rectangles of a retile by a Layout::Engine,
+   * kept between retiles so that they are only allocated when they grow.
+   */
+  std::vector<Client *> tile_order;
+  std::vector<Layout::Rect> tile_rects;
 
   /**
    * @brief The configuration for the window manager.
@@ -82,7 +150,13 @@ private:
    * the logger to log messages about what it is doing.
    */
   std::shared_ptr<spdlog::logger> logger =
-      spdlog::basic_logger_mt("Helios", "logs.txt");
+      make_async_logger("Helios", "logs.txt");
+
+  /**
+   * @brief The event loop, which waits on the X connection, the IPC sockets,
+   * timers and signals.
+   */
+  EventLoop loop;
 
   /**
    * @brief The window that currently has focus.
@@ -93,20 +167,54 @@ private:
   xcb_window_t current_window = XCB_NONE;
 
   /**
-   * @brief The cursor ID for the window manager's cursor.
+   * @brief The window that was last given input focus and the active border.
    *
-   * The cursor ID is an ID that is used to identify the window manager's
-   * cursor.
+   * This is what the X server currently believes, as opposed to
+   * current_window which is what the window manager wants. The two are
+   * reconciled once per event batch by commit_focus().
    */
-  xcb_cursor_t cursor;
+  xcb_window_t committed_focus = XCB_NONE;
 
   /**
-   * @brief The context for the window manager's cursor.
-   *
-   * The context is a structure that contains information about the cursor such
-   * as its shape and its color.
+   * @brief Bits of window manager state that need to be pushed to the X
+   *        server at the end of the current event batch.
+   */
+  enum DirtyFlags : uint8_t {
+    DIRTY_NONE = 0,
+    DIRTY_LAYOUT = 1 << 0,  // The windows need to be re-tiled.
+    DIRTY_FOCUS = 1 << 1,   // The input focus needs to be moved.
+    DIRTY_BORDERS = 1 << 2, // The active/inactive borders need repainting.
+    DIRTY_PROPERTIES = 1 << 3, // Client properties need to be read again.
+  };
+
+  /**
+   * @brief The state that has been marked dirty during the current batch.
+   */
+  uint8_t dirty = DIRTY_NONE;
+
+  /**
+   * @brief Counters describing the work done by the event loop.
+   */
+  struct LoopStats {
+    uint64_t batches = 0; // Event batches committed.
+    uint64_t events = 0;  // Events dispatched.
+    uint64_t retiles = 0; // Retiles actually performed.
+    uint64_t retiles_coalesced = 0; // Retiles folded into an earlier one.
+    uint64_t requests_saved = 0; // Requests skipped as already up to date.
+  } stats;
+
+#ifdef HELIOS_STATS
+  /**
+   * @brief Latency histograms and counters, in builds with statistics.
    */
-  xcb_cursor_context_t *cursor_context;
+  Stats metrics;
+
+  /**
+   * @brief When the first event of a sampled batch that may move the focus,
+   * or map a window, was taken off the queue. Reset on every commit.
+   */
+  std::optional<Stats::Clock::time_point> input_start, map_start;
+#endif
 
   /**
    * @brief The event mask for the window manager.
@@ -124,54 +232,73 @@ private:
       XCB_EVENT_MASK_KEY_PRESS;
 
   /**
-   * @brief A unique pointer to an array of uint32_t values.
+   * @brief The X server, or the fake one.
    *
-   * This array is used to store values that are used by the window manager.
+   * Its keyboard holds the keysym table and the key grabs, kept up to date
+   * by handle_mapping_notify().
    */
-  std::unique_ptr<uint32_t[]> values;
+  Backend backend;
 
   /**
-   * @brief A vector of supported atoms for the window manager.
-   *
-   * This vector contains the atoms that the window manager supports.
+   * @brief Starts the programs of the config and of key bindings, and reaps
+   * them when they exit.
    */
-  std::vector<xcb_atom_t> supported_atoms = {};
+  std::unique_ptr<Launcher> launcher;
 
   /**
-   * @brief A unique pointer to an array of xcb_atom_t values.
-   *
-   * This array is used to store the atoms that the window manager supports.
+   * @brief The key bindings, compiled for handle_key_press().
    */
-  std::unique_ptr<xcb_atom_t[]> atoms;
+  Bindings bindings;
 
   /**
-   * @brief The EWMH connection for the window manager.
-   *
-   * The EWMH connection is a structure that contains information about the
-   * window manager's connection to the X server.
+   * @brief The path of the config file.
+   */
+  static constexpr const char *config_path = "config.toml";
+
+  /**
+   * @brief Parses the config file again whenever it changes, off the event
+   * loop. nullptr if the file cannot be watched.
+   */
+  std::unique_ptr<ConfigWatcher> watcher;
+
+  /**
+   * @brief The IPC control socket, served by the event loop. nullptr if the
+   * socket could not be created.
+   */
+  std::unique_ptr<Ipc::Server> ipc;
+
+  /**
+   * @brief Where the events and properties taken in are recorded. nullptr
+   * unless record() was called.
    */
-  xcb_ewmh_connection_t ewmh;
+  std::unique_ptr<Trace::Recorder> recorder;
 
 public:
   /**
-   * @brief Constructs a new WindowManager instance.
+   * @brief Constructs a new window manager.
    *
    * @details
-   * This constructor does not take any parameters. It initializes the
-   * window manager by connecting to the X server, setting up the event mask,
-   * and setting up the window manager's logger.
+   * Initializes the window manager by connecting to the X server, setting up
+   * the event mask, and setting up the window manager's logger. With a live
+   * backend, it also starts the startup programs, the config watcher and the
+   * IPC socket.
+   *
+   * @param preset The config to use instead of reading config_path.
    */
-  WindowManager();
+  explicit BasicWindowManager(std::optional<Config> preset = std::nullopt);
 
   /**
-   * @brief Destructs the WindowManager instance.
+   * @brief Destructs the window manager.
    *
    * @details
-   * This destructor is called when the WindowManager instance is no longer
+   * This destructor is called when the window manager is no longer
    * needed. It is responsible for cleaning up after the window manager, which
    * includes disconnecting from the X server and freeing any allocated memory.
    */
-  ~WindowManager();
+  ~BasicWindowManager();
+
+  BasicWindowManager(const BasicWindowManager &) = delete;
+  BasicWindowManager &operator=(const BasicWindowManager &) = delete;
 
   /**
    * @brief Starts the window manager.
@@ -183,7 +310,78 @@ public:
    */
   void run();
 
+  /**
+   * @brief Prints, once, how long it took from a point in time to handling
+   * the first MapRequest.
+   *
+   * @param start The point in time, normally when the process started.
+   */
+  void bench_startup(std::chrono::steady_clock::time_point start) {
+    startup_bench = start;
+  }
+
+  /**
+   * @brief Records every event, adopted window and commit from now on into a
+   * trace file, for helios-replay.
+   *
+   * @param path The trace file to create.
+   * @throw std::runtime_error if the file cannot be created.
+   */
+  void record(const std::string &path);
+
+  /**
+   * @brief Dispatches every event the backend has, then commits the batch.
+   * Runs before every wait of the event loop, and drives the window manager
+   * directly with a fake backend.
+   */
+  void process_events();
+
+  /**
+   * @brief The backend, for benchmarks to inject events into and count the
+   * requests of.
+   */
+  Backend &server() { return backend; }
+
+  /**
+   * @brief Routes an event to its handler, without committing what it
+   * changed. Public so that benchmarks can time dispatch on its own.
+   *
+   * @param event The event to be dispatched.
+   */
+  void dispatch(xcb_generic_event_t *event);
+
+  /**
+   * @brief The number of managed clients.
+   */
+  size_t managed() const { return clients.size(); }
+
+  /**
+   * @brief How often the layouts of all workspaces were recalled instead of
+   * recomputed.
+   */
+  Layout::Tree::MemoStats layout_memo() const {
+    Layout::Tree::MemoStats total;
+    for (const auto &workspace : workspaces) {
+      total.hits += workspace.layout.memo_stats().hits;
+      total.misses += workspace.layout.memo_stats().misses;
+    }
+    return total;
+  }
+
+#ifdef HELIOS_STATS
+  /**
+   * @brief The latency histograms and counters gathered so far.
+   */
+  const Stats &statistics() const { return metrics; }
+#endif
+
 private:
+  /**
+   * @brief Where bench_startup() measures from, until the first MapRequest
+   * is handled.
+   */
+  std::optional<std::chrono::steady_clock::time_point> startup_bench;
+
   /**
    @breif The function that updates the focus
 
@@ -203,6 +401,19 @@ private:
    */
   void handle_map_request(xcb_generic_event_t *event);
 
+  /**
+   * @brief Adopts every window in pending_adoptions.
+   */
+  void adopt_pending();
+
+  /**
+   * @brief Starts managing a window, once its properties have been requested.
+   *
+   * @param window The window to manage.
+   * @param cookies The cookies of the window's property requests.
+   */
+  void manage(xcb_window_t window, const typename Backend::Cookies &cookies);
+
   /**
    * @brief Handles an unmap request event for the given window.
    *
@@ -224,6 +435,19 @@ private:
    */
   void handle_enter_notify(xcb_generic_event_t *event);
 
+  /**
+   * @brief Handles a property notify event, noting which properties of the
+   * client to read again.
+   *
+   * @param event The event to be handled.
+   */
+  void handle_property_notify(xcb_generic_event_t *event);
+
+  /**
+   * @brief Reads the properties of stale_clients again, in one round trip.
+   */
+  void refresh_properties();
+
   /**
    * @brief Handles a key press event for the given key press event.
    *
@@ -231,6 +455,80 @@ private:
    */
   void handle_key_press(xcb_generic_event_t *event);
 
+  /**
+   * @brief Returns every key binding: the configured ones and the workspace
+   *        keys.
+   */
+  std::vector<WMConfig::Keybind> key_bindings() const;
+
+  /**
+   * @brief Grabs the keys of every binding and compiles the binding table.
+   */
+  void grab_bindings();
+
+  /**
+   * @brief Ungrabs the key combinations that are no longer bound and grabs
+   * the new ones, then compiles the binding table.
+   *
+   * @param old The bindings before the config changed.
+   */
+  void regrab_bindings(const std::vector<WMConfig::Keybind> &old);
+
+  /**
+   * @brief Applies the config parsed by the watcher, if any.
+   */
+  void reload_config();
+
+  /**
+   * @brief Has the watcher parse the config file again, to be applied by
+   * reload_config().
+   */
+  void reread_config();
+
+  /**
+   * @brief Switches to a new config, changing only what differs from the
+   * config in use.
+   *
+   * @param next The new config.
+   */
+  void apply_config(Config next);
+
+  /**
+   * @brief Runs the action of a key binding.
+   *
+   * @param action The action to run.
+   */
+  void run_action(const BoundAction &action);
+
+  /**
+   * @brief Moves the focus to the next or previous tiled window.
+   *
+   * @param step 1 for the next window, -1 for the previous one.
+   */
+  void cycle_focus(int step);
+
+  /**
+   * @brief Finds a client by its WM_CLASS class or instance name.
+   *
+   * @param name The name to look for.
+   * @return The client, or nullptr if there is none.
+   */
+  Client *find_by_class(const std::string &name);
+
+  /**
+   * @brief Politely asks a window to close.
+   *
+   * @param window The window to close.
+   */
+  void close_window(xcb_window_t window);
+
+  /**
+   * @brief Hides a tiled window or shows a hidden one.
+   *
+   * @param window The window to toggle.
+   */
+  void toggle_window(xcb_window_t window);
+
   /**
    * @brief Sets the border color of the window to the given color.
    *
@@ -239,6 +537,17 @@ private:
    */
   void set_window_border_color(xcb_window_t window, uint32_t color);
 
+  /**
+   * @brief Sends only the parts of a client's geometry and border width that
+   *        differ from what the X server already has.
+   *
+   * @param client The client to configure.
+   * @param rect The geometry to give the client.
+   * @param border_width The border width to give the client.
+   */
+  void configure_client(Client &client, const Layout::Rect &rect,
+                        uint32_t border_width);
+
   /**
    * @brief Sets the focus of the window manager to the given window.
    *
@@ -254,22 +563,175 @@ private:
   void switch_workspace(uint32_t i);
 
   /**
-   * @brief Tiles all windows in the current workspace.
+   * @brief Adds a client to the window list of a workspace.
+   *
+   * @param client The client to add.
+   * @param workspace The index of the workspace.
+   */
+  void attach(Client &client, uint32_t workspace);
+
+  /**
+   * @brief Removes a client from its workspace and its layout.
+   *
+   * @param client The client to remove.
+   */
+  void detach(Client &client);
+
+  /**
+   * @brief Tiles all windows in the current workspace, with the layout of
+   * its kind.
    */
   void tile_windows();
 
-  std::unordered_map<uint32_t, EventHandler> evH = {
-      {XCB_MAP_REQUEST,
-       [this](xcb_generic_event_t *event) { handle_map_request(event); }},
-      {XCB_UNMAP_NOTIFY,
-       [this](xcb_generic_event_t *event) { handle_unmap_request(event); }},
-      {XCB_DESTROY_NOTIFY,
-       [this](xcb_generic_event_t *event) { handle_destroy_notify(event); }},
-      {XCB_ENTER_NOTIFY,
-       [this](xcb_generic_event_t *event) { handle_enter_notify(event); }},
-      {XCB_KEY_PRESS,
-       [this](xcb_generic_event_t *event) { handle_key_press(event); }},
+  /**
+   * @brief Tiles the current workspace with its dwindle tree.
+   */
+  void tile_dwindle();
+
+  /**
+   * @brief Tiles the current workspace with a Layout::Engine.
+   */
+  template <class Engine> void tile_with();
+
+  /**
+   * @brief Gives every workspace the layout config.toml names for it.
+   */
+  void set_layouts();
+
+  /**
+   * @brief Marks parts of the window manager state as needing a commit.
+   *
+   * Handlers call this instead of talking to the X server directly, so that a
+   * burst of events results in a single retile and a single flush.
+   *
+   * @param flags A combination of DirtyFlags.
+   */
+  void mark_dirty(uint8_t flags);
+
+  /**
+   * @brief Focuses the most recently mapped window that is still tiled.
+   */
+  void focus_fallback();
+
+  /**
+   * @brief Pushes the focus and border state to the X server.
+   */
+  void commit_focus();
+
+  /**
+   * @brief Pushes all dirty state to the X server and flushes once.
+   */
+  void commit();
+
+  /**
+   * @brief Handles a keyboard or modifier mapping change.
+   *
+   * @param event The event to be handled.
+   */
+  void handle_mapping_notify(xcb_generic_event_t *event);
+
+  /**
+   * @brief Handles an error reply to a request sent without checking.
+   *
+   * @param event The error, as it came out of the event queue.
+   */
+  void handle_error(xcb_generic_event_t *event);
+
+  /**
+   * @brief Registers the handlers of the signals the window manager reacts
+   * to with the event loop.
+   */
+  void watch_signals();
+
+  /**
+   * @brief Writes the statistics of the event loop to files.
+   */
+  void dump_stats();
+
+  /**
+   * @brief Answers a request on the IPC socket, from in-process state only.
+   *
+   * @param type The Ipc::Request.
+   * @param flags Its Ipc::Flags.
+   * @param payload Its payload.
+   * @param reply Where to write the reply payload.
+   * @return The status of the reply.
+   */
+  Ipc::Status handle_ipc(uint16_t type, uint16_t flags,
+                         std::string_view payload, std::string &reply);
+
+  /**
+   * @brief Writes the reply to Ipc::REQUEST_CLIENTS.
+   */
+  void describe_clients(bool json, std::string &reply);
+
+  /**
+   * @brief Writes the reply to Ipc::REQUEST_LAYOUT.
+   */
+  void describe_layout(bool json, std::string &reply);
+
+  /**
+   * @brief Handles a shape notify event for a client.
+   *
+   * @param event The event to be handled.
+   */
+  void handle_shape_notify(xcb_generic_event_t *event);
+
+  /**
+   * @brief Handles a RandR screen change notify event.
+   *
+   * @param event The event to be handled.
+   */
+  void handle_screen_change(xcb_generic_event_t *event);
+
+  /**
+   * @brief A pointer to one of the event handlers above.
+   */
+  using EventHandler = void (BasicWindowManager::*)(xcb_generic_event_t *);
+
+  /**
+   * @brief Core event handlers, indexed by response type.
+   *
+   * Core events all have a response type below 128, so a flat array replaces
+   * a hash lookup. Types without a handler hold nullptr.
+   */
+  using DispatchTable = std::array<EventHandler, 128>;
+
+  /**
+   * @brief Builds the core dispatch table at compile time.
+   */
+  static constexpr DispatchTable make_dispatch_table();
+
+  /**
+   * @brief The core dispatch table.
+   */
+  static const DispatchTable dispatch_table;
+
+  /**
+   * @brief The handlers for the events of one X extension.
+   *
+   * Extension event codes are assigned by the server at runtime, so these are
+   * keyed by the extension's first event code instead. Only the codes the
+   * extension owns are looked up, as the next code may belong to another.
+   */
+  struct ExtensionHandlers {
+    uint8_t first_event = 0; // The extension's event base, 0 if absent.
+    uint8_t events = 0;      // How many event codes the extension has.
+    std::array<EventHandler, 2> handlers = {}; // By offset from first_event.
   };
+
+  /**
+   * @brief The handlers for SHAPE and RandR events.
+   */
+  std::array<ExtensionHandlers, 2> extension_handlers = {};
 };
 
+/**
+ * @brief The window manager of a real X server.
+ */
+using WindowManager = BasicWindowManager<XcbBackend>;
+
+extern template class BasicWindowManager<XcbBackend>;
+extern template class BasicWindowManager<FakeBackend>;
+
 #endif
\ No newline at end of file
@@ -0,0 +1,244 @@
+#ifndef IPC_H
+#define IPC_H
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "event_loop.h"
+
+/**
+ * @brief The namespace which holds the IPC protocol of the window manager,
+ * shared by the server in the window manager and by helios-msg.
+ *
+ * @details
+ * Clients talk to the window manager over a Unix stream socket. Every
+ * message, in either direction, is a Header followed by `length` bytes of
+ * payload. The socket never leaves the machine, so integers are sent in host
+ * byte order. Strings are a uint32 length followed by the bytes.
+ *
+ * A request with FLAG_JSON set gets its reply payload as JSON text instead
+ * of the binary layout documented with each Request.
+ */
+namespace Ipc {
+
+/**
+ * @brief The header of every message.
+ */
+struct Header {
+  uint32_t length; // The number of payload bytes after the header.
+  uint16_t type;   // A Request; in replies, the request being answered.
+  uint16_t flags;  // In requests, Flags; in replies, a Status.
+};
+
+/**
+ * @brief The requests a client can send.
+ */
+enum Request : uint16_t {
+  /**
+   * Runs an action, as a key binding would. Payload: the action type and
+   * its target, as two strings, with the same meaning as in config.toml:
+   * run, ch, focus, close or toggle. Reply: empty.
+   */
+  REQUEST_ACTION = 1,
+
+  /**
+   * Lists the managed clients. Reply: a uint32 count, then for each client
+   * its window, workspace, x, y, width and height as uint32 (x and y are
+   * signed), a uint32 of ClientFlags, then its instance, class and title
+   * strings.
+   */
+  REQUEST_CLIENTS = 2,
+
+  /**
+   * Describes the current workspace. Reply: the workspace as uint32, the
+   * name of its layout as a string, the focused window and a tile count as
+   * uint32, then each tile as window, x, y, width and height.
+   */
+  REQUEST_LAYOUT = 3,
+
+  /**
+   * Cycles the log level, like SIGUSR1. Reply: the new level as a string.
+   */
+  REQUEST_LOG_LEVEL = 4,
+};
+
+/**
+ * @brief The flags of a request.
+ */
+enum Flags : uint16_t {
+  FLAG_JSON = 1 << 0,
+};
+
+/**
+ * @brief The status of a reply.
+ */
+enum Status : uint16_t {
+  STATUS_OK = 0,
+  STATUS_UNKNOWN_REQUEST = 1,
+  STATUS_INVALID = 2, // The payload could not be parsed or was rejected.
+};
+
+/**
+ * @brief The bits of the flags of a client in REQUEST_CLIENTS.
+ */
+enum ClientFlags : uint32_t {
+  CLIENT_FOCUSED = 1 << 0,
+  CLIENT_TILED = 1 << 1,
+  CLIENT_URGENT = 1 << 2,
+};
+
+/**
+ * @brief The largest payload accepted, to bound what a client can make the
+ * window manager buffer.
+ */
+constexpr uint32_t MAX_PAYLOAD = 1 << 20;
+
+/**
+ * @brief The path of the socket: $HELIOS_SOCKET if set, otherwise one per
+ * display in $XDG_RUNTIME_DIR, or in /tmp without it.
+ */
+std::string socket_path();
+
+/**
+ * @brief Builds a payload.
+ */
+class Writer {
+public:
+  void u32(uint32_t value) { append(&value, sizeof(value)); }
+  void str(std::string_view value) {
+    u32(static_cast<uint32_t>(value.size()));
+    append(value.data(), value.size());
+  }
+
+  std::string &data() { return buffer; }
+
+private:
+  void append(const void *data, size_t size) {
+    buffer.append(static_cast<const char *>(data), size);
+  }
+
+  std::string buffer;
+};
+
+/**
+ * @brief Reads a payload. Reading past the end sets a sticky error instead
+ * of failing, so a whole payload can be read before checking ok().
+ */
+class Reader {
+public:
+  explicit Reader(std::string_view data) : data(data) {}
+
+  uint32_t u32() {
+    uint32_t value = 0;
+    take(&value, sizeof(value));
+    return value;
+  }
+  std::string str() {
+    uint32_t size = u32();
+    if (size > data.size() - pos) {
+      failed = true;
+      return {};
+    }
+    std::string value(data.substr(pos, size));
+    pos += size;
+    return value;
+  }
+
+  bool ok() const { return !failed; }
+  bool done() const { return pos == data.size(); }
+
+private:
+  void take(void *out, size_t size) {
+    if (failed || size > data.size() - pos) {
+      failed = true;
+      return;
+    }
+    std::memcpy(out, data.data() + pos, size);
+    pos += size;
+  }
+
+  std::string_view data;
+  size_t pos = 0;
+  bool failed = false;
+};
+
+/**
+ * @brief Escapes a string for a JSON string literal, quotes included.
+ */
+std::string json_string(std::string_view value);
+
+/**
+ * @class Server
+ *
+ * @brief The listening socket and the client connections.
+ *
+ * @details
+ * Every socket is non-blocking and watched by the event loop of the window
+ * manager, next to the X connection. Connections are accepted as they come,
+ * every whole request is answered through the handler, and replies are
+ * written out as far as the socket allows, the rest when it is writable
+ * again. Nothing here ever blocks.
+ */
+class Server {
+public:
+  /**
+   * @brief Answers a request.
+   *
+   * @param type The Request.
+   * @param flags Its Flags.
+   * @param payload Its payload.
+   * @param reply Where to write the reply payload.
+   * @return The Status of the reply.
+   */
+  using Handler = std::function<Status(uint16_t type, uint16_t flags,
+                                       std::string_view payload,
+                                       std::string &reply)>;
+
+  /**
+   * @brief Listens on a socket, replacing a stale socket file.
+   *
+   * @param loop The loop that serves the sockets. Must outlive the server.
+   * @param path The path of the socket.
+   * @param handler Called for every request.
+   * @throw std::runtime_error if the socket cannot be created.
+   */
+  Server(EventLoop &loop, std::string path, Handler handler);
+
+  /**
+   * @brief Closes every connection and removes the socket file.
+   */
+  ~Server();
+
+  Server(const Server &) = delete;
+  Server &operator=(const Server &) = delete;
+
+private:
+  /**
+   * @brief A client connection, with what is left to read and to write.
+   */
+  struct Connection {
+    std::string in;
+    std::string out;
+    bool writable_watched = false; // Whether EPOLLOUT is being waited for.
+  };
+
+  void accept_all();
+  void serve(int fd, uint32_t events);
+  void drop(int fd);
+  bool read_from(int fd, Connection &connection);
+  bool write_to(int fd, Connection &connection);
+
+  EventLoop &loop;
+  std::string path;
+  Handler handler;
+  int listen_fd = -1;
+  std::unordered_map<int, Connection> connections;
+};
+
+} // namespace Ipc
+
+#endif
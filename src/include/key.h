@@ -1,57 +1,159 @@
-#include <cstdlib>
+#ifndef KEY_H
+#define KEY_H
+
+#include <cstdint>
+#include <vector>
 #include <xcb/xcb.h>
-#include <xcb/xcb_ewmh.h>
 #include <xcb/xcb_keysyms.h>
 #include <xcb/xproto.h>
 
-#include <iostream>
+#include <X11/keysym.h>
 
 /**
- * @brief Grabs a key so that it will not be passed to other X clients.
- * 
+ * @brief Turns a modifier from the config file into an X modifier mask.
+ *
  * @details
- * This function will grab a key so that it will not be passed to other X clients.
- * It will use the XCB library to do this. The function takes four parameters: a
- * pointer to an XCB connection, a modifier mask, a keysym, and a window ID. The
- * function will return nothing.
- * 
- * The first thing the function does is to allocate a key symbols structure. This
- * structure will be used to look up the keycode associated with the given keysym.
- * The function does this by calling xcb_key_symbols_alloc(). The function then
- * looks up the keycode associated with the given keysym by calling
- * xcb_key_symbols_get_keycode(). If this call fails, the function will print an
- * error message and exit with a status of EXIT_FAILURE.
- * 
- * If the call succeeds, the function will then call xcb_grab_key() to grab the
- * key. The function passes 1 as the first parameter to xcb_grab_key() to specify
- * that the key should be grabbed for the given window. The second parameter is
- * the window ID, the third is the modifier mask, the fourth is the keycode, the
- * fifth is the grab mode, and the sixth is the grab mode. The function then calls
- * xcb_flush() to flush the XCB connection.
- * 
- * Finally, the function frees the key symbols structure by calling
- * xcb_key_symbols_free().
- * 
- * @param conn The XCB connection to use.
- * @param mod The modifier mask to use.
- * @param keysym The keysym to use.
- * @param window The window ID to use.
- * @exception exit(EXIT_FAILURE) if the system is unable to find keycode for a given keysym
+ * The config file accepts either a modifier mask (XCB_MOD_MASK_*) or the
+ * keysym of a modifier key, such as XK_Super_L (0xffeb). Keysyms of modifier
+ * keys all live in the 0xffe1-0xffee range, far above any modifier mask, so
+ * the two cannot be confused. Keysyms are mapped to the modifier they
+ * conventionally drive: Shift, Lock, Control, Mod1 for Alt and Meta, and Mod4
+ * for Super and Hyper.
+ *
+ * @param mod The modifier, as written in the config file.
+ * @return The modifier mask to grab with.
  */
-inline void grab_key(xcb_connection_t *conn, uint16_t mod, uint32_t keysym,
-                     xcb_window_t window) {
-  auto *keysyms = xcb_key_symbols_alloc(conn);
-  auto *keycode = xcb_key_symbols_get_keycode(keysyms, keysym);
-
-  if (keycode) {
-    xcb_grab_key(conn, 1, window, mod, *keycode, XCB_GRAB_MODE_ASYNC,
-                 XCB_GRAB_MODE_ASYNC);
-    xcb_flush(conn);
-    free(keycode);
-  } else {
-    std::cerr << "Unable to find keycode for the given keysym." << std::endl;
-    exit(EXIT_FAILURE);
+inline uint16_t modifier_mask(uint32_t mod) {
+  switch (mod) {
+  case XK_Shift_L:
+  case XK_Shift_R:
+    return XCB_MOD_MASK_SHIFT;
+  case XK_Caps_Lock:
+  case XK_Shift_Lock:
+    return XCB_MOD_MASK_LOCK;
+  case XK_Control_L:
+  case XK_Control_R:
+    return XCB_MOD_MASK_CONTROL;
+  case XK_Alt_L:
+  case XK_Alt_R:
+  case XK_Meta_L:
+  case XK_Meta_R:
+    return XCB_MOD_MASK_1;
+  case XK_Super_L:
+  case XK_Super_R:
+  case XK_Hyper_L:
+  case XK_Hyper_R:
+    return XCB_MOD_MASK_4;
+  default:
+    return static_cast<uint16_t>(mod);
   }
-
-  xcb_key_symbols_free(keysyms);
 }
+
+/**
+ * @class Keyboard
+ *
+ * @brief Owns the keysym table and the key grabs of the window manager.
+ *
+ * @details
+ * The keyboard and modifier mappings are requested when the keyboard is
+ * created and only waited for when the first grab needs them, so creating it
+ * costs no round trip. The keysym table is shared by every lookup. Grabs are
+ * only queued on the connection, so the caller decides when to flush, and
+ * every grab is made for each combination of Caps Lock and Num Lock so that
+ * bindings keep working whatever their state.
+ *
+ * When the X server sends a MappingNotify, refresh() downloads the new
+ * mapping and only regrabs the bindings whose keycodes actually moved. A
+ * change of the modifier mapping regrabs everything if Num Lock moved to
+ * another modifier.
+ */
+class Keyboard {
+public:
+  /**
+   * @brief Creates the keysym table for a connection, sending the requests
+   * for the keyboard and modifier mappings without waiting for them.
+   *
+   * @param conn The XCB connection to use.
+   * @param root The window to grab keys on.
+   */
+  Keyboard(xcb_connection_t *conn, xcb_window_t root);
+
+  /**
+   * @brief Frees the keysym table. Grabs die with the connection.
+   */
+  ~Keyboard();
+
+  Keyboard(const Keyboard &) = delete;
+  Keyboard &operator=(const Keyboard &) = delete;
+
+  /**
+   * @brief Grabs a key combination on the root window.
+   *
+   * @param mods The modifier mask, without Lock or Num Lock.
+   * @param keysym The keysym to grab.
+   * @return false if no key produces the keysym. The binding is still
+   * remembered, and grabbed should a later mapping produce the keysym.
+   */
+  bool grab(uint16_t mods, xcb_keysym_t keysym);
+
+  /**
+   * @brief Releases and forgets the grabs of a key combination.
+   *
+   * @param mods The modifier mask it was grabbed with.
+   * @param keysym The keysym it was grabbed with.
+   */
+  void ungrab(uint16_t mods, xcb_keysym_t keysym);
+
+  /**
+   * @brief Releases and forgets every grab.
+   */
+  void ungrab_all();
+
+  /**
+   * @brief Applies a MappingNotify event.
+   *
+   * @param event The MappingNotify event.
+   * @return true if the keycode of any grab changed.
+   */
+  bool refresh(xcb_mapping_notify_event_t *event);
+
+  /**
+   * @brief Strips Lock, Num Lock and the mouse buttons from a modifier
+   * state, leaving what bindings are matched on.
+   *
+   * @param state The state of a key event.
+   */
+  uint16_t clean_mask(uint16_t state) const {
+    return state & ~(XCB_MOD_MASK_LOCK | numlock) &
+           (XCB_MOD_MASK_SHIFT | XCB_MOD_MASK_CONTROL | XCB_MOD_MASK_1 |
+            XCB_MOD_MASK_2 | XCB_MOD_MASK_3 | XCB_MOD_MASK_4 | XCB_MOD_MASK_5);
+  }
+
+  /**
+   * @brief The keycodes that currently produce a keysym.
+   *
+   * @param keysym The keysym to look up.
+   */
+  std::vector<xcb_keycode_t> keycodes(xcb_keysym_t keysym) const;
+
+private:
+  struct Grab {
+    uint16_t mods;
+    xcb_keysym_t keysym;
+    std::vector<xcb_keycode_t> keycodes;
+  };
+
+  void apply(const Grab &grab, bool enable) const;
+  void resolve_numlock();
+  uint16_t read_numlock(xcb_get_modifier_mapping_cookie_t cookie) const;
+
+  xcb_connection_t *conn;
+  xcb_window_t root;
+  xcb_key_symbols_t *syms;
+  uint16_t numlock = 0;
+  xcb_get_modifier_mapping_cookie_t pending_modmap;
+  bool modmap_pending = false; // pending_modmap was not collected yet.
+  std::vector<Grab> grabs;
+};
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef LAUNCHER_H
+#define LAUNCHER_H
+
+#include <chrono>
+#include <memory>
+#include <spdlog/spdlog.h>
+#include <string>
+#include <sys/types.h>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @class Launcher
+ *
+ * @brief Starts programs and reaps them when they exit.
+ *
+ * @details
+ * Programs are started with posix_spawn(), which glibc implements with
+ * vfork semantics: the child shares the memory of the window manager until
+ * it calls exec, so no page tables are copied, however large the window
+ * manager grows. The child gets an empty signal mask back and the default
+ * SIGCHLD disposition.
+ *
+ * The event loop handles SIGCHLD and calls reap(). Every child is remembered
+ * with the command that started it until it is reaped, so no zombie is left
+ * behind and its exit is logged with a name.
+ */
+class Launcher {
+public:
+  /**
+   * @param logger Where launches and exits are logged.
+   */
+  explicit Launcher(std::shared_ptr<spdlog::logger> logger)
+      : logger(std::move(logger)) {}
+
+  Launcher(const Launcher &) = delete;
+  Launcher &operator=(const Launcher &) = delete;
+
+  /**
+   * @brief Starts a program from an already split argument vector.
+   *
+   * @param argv The NULL-terminated argument vector. argv[0] is looked up in
+   * PATH.
+   * @return The pid of the child, or -1 if it could not be started.
+   */
+  pid_t spawn(char *const argv[]);
+
+  /**
+   * @brief Starts a command through /bin/sh -c.
+   *
+   * @param command The command line.
+   * @return The pid of the child, or -1 if it could not be started.
+   */
+  pid_t spawn(const std::string &command);
+
+  /**
+   * @brief Starts several commands through /bin/sh -c at the same time.
+   *
+   * Each posix_spawn() waits for its child to exec, so the commands are
+   * started from one thread each and the call takes as long as the slowest
+   * launch instead of the sum of them. The launch latency of every command
+   * is logged.
+   *
+   * @param commands The command lines.
+   */
+  void spawn_all(const std::vector<std::string> &commands);
+
+  /**
+   * @brief Reaps every child that exited. Called on SIGCHLD.
+   */
+  void reap();
+
+private:
+  /**
+   * @brief A running child.
+   */
+  struct Child {
+    std::string command; // What started it, for the logs.
+    std::chrono::steady_clock::time_point started;
+  };
+
+  pid_t launch(char *const argv[], int &error) const;
+  void remember(pid_t pid, std::string command,
+                std::chrono::steady_clock::time_point started);
+
+  std::shared_ptr<spdlog::logger> logger;
+  std::unordered_map<pid_t, Child> children;
+};
+
+#endif
@@ -0,0 +1,252 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <xcb/xproto.h>
+
+#include "window_index.h"
+
+/**
+ * @brief The namespace which holds the geometry types, the persistent split
+ * tree used to tile windows and the other layout engines.
+ *
+ */
+namespace Layout {
+
+/**
+ * @brief A rectangle on the screen, in pixels.
+ */
+struct Rect {
+  int x, y, width, height;
+
+  bool operator==(const Rect &other) const {
+    return x == other.x && y == other.y && width == other.width &&
+           height == other.height;
+  }
+  bool operator!=(const Rect &other) const { return !(*this == other); }
+};
+
+/**
+ * @brief The ways a workspace can lay its windows out.
+ */
+enum class Kind : uint8_t {
+  dwindle,      // Each window splits the largest one, see Tree.
+  master_stack, // The first window on the left, the others stacked right.
+  monocle,      // The focused window fills the area, the others beneath.
+  grid,         // Rows and columns as even as the count allows.
+};
+
+/**
+ * @brief Parses the name of a Kind, as written in config.toml.
+ *
+ * @param name "dwindle", "master-stack", "monocle" or "grid".
+ * @param out Where to store the Kind.
+ * @return false if the name is unknown.
+ */
+bool parse_kind(const std::string &name, Kind &out);
+
+/**
+ * @brief The name of a Kind, as written in config.toml.
+ */
+const char *kind_name(Kind kind);
+
+/**
+ * @brief A layout whose geometry only depends on the number of windows.
+ *
+ * @details
+ * Every specialization has:
+ *
+ * - `static constexpr bool focused_only`: whether only the focused window is
+ *   shown, in which case it is the only one placed and it is raised above
+ *   the others. Otherwise every window is placed, in mapping order.
+ * - `static void arrange(const Rect &area, int gap, size_t count, Rect
+ *   *out)`: writes the rectangles of the count windows placed into out,
+ *   which has room for them.
+ *
+ * The dwindle layout depends on the order windows came and went in, so it
+ * is the Tree below instead.
+ */
+template <Kind K> struct Engine;
+
+template <> struct Engine<Kind::master_stack> {
+  static constexpr bool focused_only = false;
+  static void arrange(const Rect &area, int gap, size_t count, Rect *out);
+};
+
+/**
+ * The focused window fills the screen. The others keep the geometry they
+ * had, under it, so a retile configures at most one window.
+ */
+template <> struct Engine<Kind::monocle> {
+  static constexpr bool focused_only = true;
+  static void arrange(const Rect &area, int gap, size_t count, Rect *out);
+};
+
+template <> struct Engine<Kind::grid> {
+  static constexpr bool focused_only = false;
+  static void arrange(const Rect &area, int gap, size_t count, Rect *out);
+};
+
+/**
+ * @brief A persistent binary space partitioning tree implementing the dwindle
+ * layout.
+ *
+ * @details
+ * Every leaf holds one window and every inner node holds the split that
+ * created its two children. A new window splits the leaf with the largest
+ * area (the oldest one on ties), alternating between vertical and horizontal
+ * splits, which is exactly what the old from-scratch tiling did. Removing a
+ * window hands its parent's space to its sibling.
+ *
+ * Each node caches the largest leaf of its subtree, so an insertion only
+ * walks one root-to-leaf path and a removal only relayouts the sibling's
+ * subtree. Leaves whose rectangle changed are remembered until
+ * take_changes() is called, so the caller only configures those.
+ *
+ * Only a new area or gap relays the whole tree out. The last MEMO_SIZE
+ * layouts are kept, keyed by the area, the gap and the shape of the tree,
+ * so going back to one of them, as docking and undocking a laptop does, is
+ * a copy instead of a recursion. Inserting or removing a window changes the
+ * shape and so retires them, except that removing the window inserted last
+ * gives back the shape from before it, as opening and closing a dialog
+ * leaves the tree as it was.
+ */
+class Tree {
+public:
+  /**
+   * @brief Sets the area to tile and the gap between windows.
+   *
+   * The whole tree is relaid out if either differs from the current values.
+   *
+   * @param area The area the windows may occupy, usually the screen.
+   * @param gap The gap between windows and around the area, in pixels.
+   */
+  void set_area(Rect area, int gap);
+
+  /**
+   * @brief Adds a window by splitting the largest leaf.
+   *
+   * @param window The window to add. Adding a window twice does nothing.
+   */
+  void insert(xcb_window_t window);
+
+  /**
+   * @brief Removes a window and gives its space to its sibling.
+   *
+   * @param window The window to remove. Unknown windows are ignored.
+   */
+  void remove(xcb_window_t window);
+
+  /**
+   * @brief Whether the window is tiled by this tree.
+   */
+  bool contains(xcb_window_t window) const {
+    return leaves.contains(window);
+  }
+
+  /**
+   * @brief The number of tiled windows.
+   */
+  size_t size() const { return leaves.size(); }
+
+  /**
+   * @brief Reports every window on the next take_changes(), for when
+   * another layout moved them in the meantime.
+   */
+  void mark_all();
+
+  /**
+   * @brief How often set_area() found the layout among those it kept.
+   */
+  struct MemoStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+  };
+
+  const MemoStats &memo_stats() const { return memo_counts; }
+
+  /**
+   * @brief Calls fn(window, rect) for every window whose rectangle changed
+   * since the last call, then forgets the changes.
+   *
+   * @param fn The callback to invoke.
+   */
+  template <typename Fn> void take_changes(Fn &&fn) {
+    for (uint32_t idx : changed) {
+      Node &node = nodes[idx];
+      if (!node.changed)
+        continue;
+      node.changed = false;
+      // Freed since it was queued, or reused as an inner node.
+      if (node.window == XCB_NONE)
+        continue;
+      fn(node.window, node.rect);
+    }
+    changed.clear();
+  }
+
+private:
+  static constexpr uint32_t NIL = UINT32_MAX;
+
+  struct Node {
+    Rect rect = {0, 0, 0, 0};
+    uint32_t parent = NIL;
+    uint32_t child[2] = {NIL, NIL};
+    xcb_window_t window = XCB_NONE; // Set on leaves only.
+    bool split_horizontal = false;  // Set on inner nodes only.
+    bool changed = false; // Queued in `changed`, even once freed.
+    uint64_t seq = 0;               // Insertion order of a leaf.
+    int64_t best_area = 0;          // Largest leaf area in the subtree.
+    uint64_t best_seq = 0;          // Insertion order of that leaf.
+    uint32_t best_leaf = NIL;       // That leaf.
+  };
+
+  /**
+   * @brief A layout of the whole tree, as set_area() left it.
+   */
+  struct Memo {
+    Rect area = {0, 0, 0, 0};
+    int gap = 0;
+    uint64_t shape = 0; // The value of `shape` it was laid out for.
+    uint64_t used = 0;  // When it was last stored or recalled.
+    std::vector<Node> nodes;
+  };
+
+  static constexpr size_t MEMO_SIZE = 2;
+
+  void remember();
+  bool recall();
+
+  uint32_t alloc_node();
+  void free_node(uint32_t idx);
+  void mark(uint32_t idx);
+  void assign(uint32_t idx, Rect rect);
+  void update_best(uint32_t idx);
+  void update_path(uint32_t idx);
+  Rect root_rect() const;
+
+  std::vector<Node> nodes;
+  std::vector<uint32_t> free_nodes;
+  std::vector<uint32_t> changed;
+  WindowIndex leaves; // Window ID to leaf.
+  uint32_t root = NIL;
+  uint64_t next_seq = 0;
+  Rect area = {0, 0, 0, 0};
+  int gap = 0;
+
+  uint64_t shape = 1;       // A new value for every new shape of the tree.
+  uint64_t shape_clock = 1; // The last value given out.
+  xcb_window_t last_insert = XCB_NONE;
+  uint64_t shape_before_insert = 0;
+  uint64_t memo_clock = 0;
+  std::array<Memo, MEMO_SIZE> memos;
+  MemoStats memo_counts;
+};
+
+} // namespace Layout
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <spdlog/sinks/sink.h>
+#include <spdlog/spdlog.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @class RingSink
+ *
+ * @brief An spdlog sink that hands messages to a background writer thread
+ * through a preallocated lock-free ring buffer.
+ *
+ * @details
+ * Logging from the event loop costs a filtered level check, the formatting
+ * of the message text and a copy into a ring slot. No lock is taken, nothing
+ * is allocated and nothing touches the file. The writer thread does the
+ * rest: it stamps the line with the pattern, writes it out and flushes once
+ * the ring is empty, so a burst of messages costs a single write.
+ *
+ * The ring is a bounded multi-producer queue with a sequence number per
+ * slot, so any thread may log. When it is full, messages are dropped rather
+ * than blocking the caller, and the writer reports how many were lost.
+ * Identical messages logged in a row are written once, followed by a count
+ * of the repeats. Text longer than a slot is truncated.
+ */
+class RingSink : public spdlog::sinks::sink {
+public:
+  /**
+   * @brief Opens the log file and starts the writer thread.
+   *
+   * @param name The logger name stamped on lines.
+   * @param filename The file to append to.
+   * @param capacity The number of slots in the ring, rounded up to a power
+   * of two.
+   * @throw spdlog::spdlog_ex if the file cannot be opened.
+   */
+  RingSink(std::string name, const std::string &filename, size_t capacity);
+
+  /**
+   * @brief Writes out what is left in the ring and stops the writer thread.
+   */
+  ~RingSink() override;
+
+  void log(const spdlog::details::log_msg &msg) override;
+  void flush() override;
+  void set_pattern(const std::string &pattern) override;
+  void set_formatter(std::unique_ptr<spdlog::formatter> formatter) override;
+
+  /**
+   * @brief The number of messages dropped because the ring was full.
+   */
+  size_t dropped() const { return total_dropped.load(); }
+
+private:
+  static constexpr size_t TEXT_SIZE = 226; // Makes a slot 256 bytes.
+
+  /**
+   * @brief A slot of the ring. seq says whose turn it is: the slot is free
+   * for the producer of position p when seq == p, and holds that producer's
+   * message when seq == p + 1.
+   */
+  struct alignas(64) Slot {
+    std::atomic<size_t> seq;
+    spdlog::log_clock::time_point time;
+    size_t thread_id;
+    spdlog::level::level_enum level;
+    uint16_t length;
+    char text[TEXT_SIZE];
+  };
+
+  void run();
+  bool drain(spdlog::memory_buf_t &out);
+  void write(const Slot &slot, spdlog::memory_buf_t &out);
+  void write_note(spdlog::level::level_enum level, const std::string &text,
+                  spdlog::memory_buf_t &out);
+  void end_repeats(spdlog::memory_buf_t &out);
+
+  std::vector<Slot> slots;
+  size_t mask;
+  alignas(64) std::atomic<size_t> head{0}; // Next position to produce.
+  alignas(64) size_t tail = 0;             // Next position to consume.
+
+  std::atomic<size_t> lost{0};          // Dropped since last reported.
+  std::atomic<size_t> total_dropped{0}; // Dropped since startup.
+
+  // Only touched by the writer thread, or under formatter_mutex.
+  std::FILE *file;
+  std::mutex formatter_mutex;
+  std::unique_ptr<spdlog::formatter> formatter;
+  std::string name;
+
+  // The last line written, to collapse repeats.
+  spdlog::level::level_enum last_level = spdlog::level::off;
+  std::string last_text;
+  size_t repeats = 0;
+
+  std::mutex wake_mutex;
+  std::condition_variable wake;
+  std::atomic<bool> stopping{false};
+  std::thread writer;
+};
+
+/**
+ * @brief Creates a logger that writes to a file through a RingSink.
+ *
+ * @param name The name of the logger.
+ * @param filename The file to append to.
+ * @param capacity The number of messages the ring holds.
+ */
+std::shared_ptr<spdlog::logger>
+make_async_logger(const std::string &name, const std::string &filename,
+                  size_t capacity = 1024);
+
+/**
+ * @brief Moves a logger to the next level, cycling from info to debug,
+ * trace, warn, error and back to info.
+ *
+ * @param logger The logger to change.
+ * @return The new level.
+ */
+spdlog::level::level_enum cycle_log_level(spdlog::logger &logger);
+
+#endif
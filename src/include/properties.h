@@ -0,0 +1,98 @@
+#ifndef PROPERTIES_H
+#define PROPERTIES_H
+
+#include <xcb/xcb.h>
+#include <xcb/xcb_ewmh.h>
+#include <xcb/xproto.h>
+
+#include "client.h"
+
+/**
+ * @brief The namespace which holds the functions that read the ICCCM and EWMH
+ * properties of a window.
+ *
+ * @details
+ * Reading is split in two so that the requests for many windows can be sent
+ * before waiting for any reply: request() only queues the requests and
+ * returns their cookies, collect() waits for the replies and parses them.
+ * Adopting any number of windows this way costs a single round trip, and so
+ * does reading again the properties that changed on any number of windows.
+ */
+namespace Properties {
+
+/**
+ * @brief The cookies of the requests sent to adopt one window, or to read
+ * some of its properties again.
+ */
+struct Cookies {
+  uint8_t fields = 0; // The ClientProperties::Field requested.
+  xcb_get_window_attributes_cookie_t attributes = {0}; // Adoption only.
+  xcb_get_property_cookie_t name;
+  xcb_get_property_cookie_t legacy_name;
+  xcb_get_property_cookie_t wm_class;
+  xcb_get_property_cookie_t window_type;
+  xcb_get_property_cookie_t hints;
+  xcb_get_property_cookie_t normal_hints;
+  xcb_get_property_cookie_t state;
+  xcb_get_property_cookie_t protocols;
+};
+
+/**
+ * @brief Sends every request needed to adopt a window, without waiting.
+ *
+ * @param ewmh The EWMH connection, which also carries the XCB connection.
+ * @param window The window to read.
+ * @return The cookies to hand to collect().
+ */
+Cookies request(xcb_ewmh_connection_t *ewmh, xcb_window_t window);
+
+/**
+ * @brief Sends the requests for some of the properties of a window, without
+ * waiting.
+ *
+ * @param ewmh The EWMH connection.
+ * @param window The window to read.
+ * @param fields The ClientProperties::Field to read.
+ * @return The cookies to hand to update().
+ */
+Cookies request(xcb_ewmh_connection_t *ewmh, xcb_window_t window,
+                uint8_t fields);
+
+/**
+ * @brief Waits for the replies of request() and parses them.
+ *
+ * Errors, such as the window having been destroyed in the meantime, are
+ * consumed here instead of ending up in the event queue.
+ *
+ * @param ewmh The EWMH connection the requests were sent on.
+ * @param cookies The cookies returned by request().
+ * @param props Where to store the parsed properties.
+ * @param override_redirect Set to the window's override-redirect flag.
+ * @return false if the window no longer exists.
+ */
+bool collect(xcb_ewmh_connection_t *ewmh, const Cookies &cookies,
+             ClientProperties &props, bool &override_redirect);
+
+/**
+ * @brief Waits for the replies of a request() for some fields, and replaces
+ * those fields. A property that was deleted resets its field.
+ *
+ * @param ewmh The EWMH connection the requests were sent on.
+ * @param cookies The cookies returned by request().
+ * @param props The properties to update.
+ */
+void update(xcb_ewmh_connection_t *ewmh, const Cookies &cookies,
+            ClientProperties &props);
+
+/**
+ * @brief The field a property belongs to.
+ *
+ * @param ewmh The EWMH connection, which holds the interned atoms.
+ * @param atom The atom of the property, as in a PropertyNotify.
+ * @return A ClientProperties::Field, or 0 for the properties not kept.
+ */
+uint8_t field_of(const xcb_ewmh_connection_t *ewmh, xcb_atom_t atom);
+
+} // namespace Properties
+
+#endif
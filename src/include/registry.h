@@ -0,0 +1,102 @@
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+#include <cstdint>
+#include <vector>
+#include <xcb/xproto.h>
+
+#include "client.h"
+#include "window_index.h"
+
+/**
+ * @class ClientRegistry
+ *
+ * @brief The clients managed by the window manager, indexed by window ID.
+ *
+ * @details
+ * The clients are stored contiguously in a dense vector of slots, so that
+ * walking all of them touches memory in order. An open-addressing hash table
+ * with linear probing maps each window ID to its slot. Removing a client
+ * moves the last slot into the hole, so lookups, insertions and removals are
+ * all O(1) and the slots never have gaps. Neither allocates once the
+ * registry has held as many clients.
+ *
+ * Since slots move, a pointer or reference to a client is only valid until
+ * the next insert() or erase().
+ *
+ * The registry also maintains the intrusive lists threaded through the
+ * clients, such as the mapping order and focus history of a workspace.
+ */
+class ClientRegistry {
+public:
+  /**
+   * @brief A pointer to one of the list links of Client.
+   */
+  using LinkMember = Client::Link Client::*;
+
+  /**
+   * @brief Finds the client of a window.
+   *
+   * @param window The window ID.
+   * @return The client, or nullptr if the window is not managed.
+   */
+  Client *find(xcb_window_t window) {
+    uint32_t slot = index.find(window);
+    return slot == WindowIndex::NOT_FOUND ? nullptr : &slots[slot];
+  }
+
+  const Client *find(xcb_window_t window) const {
+    uint32_t slot = index.find(window);
+    return slot == WindowIndex::NOT_FOUND ? nullptr : &slots[slot];
+  }
+
+  bool contains(xcb_window_t window) const { return index.contains(window); }
+
+  /**
+   * @brief Finds the client of a window, adding a new one if there is none.
+   *
+   * @param window The window ID, which must not be XCB_NONE.
+   * @return The client, with its window set.
+   */
+  Client &insert(xcb_window_t window);
+
+  /**
+   * @brief Removes the client of a window. The client must already be
+   * unlinked from every list.
+   *
+   * @param window The window ID.
+   * @return false if the window was not managed.
+   */
+  bool erase(xcb_window_t window);
+
+  void clear();
+
+  size_t size() const { return slots.size(); }
+  bool empty() const { return slots.empty(); }
+
+  std::vector<Client>::iterator begin() { return slots.begin(); }
+  std::vector<Client>::iterator end() { return slots.end(); }
+  std::vector<Client>::const_iterator begin() const { return slots.begin(); }
+  std::vector<Client>::const_iterator end() const { return slots.end(); }
+
+  /**
+   * @brief Links a client at the front of a list.
+   */
+  void push_front(ClientList &list, LinkMember link, Client &client);
+
+  /**
+   * @brief Links a client at the back of a list.
+   */
+  void push_back(ClientList &list, LinkMember link, Client &client);
+
+  /**
+   * @brief Unlinks a client from a list it is on.
+   */
+  void unlink(ClientList &list, LinkMember link, Client &client);
+
+private:
+  std::vector<Client> slots;
+  WindowIndex index; // Window ID to slot.
+};
+
+#endif
@@ -0,0 +1,191 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/**
+ * @brief Wraps a statement that only exists in builds with statistics.
+ *
+ * @details
+ * Configure with `meson configure -Dstats=true` to define HELIOS_STATS.
+ * Without it, every HELIOS_STAT() vanishes, along with its clock reads.
+ */
+#ifdef HELIOS_STATS
+#define HELIOS_STAT(...) __VA_ARGS__
+#else
+#define HELIOS_STAT(...)
+#endif
+
+/**
+ * @class Histogram
+ *
+ * @brief A histogram of durations with log-scaled buckets, in the spirit of
+ * HdrHistogram.
+ *
+ * @details
+ * Every power of two is split into SUB_BUCKETS linear buckets, so a value is
+ * recorded with a relative error below 1 / SUB_BUCKETS whatever its
+ * magnitude, from nanoseconds to a minute. Recording is a count leading
+ * zeros, a shift and an increment.
+ */
+class Histogram {
+public:
+  static constexpr unsigned SUB_BITS = 3;
+  static constexpr unsigned SUB_BUCKETS = 1 << SUB_BITS;
+  static constexpr unsigned MAX_BITS = 36; // Values are clamped to 2^36 ns.
+  static constexpr unsigned BUCKETS = (MAX_BITS - SUB_BITS + 1) * SUB_BUCKETS;
+
+  /**
+   * @brief Records a value.
+   *
+   * @param value The value, in nanoseconds.
+   */
+  void record(uint64_t value) {
+    ++buckets[index(value)];
+    ++total;
+    sum += value;
+    if (value < min_value)
+      min_value = value;
+    if (value > max_value)
+      max_value = value;
+  }
+
+  uint64_t count() const { return total; }
+  uint64_t min() const { return total ? min_value : 0; }
+  uint64_t max() const { return max_value; }
+  double mean() const { return total ? double(sum) / total : 0; }
+
+  /**
+   * @brief The value below which a share of the recorded values fall.
+   *
+   * @param percentile The share, from 0 to 100.
+   * @return The highest value of the bucket the percentile lies in.
+   */
+  uint64_t percentile(double percentile) const;
+
+private:
+  static unsigned index(uint64_t value) {
+    if (value < SUB_BUCKETS)
+      return static_cast<unsigned>(value);
+    unsigned exponent = 63 - __builtin_clzll(value);
+    if (exponent >= MAX_BITS)
+      return BUCKETS - 1;
+    unsigned sub = (value >> (exponent - SUB_BITS)) & (SUB_BUCKETS - 1);
+    return (exponent - SUB_BITS + 1) * SUB_BUCKETS + sub;
+  }
+
+  static uint64_t highest(unsigned index);
+
+  std::array<uint32_t, BUCKETS> buckets = {};
+  uint64_t total = 0;
+  uint64_t sum = 0;
+  uint64_t min_value = UINT64_MAX;
+  uint64_t max_value = 0;
+};
+
+/**
+ * @class Stats
+ *
+ * @brief Latency histograms and counters of the event loop.
+ *
+ * @details
+ * Handlers are timed into a histogram for their response type. Two
+ * end-to-end latencies are tracked as well, from the moment the event is
+ * taken off the queue to the flush that makes its effect visible: input to
+ * focus, for key presses and pointer crossings that move the focus, and map
+ * to tile, for MapRequests.
+ *
+ * A clock read costs about as much as dispatching an event, so only one
+ * batch in BATCH_SAMPLE is sampled: the handler of its first event is timed,
+ * and its first input and MapRequest start the end-to-end latencies. The
+ * events of other batches cost a branch.
+ *
+ * Everything here is only touched from the event loop, so nothing is
+ * atomic.
+ */
+class Stats {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  /**
+   * @brief Counters of the requests and work the event loop generates.
+   */
+  struct Counters {
+    uint64_t configures = 0;  // ConfigureWindow requests sent.
+    uint64_t flushes = 0;     // xcb_flush() calls.
+    uint64_t round_trips = 0; // Waits for a reply.
+    uint64_t retiles = 0;     // Layouts pushed to the X server.
+  };
+
+  static constexpr unsigned BATCH_SAMPLE = 16;
+
+  static Clock::time_point now() { return Clock::now(); }
+
+  /**
+   * @brief Whether the current batch is sampled.
+   */
+  bool sampling_batch() const { return batch_sampled; }
+
+  /**
+   * @brief Whether to time the handler of an event of a sampled batch: true
+   * for the first one only.
+   */
+  bool time_handler() {
+    bool first = !handler_timed;
+    handler_timed = true;
+    return first;
+  }
+
+  /**
+   * @brief Moves on to the next batch, once the current one is committed.
+   */
+  void next_batch() {
+    batch_sampled = (++batches & (BATCH_SAMPLE - 1)) == 0;
+    handler_timed = false;
+  }
+
+  /**
+   * @brief Records how long the handler of an event took.
+   *
+   * @param type The response type of the event, without the sent bit.
+   * @param start When the handler started.
+   */
+  void record_event(uint8_t type, Clock::time_point start);
+
+  /**
+   * @brief Records a latency that ends now.
+   */
+  static void record_since(Histogram &histogram, Clock::time_point start) {
+    histogram.record(static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(now() - start)
+            .count()));
+  }
+
+  /**
+   * @brief Writes everything as human-readable text.
+   */
+  std::string text() const;
+
+  /**
+   * @brief Writes everything as one JSON object.
+   */
+  std::string json() const;
+
+  Counters counters;
+  Histogram input_to_focus;
+  Histogram map_to_tile;
+
+private:
+  // Allocated the first time an event of the type is seen, as most of the
+  // 256 types never are.
+  std::array<std::unique_ptr<Histogram>, 256> events;
+  uint32_t batches = 0;
+  bool batch_sampled = true;
+  bool handler_timed = false;
+};
+
+#endif
@@ -0,0 +1,176 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <xcb/xcb.h>
+#include <xcb/xproto.h>
+
+#include "client.h"
+
+/**
+ * @brief The namespace which holds the trace files of recorded sessions.
+ *
+ * @details
+ * A trace is what the window manager took in during a session: every X
+ * event, the properties read when adopting each window and when refreshing
+ * them after a PropertyNotify, and where each batch was committed. Replaying
+ * it through a FakeBackend reproduces the session without the X server or
+ * the clients.
+ *
+ * The file starts with a Setup, after a magic number and a version. Then
+ * come the records, each a type byte, the time since the previous record in
+ * microseconds as a LEB128 varint, and a payload:
+ *
+ * - RECORD_EVENT: the 32 bytes of the event, as they came from the server.
+ * - RECORD_PROPERTIES: the window, whether it is override-redirect and
+ *   whether it was tiled, and its ClientProperties, strings and lists
+ *   prefixed by their length. Atoms are those of the recorded server, so the
+ *   tiled flag stands in for the window type.
+ * - RECORD_COMMIT: nothing.
+ * - RECORD_REFRESH: the window, the ClientProperties::Field flags that were
+ *   read again, and its ClientProperties as they were afterwards, encoded as
+ *   in RECORD_PROPERTIES.
+ *
+ * Numbers are in host byte order, as traces are replayed where they are
+ * recorded.
+ */
+namespace Trace {
+
+constexpr uint32_t MAGIC = 0x52544c48; // "HLTR"
+constexpr uint32_t VERSION = 2;
+
+/**
+ * @brief What the events of a trace refer to on the recorded server.
+ */
+struct Setup {
+  xcb_window_t root = XCB_NONE;
+  uint16_t width = 0, height = 0;
+  uint8_t shape_base = 0; // 0 if the server lacked SHAPE.
+  uint8_t randr_base = 0; // 0 if the server lacked RandR.
+};
+
+enum RecordType : uint8_t {
+  RECORD_EVENT = 1,
+  RECORD_PROPERTIES = 2,
+  RECORD_COMMIT = 3,
+  RECORD_REFRESH = 4,
+};
+
+/**
+ * @brief One record, as read back. Only the members of its type are set.
+ */
+struct Record {
+  RecordType type;
+  uint64_t time = 0; // Microseconds since the start of the recording.
+
+  xcb_generic_event_t event; // RECORD_EVENT, full_sequence excluded.
+
+  xcb_window_t window = XCB_NONE; // RECORD_PROPERTIES and RECORD_REFRESH.
+  bool override_redirect = false;
+  bool tiled = true;
+  uint8_t fields = 0; // RECORD_REFRESH.
+  ClientProperties props;
+};
+
+/**
+ * @class Recorder
+ *
+ * @brief Appends the records of a session to a trace file.
+ *
+ * @details
+ * Records are encoded into a buffer that is written out once it is large,
+ * so recording costs a copy per event and a write every few thousand.
+ */
+class Recorder {
+public:
+  /**
+   * @brief Creates the trace file and writes its header.
+   *
+   * @param path The file to create, or truncate.
+   * @param setup What the events refer to.
+   * @throw std::runtime_error if the file cannot be created.
+   */
+  Recorder(const std::string &path, const Setup &setup);
+
+  /**
+   * @brief Writes out what is buffered and closes the file.
+   */
+  ~Recorder();
+
+  Recorder(const Recorder &) = delete;
+  Recorder &operator=(const Recorder &) = delete;
+
+  void event(const xcb_generic_event_t *event);
+  void properties(xcb_window_t window, const ClientProperties &props,
+                  bool override_redirect, bool tiled);
+  void commit();
+  void refresh(xcb_window_t window, uint8_t fields,
+               const ClientProperties &props);
+
+private:
+  void begin(RecordType type);
+  void put(const void *data, size_t size);
+  void put_u32(uint32_t value) { put(&value, sizeof(value)); }
+  void put_str(const std::string &value);
+  void put_props(const ClientProperties &props, uint32_t flags);
+  void write_out();
+
+  std::FILE *file;
+  std::string buffer;
+  std::chrono::steady_clock::time_point last;
+};
+
+/**
+ * @class Player
+ *
+ * @brief Reads the records of a trace file back.
+ */
+class Player {
+public:
+  /**
+   * @brief Reads a whole trace file and its header.
+   *
+   * @param path The file to read.
+   * @throw std::runtime_error if the file cannot be read or is not a trace.
+   */
+  explicit Player(const std::string &path);
+
+  const Setup &setup() const { return header; }
+
+  /**
+   * @brief Reads the next record.
+   *
+   * @param record Where to store it.
+   * @return false at the end of the trace.
+   * @throw std::runtime_error if the trace is truncated or corrupt.
+   */
+  bool next(Record &record);
+
+  /**
+   * @brief Goes back to the first record.
+   */
+  void rewind();
+
+private:
+  void take(void *out, size_t size);
+  uint32_t take_u32() {
+    uint32_t value;
+    take(&value, sizeof(value));
+    return value;
+  }
+  std::string take_str();
+  uint32_t take_props(ClientProperties &props);
+
+  std::string data;
+  size_t start = 0; // Where the records begin.
+  size_t pos = 0;
+  uint64_t time = 0;
+  Setup header;
+};
+
+} // namespace Trace
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef WATCHER_H
+#define WATCHER_H
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <spdlog/spdlog.h>
+#include <string>
+#include <thread>
+
+#include "config.h"
+
+/**
+ * @class ConfigWatcher
+ *
+ * @brief Watches the config file and parses it again whenever it changes,
+ * or when asked to.
+ *
+ * @details
+ * A background thread waits on inotify for the file to be written, or to be
+ * replaced by a rename as most editors do, and parses it with loadConfig().
+ * request() makes it parse the file at once, for SIGHUP, which also works
+ * where the file cannot be watched. The X event loop is never blocked: the parsed config is parked until the
+ * main thread calls take(), and the thread only calls a notify function to
+ * wake the main thread up. A file that fails to parse is logged and
+ * ignored, so a typo never takes the running config away.
+ */
+class ConfigWatcher {
+public:
+  /**
+   * @brief Starts watching a config file.
+   *
+   * @param path The path of the config file.
+   * @param logger Where to report parse errors. Must be thread-safe.
+   * @param notify Called on the watcher thread after each successful parse.
+   * @throw std::runtime_error if the thread cannot be woken up. A file that
+   * cannot be watched is only logged, as request() still works.
+   */
+  ConfigWatcher(std::string path, std::shared_ptr<spdlog::logger> logger,
+                std::function<void()> notify);
+
+  /**
+   * @brief Stops the watcher thread and waits for it.
+   */
+  ~ConfigWatcher();
+
+  ConfigWatcher(const ConfigWatcher &) = delete;
+  ConfigWatcher &operator=(const ConfigWatcher &) = delete;
+
+  /**
+   * @brief Takes the most recently parsed config, if there is one that was
+   * not taken yet.
+   */
+  std::optional<Config> take();
+
+  /**
+   * @brief Asks the watcher thread to parse the file now. Returns at once.
+   */
+  void request();
+
+private:
+  void run();
+  void reload();
+
+  std::string path;
+  std::string name; // The file name within the watched directory.
+  std::shared_ptr<spdlog::logger> logger;
+  std::function<void()> notify;
+
+  int inotify_fd = -1; // -1 if the file is not watched.
+  int stop_fd = -1;    // An eventfd that tells the thread to exit.
+  int request_fd = -1; // An eventfd that asks the thread to parse the file.
+
+  std::mutex mutex;
+  std::optional<Config> pending; // Guarded by mutex.
+
+  std::thread thread;
+};
+
+#endif
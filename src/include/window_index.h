@@ -0,0 +1,100 @@
+#ifndef WINDOW_INDEX_H
+#define WINDOW_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <xcb/xproto.h>
+
+/**
+ * @class WindowIndex
+ *
+ * @brief Maps window IDs to 32-bit indices, without allocating once it has
+ * grown to the number of windows it holds.
+ *
+ * @details
+ * An open-addressing hash table with linear probing, at most half full.
+ * Removals use backward-shift deletion, so there are no tombstones and a
+ * table that holds as many windows as it did before never rehashes.
+ */
+class WindowIndex {
+public:
+  static constexpr uint32_t NOT_FOUND = UINT32_MAX;
+
+  /**
+   * @brief Finds the index of a window.
+   *
+   * @return The index, or NOT_FOUND.
+   */
+  uint32_t find(xcb_window_t window) const {
+    uint32_t bucket = lookup(window);
+    return bucket == NOT_FOUND ? NOT_FOUND : buckets[bucket].index;
+  }
+
+  bool contains(xcb_window_t window) const {
+    return lookup(window) != NOT_FOUND;
+  }
+
+  /**
+   * @brief Sets the index of a window, adding the window if it is not there.
+   *
+   * @param window The window ID, which must not be XCB_NONE.
+   * @param index The index.
+   */
+  void set(xcb_window_t window, uint32_t index);
+
+  /**
+   * @brief Removes a window.
+   *
+   * @return false if the window was not there.
+   */
+  bool erase(xcb_window_t window);
+
+  /**
+   * @brief Removes every window, keeping the table.
+   */
+  void clear();
+
+  size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+
+  /**
+   * @brief Calls f(window, index) for every window, in no particular order.
+   */
+  template <class F> void for_each(F &&f) const {
+    for (const Bucket &bucket : buckets) {
+      if (bucket.window != XCB_NONE) {
+        f(bucket.window, bucket.index);
+      }
+    }
+  }
+
+private:
+  /**
+   * @brief A bucket of the table. XCB_NONE marks an empty bucket.
+   */
+  struct Bucket {
+    xcb_window_t window = XCB_NONE;
+    uint32_t index = 0;
+  };
+
+  /**
+   * @brief Fibonacci hashing: window IDs of one client differ in their low
+   * bits, which the multiplication spreads over the high ones.
+   */
+  uint32_t home(xcb_window_t window) const {
+    return static_cast<uint32_t>((uint64_t(window) * 0x9E3779B97F4A7C15ull) >>
+                                 shift);
+  }
+
+  uint32_t mask() const { return static_cast<uint32_t>(buckets.size()) - 1; }
+
+  uint32_t lookup(xcb_window_t window) const;
+  void rehash(size_t capacity);
+
+  std::vector<Bucket> buckets; // A power of two, at most half full.
+  size_t count = 0;
+  unsigned shift = 64;
+};
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef WORKSPACE_H
+#define WORKSPACE_H
+
+#include <xcb/xproto.h>
+
+#include "client.h"
+#include "layout.h"
+
+/**
+ * @brief A workspace: a set of clients with a layout of their own.
+ *
+ * @details
+ * Only the clients of the current workspace are mapped. The layout of the
+ * other workspaces is kept as it was, so switching back to one finds every
+ * window where it was left and nothing has to be reconfigured.
+ *
+ * The tree holds the tiled clients whatever the kind of layout, and places
+ * them when the kind is dwindle. The other kinds place them with a
+ * Layout::Engine.
+ */
+struct Workspace {
+  ClientList windows;  // The clients, in mapping order.
+  ClientList history;  // The clients, most recently focused first.
+  Layout::Tree layout; // The tiles of the visible clients.
+  Layout::Kind kind = Layout::Kind::dwindle;
+  xcb_window_t raised = XCB_NONE; // The last window raised, for monocle.
+};
+
+#endif
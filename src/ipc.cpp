@@ -0,0 +1,203 @@
+#include "include/ipc.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+std::string Ipc::socket_path() {
+  if (const char *path = std::getenv("HELIOS_SOCKET"))
+    return path;
+
+  std::string display = std::getenv("DISPLAY") ? std::getenv("DISPLAY") : "";
+  for (auto &c : display) {
+    if (c == '/')
+      c = '_';
+  }
+
+  const char *dir = std::getenv("XDG_RUNTIME_DIR");
+  if (dir)
+    return std::string(dir) + "/helios" + display + ".sock";
+  return "/tmp/helios-" + std::to_string(getuid()) + display + ".sock";
+}
+
+std::string Ipc::json_string(std::string_view value) {
+  std::string out = "\"";
+  for (char c : value) {
+    switch (c) {
+    case '"':
+      out += "\\\"";
+      break;
+    case '\\':
+      out += "\\\\";
+      break;
+    case '\n':
+      out += "\\n";
+      break;
+    case '\t':
+      out += "\\t";
+      break;
+    default:
+      if (static_cast<unsigned char>(c) < 0x20) {
+        char escape[8];
+        std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+        out += escape;
+      } else {
+        out += c;
+      }
+    }
+  }
+  return out + "\"";
+}
+
+Ipc::Server::Server(EventLoop &loop, std::string path, Handler handler)
+    : loop(loop), path(std::move(path)), handler(std::move(handler)) {
+  sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  if (this->path.size() >= sizeof(addr.sun_path))
+    throw std::runtime_error("Socket path too long: " + this->path);
+  std::memcpy(addr.sun_path, this->path.c_str(), this->path.size() + 1);
+
+  listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (listen_fd < 0)
+    throw std::runtime_error("Unable to create the IPC socket");
+
+  // A socket file left behind by a crash would make bind() fail.
+  unlink(this->path.c_str());
+  // Anyone who can connect can run commands, so only the owner may.
+  if (bind(listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 ||
+      chmod(this->path.c_str(), 0600) < 0 || listen(listen_fd, 16) < 0) {
+    int error = errno;
+    close(listen_fd);
+    throw std::runtime_error("Unable to listen on " + this->path + ": " +
+                             std::strerror(error));
+  }
+
+  try {
+    loop.add(listen_fd, EPOLLIN, [this](uint32_t) { accept_all(); });
+  } catch (...) {
+    close(listen_fd);
+    unlink(this->path.c_str());
+    throw;
+  }
+}
+
+Ipc::Server::~Server() {
+  for (auto &[fd, connection] : connections) {
+    loop.remove(fd);
+    close(fd);
+  }
+  loop.remove(listen_fd);
+  close(listen_fd);
+  unlink(path.c_str());
+}
+
+void Ipc::Server::accept_all() {
+  int fd;
+  while ((fd = accept4(listen_fd, nullptr, nullptr,
+                       SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+    try {
+      loop.add(fd, EPOLLIN,
+               [this, fd](uint32_t events) { serve(fd, events); });
+    } catch (const std::exception &) {
+      close(fd);
+      continue;
+    }
+    connections[fd] = {};
+  }
+}
+
+void Ipc::Server::serve(int fd, uint32_t events) {
+  auto it = connections.find(fd);
+  if (it == connections.end())
+    return;
+  Connection &connection = it->second;
+
+  bool alive = true;
+  if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+    alive = read_from(fd, connection);
+  }
+  if (alive && !connection.out.empty()) {
+    alive = write_to(fd, connection);
+  }
+  if (!alive) {
+    drop(fd);
+    return;
+  }
+
+  // Only wait for the socket to become writable while replies are pending.
+  bool pending = !connection.out.empty();
+  if (pending != connection.writable_watched) {
+    loop.modify(fd, pending ? EPOLLIN | EPOLLOUT : EPOLLIN);
+    connection.writable_watched = pending;
+  }
+}
+
+void Ipc::Server::drop(int fd) {
+  loop.remove(fd);
+  close(fd);
+  connections.erase(fd);
+}
+
+/**
+ * Reads what the client sent and answers every complete request in it.
+ *
+ * @return false if the connection is closed or broke the protocol.
+ */
+bool Ipc::Server::read_from(int fd, Connection &connection) {
+  char buf[4096];
+  ssize_t n;
+  while ((n = read(fd, buf, sizeof(buf))) > 0) {
+    connection.in.append(buf, n);
+  }
+  bool closed = n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK);
+
+  size_t pos = 0;
+  while (connection.in.size() - pos >= sizeof(Header)) {
+    Header header;
+    std::memcpy(&header, connection.in.data() + pos, sizeof(header));
+    if (header.length > MAX_PAYLOAD)
+      return false;
+    if (connection.in.size() - pos - sizeof(Header) < header.length)
+      break;
+
+    std::string_view payload(connection.in.data() + pos + sizeof(Header),
+                             header.length);
+    std::string reply;
+    Status status = handler(header.type, header.flags, payload, reply);
+
+    Header out = {static_cast<uint32_t>(reply.size()), header.type, status};
+    connection.out.append(reinterpret_cast<const char *>(&out), sizeof(out));
+    connection.out += reply;
+    pos += sizeof(Header) + header.length;
+  }
+  connection.in.erase(0, pos);
+
+  // Replies still get out, as far as they can, to a client that only
+  // closed its writing end.
+  if (closed) {
+    write_to(fd, connection);
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Writes as much of the pending replies as the socket takes.
+ *
+ * @return false if the connection broke.
+ */
+bool Ipc::Server::write_to(int fd, Connection &connection) {
+  while (!connection.out.empty()) {
+    ssize_t n = send(fd, connection.out.data(),
+                     connection.out.size(), MSG_NOSIGNAL);
+    if (n < 0) {
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+    connection.out.erase(0, n);
+  }
+  return true;
+}
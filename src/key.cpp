@@ -0,0 +1,157 @@
+#include "include/key.h"
+#include <algorithm>
+#include <cstdlib>
+
+Keyboard::Keyboard(xcb_connection_t *conn, xcb_window_t root)
+    : conn(conn), root(root), syms(xcb_key_symbols_alloc(conn)),
+      pending_modmap(xcb_get_modifier_mapping(conn)), modmap_pending(true) {}
+
+Keyboard::~Keyboard() {
+  if (modmap_pending) {
+    xcb_discard_reply(conn, pending_modmap.sequence);
+  }
+  xcb_key_symbols_free(syms);
+}
+
+bool Keyboard::grab(uint16_t mods, xcb_keysym_t keysym) {
+  resolve_numlock();
+  grabs.push_back({mods, keysym, keycodes(keysym)});
+  apply(grabs.back(), true);
+  return !grabs.back().keycodes.empty();
+}
+
+void Keyboard::ungrab(uint16_t mods, xcb_keysym_t keysym) {
+  auto matches = [&](const Grab &grab) {
+    return grab.mods == mods && grab.keysym == keysym;
+  };
+  for (const auto &grab : grabs) {
+    if (matches(grab)) {
+      apply(grab, false);
+    }
+  }
+  grabs.erase(std::remove_if(grabs.begin(), grabs.end(), matches),
+              grabs.end());
+}
+
+void Keyboard::ungrab_all() {
+  for (const auto &grab : grabs) {
+    apply(grab, false);
+  }
+  grabs.clear();
+}
+
+bool Keyboard::refresh(xcb_mapping_notify_event_t *event) {
+  resolve_numlock();
+  if (event->request == XCB_MAPPING_MODIFIER) {
+    uint16_t mask = read_numlock(xcb_get_modifier_mapping(conn));
+    if (mask == numlock)
+      return false;
+
+    for (const auto &grab : grabs) {
+      apply(grab, false);
+    }
+    numlock = mask;
+    for (const auto &grab : grabs) {
+      apply(grab, true);
+    }
+    return false;
+  }
+
+  if (!xcb_refresh_keyboard_mapping(syms, event))
+    return false;
+
+  bool changed = false;
+  for (auto &grab : grabs) {
+    auto codes = keycodes(grab.keysym);
+    if (codes == grab.keycodes)
+      continue;
+
+    apply(grab, false);
+    grab.keycodes = std::move(codes);
+    apply(grab, true);
+    changed = true;
+  }
+  return changed;
+}
+
+std::vector<xcb_keycode_t> Keyboard::keycodes(xcb_keysym_t keysym) const {
+  std::vector<xcb_keycode_t> codes;
+  xcb_keycode_t *list = xcb_key_symbols_get_keycode(syms, keysym);
+  if (!list)
+    return codes;
+
+  for (auto *code = list; *code != XCB_NO_SYMBOL; ++code) {
+    codes.push_back(*code);
+  }
+  free(list);
+  return codes;
+}
+
+/**
+ * Grabs or ungrabs every keycode of a grab, once for each combination of
+ * Lock and Num Lock.
+ */
+void Keyboard::apply(const Grab &grab, bool enable) const {
+  const uint16_t locks[] = {0, XCB_MOD_MASK_LOCK, numlock,
+                            static_cast<uint16_t>(numlock | XCB_MOD_MASK_LOCK)};
+  size_t variants = numlock ? 4 : 2;
+
+  for (auto code : grab.keycodes) {
+    for (size_t i = 0; i < variants; ++i) {
+      uint16_t mods = grab.mods | locks[i];
+      if (enable) {
+        xcb_grab_key(conn, 1, root, mods, code, XCB_GRAB_MODE_ASYNC,
+                     XCB_GRAB_MODE_ASYNC);
+      } else {
+        xcb_ungrab_key(conn, code, root, mods);
+      }
+    }
+  }
+}
+
+/**
+ * Collects the modifier mapping requested by the constructor, the first time
+ * the Num Lock mask is needed.
+ */
+void Keyboard::resolve_numlock() {
+  if (!modmap_pending)
+    return;
+  modmap_pending = false;
+  numlock = read_numlock(pending_modmap);
+}
+
+/**
+ * Finds the modifier that Num Lock is bound to, 0 if it is not bound.
+ *
+ * The keyboard mapping needed to find the keycodes of Num Lock is waited for
+ * while the modifier mapping request is already on its way.
+ */
+uint16_t Keyboard::read_numlock(xcb_get_modifier_mapping_cookie_t cookie) const {
+  auto numlock_codes = keycodes(XK_Num_Lock);
+  if (numlock_codes.empty()) {
+    xcb_discard_reply(conn, cookie.sequence);
+    return 0;
+  }
+
+  auto *reply = xcb_get_modifier_mapping_reply(conn, cookie, nullptr);
+  if (!reply)
+    return 0;
+
+  uint16_t mask = 0;
+  auto *codes = xcb_get_modifier_mapping_keycodes(reply);
+  int per_modifier = reply->keycodes_per_modifier;
+
+  for (int mod = 0; mod < 8 && !mask; ++mod) {
+    for (int i = 0; i < per_modifier; ++i) {
+      auto code = codes[mod * per_modifier + i];
+      if (std::find(numlock_codes.begin(), numlock_codes.end(), code) !=
+          numlock_codes.end()) {
+        mask = 1 << mod;
+        break;
+      }
+    }
+  }
+
+  free(reply);
+  return mask;
+}
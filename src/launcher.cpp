@@ -0,0 +1,151 @@
+#include "include/launcher.h"
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <thread>
+
+extern char **environ;
+
+namespace {
+
+/**
+ * Joins an argument vector into one string, for the logs.
+ */
+std::string join(char *const argv[]) {
+  std::string command;
+  for (auto *arg = argv; *arg; ++arg) {
+    if (arg != argv)
+      command += ' ';
+    command += *arg;
+  }
+  return command;
+}
+
+double elapsed_ms(std::chrono::steady_clock::time_point since) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - since)
+      .count();
+}
+
+} // namespace
+
+/**
+ * Calls posix_spawnp() with the signal state a new program expects.
+ *
+ * @param error Set to the error of posix_spawnp(), 0 on success.
+ * @return The pid of the child, or -1.
+ */
+pid_t Launcher::launch(char *const argv[], int &error) const {
+  posix_spawnattr_t attr;
+  posix_spawnattr_init(&attr);
+
+  sigset_t empty, defaults;
+  sigemptyset(&empty);
+  sigemptyset(&defaults);
+  sigaddset(&defaults, SIGCHLD);
+  posix_spawnattr_setsigmask(&attr, &empty);
+  posix_spawnattr_setsigdefault(&attr, &defaults);
+  posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK |
+                                      POSIX_SPAWN_SETSIGDEF);
+
+  pid_t pid = -1;
+  error = posix_spawnp(&pid, argv[0], nullptr, &attr, argv, environ);
+  posix_spawnattr_destroy(&attr);
+  return error ? -1 : pid;
+}
+
+void Launcher::remember(pid_t pid, std::string command,
+                        std::chrono::steady_clock::time_point started) {
+  children[pid] = {std::move(command), started};
+}
+
+pid_t Launcher::spawn(char *const argv[]) {
+  auto started = std::chrono::steady_clock::now();
+  int error = 0;
+  pid_t pid = launch(argv, error);
+  if (pid < 0) {
+    logger->error("Unable to run {}: {}", join(argv), std::strerror(error));
+    return -1;
+  }
+
+  remember(pid, join(argv), started);
+  return pid;
+}
+
+pid_t Launcher::spawn(const std::string &command) {
+  std::string shell = "/bin/sh", flag = "-c", line = command;
+  char *argv[] = {shell.data(), flag.data(), line.data(), nullptr};
+
+  auto started = std::chrono::steady_clock::now();
+  int error = 0;
+  pid_t pid = launch(argv, error);
+  if (pid < 0) {
+    logger->error("Unable to run {}: {}", command, std::strerror(error));
+    return -1;
+  }
+
+  remember(pid, command, started);
+  return pid;
+}
+
+void Launcher::spawn_all(const std::vector<std::string> &commands) {
+  struct Launch {
+    pid_t pid = -1;
+    int error = 0;
+    std::chrono::steady_clock::time_point started;
+    double latency_ms = 0;
+  };
+  std::vector<Launch> launches(commands.size());
+  std::vector<std::thread> threads;
+  threads.reserve(commands.size());
+
+  for (size_t i = 0; i < commands.size(); ++i) {
+    threads.emplace_back([this, &commands, &launch = launches[i], i] {
+      std::string shell = "/bin/sh", flag = "-c", line = commands[i];
+      char *argv[] = {shell.data(), flag.data(), line.data(), nullptr};
+      launch.started = std::chrono::steady_clock::now();
+      launch.pid = this->launch(argv, launch.error);
+      launch.latency_ms = elapsed_ms(launch.started);
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  for (size_t i = 0; i < commands.size(); ++i) {
+    const Launch &launch = launches[i];
+    if (launch.pid < 0) {
+      logger->error("Unable to run {}: {}", commands[i],
+                    std::strerror(launch.error));
+      continue;
+    }
+    logger->info("Started {} (pid {}) in {:.3f} ms", commands[i], launch.pid,
+                 launch.latency_ms);
+    remember(launch.pid, commands[i], launch.started);
+  }
+}
+
+void Launcher::reap() {
+  // Signals coalesce, so one SIGCHLD may stand for many children.
+  int status;
+  pid_t pid;
+  while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+    auto it = children.find(pid);
+    std::string command = it == children.end() ? "?" : it->second.command;
+    double lifetime =
+        it == children.end() ? 0 : elapsed_ms(it->second.started) / 1000;
+
+    if (WIFEXITED(status)) {
+      logger->info("{} (pid {}) exited with {} after {:.1f} s", command, pid,
+                   WEXITSTATUS(status), lifetime);
+    } else if (WIFSIGNALED(status)) {
+      logger->info("{} (pid {}) killed by signal {} after {:.1f} s", command,
+                   pid, WTERMSIG(status), lifetime);
+    }
+    if (it != children.end()) {
+      children.erase(it);
+    }
+  }
+}
@@ -0,0 +1,371 @@
+#include "include/layout.h"
+#include <algorithm>
+
+namespace Layout {
+
+namespace {
+
+/**
+ * Whether the leaf (a_area, a_seq) should be split before (b_area, b_seq).
+ *
+ * The largest area wins and the oldest leaf wins ties. Leaves without a
+ * positive area are never preferred over one that has it, and among
+ * themselves the newest wins, like the old linear scan did.
+ */
+bool better(int64_t a_area, uint64_t a_seq, int64_t b_area, uint64_t b_seq) {
+  if ((a_area > 0) != (b_area > 0))
+    return a_area > 0;
+  if (a_area <= 0)
+    return a_seq > b_seq;
+  if (a_area != b_area)
+    return a_area > b_area;
+  return a_seq < b_seq;
+}
+
+/**
+ * The area inside the gap around it.
+ */
+Rect inset(const Rect &area, int gap) {
+  return {area.x + gap, area.y + gap, area.width - 2 * gap,
+          area.height - 2 * gap};
+}
+
+/**
+ * Splits a length into count parts with a gap between each, the last part
+ * taking what the division leaves over.
+ */
+void split(int start, int length, int gap, size_t count, size_t index,
+           int &out_start, int &out_length) {
+  int n = static_cast<int>(count), i = static_cast<int>(index);
+  int part = (length - (n - 1) * gap) / n;
+  out_start = start + i * (part + gap);
+  out_length = i == n - 1 ? start + length - out_start : part;
+}
+
+} // namespace
+
+bool parse_kind(const std::string &name, Kind &out) {
+  for (Kind kind :
+       {Kind::dwindle, Kind::master_stack, Kind::monocle, Kind::grid}) {
+    if (name == kind_name(kind)) {
+      out = kind;
+      return true;
+    }
+  }
+  return false;
+}
+
+const char *kind_name(Kind kind) {
+  switch (kind) {
+  case Kind::dwindle:
+    return "dwindle";
+  case Kind::master_stack:
+    return "master-stack";
+  case Kind::monocle:
+    return "monocle";
+  case Kind::grid:
+    return "grid";
+  }
+  return "dwindle";
+}
+
+/**
+ * The first window takes the left half, and the others share the right half
+ * from top to bottom.
+ */
+void Engine<Kind::master_stack>::arrange(const Rect &area, int gap,
+                                         size_t count, Rect *out) {
+  if (count == 0)
+    return;
+
+  Rect inner = inset(area, gap);
+  if (count == 1) {
+    out[0] = inner;
+    return;
+  }
+
+  Rect &master = out[0];
+  master = inner;
+  master.width = (inner.width - gap) / 2;
+
+  int stack_x = inner.x + master.width + gap;
+  int stack_width = inner.x + inner.width - stack_x;
+  for (size_t i = 1; i < count; ++i) {
+    Rect &tile = out[i];
+    tile.x = stack_x;
+    tile.width = stack_width;
+    split(inner.y, inner.height, gap, count - 1, i - 1, tile.y, tile.height);
+  }
+}
+
+void Engine<Kind::monocle>::arrange(const Rect &area, int gap, size_t count,
+                                    Rect *out) {
+  std::fill(out, out + count, inset(area, gap));
+}
+
+/**
+ * As many columns as the square root of the count rounded up, and as many
+ * rows as needed to hold them all. The windows of the last row share its
+ * width.
+ */
+void Engine<Kind::grid>::arrange(const Rect &area, int gap, size_t count,
+                                 Rect *out) {
+  if (count == 0)
+    return;
+
+  Rect inner = inset(area, gap);
+  size_t columns = 1;
+  while (columns * columns < count) {
+    ++columns;
+  }
+  size_t rows = (count + columns - 1) / columns;
+
+  for (size_t i = 0; i < count; ++i) {
+    size_t row = i / columns, column = i % columns;
+    size_t in_row = row == rows - 1 ? count - row * columns : columns;
+    Rect &tile = out[i];
+    split(inner.x, inner.width, gap, in_row, column, tile.x, tile.width);
+    split(inner.y, inner.height, gap, rows, row, tile.y, tile.height);
+  }
+}
+
+void Tree::set_area(Rect new_area, int new_gap) {
+  if (new_area == area && new_gap == gap)
+    return;
+
+  if (root != NIL)
+    remember();
+  area = new_area;
+  gap = new_gap;
+  if (root != NIL && !recall())
+    assign(root, root_rect());
+}
+
+/**
+ * Keeps the current layout in the memo slot used longest ago, unless it is
+ * already kept.
+ */
+void Tree::remember() {
+  Memo *slot = &memos[0];
+  for (auto &memo : memos) {
+    if (memo.shape == shape && memo.area == area && memo.gap == gap) {
+      memo.used = ++memo_clock;
+      return;
+    }
+    if (memo.used < slot->used)
+      slot = &memo;
+  }
+
+  slot->area = area;
+  slot->gap = gap;
+  slot->shape = shape;
+  slot->used = ++memo_clock;
+  slot->nodes = nodes;
+}
+
+/**
+ * Restores the layout of the current area and gap if it is kept, marking
+ * the leaves it moves.
+ *
+ * @return false if it is not kept.
+ */
+bool Tree::recall() {
+  for (auto &memo : memos) {
+    if (memo.shape != shape || memo.area != area || memo.gap != gap)
+      continue;
+
+    memo.used = ++memo_clock;
+    ++memo_counts.hits;
+    // Nodes past those kept were allocated since, and are free again.
+    for (uint32_t idx = 0; idx < memo.nodes.size(); ++idx) {
+      Node &node = nodes[idx];
+      const Node &kept = memo.nodes[idx];
+      if (node.window != XCB_NONE && node.rect != kept.rect)
+        mark(idx);
+      node.rect = kept.rect;
+      node.best_area = kept.best_area;
+      node.best_seq = kept.best_seq;
+      node.best_leaf = kept.best_leaf;
+    }
+    return true;
+  }
+
+  ++memo_counts.misses;
+  return false;
+}
+
+void Tree::insert(xcb_window_t window) {
+  if (contains(window))
+    return;
+
+  bool split_horizontal = leaves.size() % 2 == 0;
+  last_insert = window;
+  shape_before_insert = shape;
+  shape = ++shape_clock;
+
+  uint32_t leaf = alloc_node();
+  nodes[leaf].window = window;
+  nodes[leaf].seq = next_seq++;
+  leaves.set(window, leaf);
+  mark(leaf);
+
+  if (root == NIL) {
+    root = leaf;
+    assign(leaf, root_rect());
+    return;
+  }
+
+  uint32_t target = nodes[root].best_leaf;
+  uint32_t inner = alloc_node();
+  uint32_t parent = nodes[target].parent;
+
+  nodes[inner].parent = parent;
+  nodes[inner].split_horizontal = split_horizontal;
+  nodes[inner].child[0] = target;
+  nodes[inner].child[1] = leaf;
+
+  if (parent == NIL) {
+    root = inner;
+  } else {
+    Node &p = nodes[parent];
+    p.child[p.child[0] == target ? 0 : 1] = inner;
+  }
+  nodes[target].parent = inner;
+  nodes[leaf].parent = inner;
+
+  assign(inner, nodes[target].rect);
+  update_path(parent);
+}
+
+void Tree::remove(xcb_window_t window) {
+  uint32_t leaf = leaves.find(window);
+  if (leaf == WindowIndex::NOT_FOUND)
+    return;
+
+  leaves.erase(window);
+  // Undoing the last insertion puts every other node back where it was.
+  shape = window == last_insert ? shape_before_insert : ++shape_clock;
+  last_insert = XCB_NONE;
+
+  uint32_t parent = nodes[leaf].parent;
+  free_node(leaf);
+
+  if (parent == NIL) {
+    root = NIL;
+    return;
+  }
+
+  const Node &p = nodes[parent];
+  uint32_t sibling = p.child[p.child[0] == leaf ? 1 : 0];
+  uint32_t grand = p.parent;
+  Rect rect = p.rect;
+
+  nodes[sibling].parent = grand;
+  if (grand == NIL) {
+    root = sibling;
+  } else {
+    Node &g = nodes[grand];
+    g.child[g.child[0] == parent ? 0 : 1] = sibling;
+  }
+  free_node(parent);
+
+  assign(sibling, rect);
+  update_path(grand);
+}
+
+uint32_t Tree::alloc_node() {
+  if (free_nodes.empty()) {
+    nodes.emplace_back();
+    return nodes.size() - 1;
+  }
+
+  uint32_t idx = free_nodes.back();
+  free_nodes.pop_back();
+  bool queued = nodes[idx].changed;
+  nodes[idx] = Node{};
+  nodes[idx].changed = queued;
+  return idx;
+}
+
+/**
+ * A freed node stays queued in `changed` if it was, so that reusing it
+ * before the next take_changes() does not queue it a second time.
+ */
+void Tree::free_node(uint32_t idx) {
+  nodes[idx].window = XCB_NONE;
+  free_nodes.push_back(idx);
+}
+
+void Tree::mark(uint32_t idx) {
+  if (!nodes[idx].changed) {
+    nodes[idx].changed = true;
+    changed.push_back(idx);
+  }
+}
+
+/**
+ * Gives a node a new rectangle and lays its subtree out inside it, marking
+ * every leaf whose rectangle actually moved.
+ */
+void Tree::assign(uint32_t idx, Rect rect) {
+  Node &node = nodes[idx];
+
+  if (node.window != XCB_NONE) {
+    if (node.rect != rect) {
+      node.rect = rect;
+      mark(idx);
+    }
+    update_best(idx);
+    return;
+  }
+
+  node.rect = rect;
+
+  Rect first = rect, second = rect;
+  if (node.split_horizontal) {
+    first.height = (rect.height - gap) / 2;
+    second.y = rect.y + first.height + gap;
+    second.height = rect.height - first.height - gap;
+  } else {
+    first.width = (rect.width - gap) / 2;
+    second.x = rect.x + first.width + gap;
+    second.width = rect.width - first.width - gap;
+  }
+
+  uint32_t c0 = node.child[0], c1 = node.child[1];
+  assign(c0, first);
+  assign(c1, second);
+  update_best(idx);
+}
+
+void Tree::mark_all() {
+  leaves.for_each([this](xcb_window_t, uint32_t leaf) { mark(leaf); });
+}
+
+void Tree::update_best(uint32_t idx) {
+  Node &node = nodes[idx];
+
+  if (node.window != XCB_NONE) {
+    node.best_area = int64_t(node.rect.width) * node.rect.height;
+    node.best_seq = node.seq;
+    node.best_leaf = idx;
+    return;
+  }
+
+  const Node &a = nodes[node.child[0]];
+  const Node &b = nodes[node.child[1]];
+  const Node &best =
+      better(b.best_area, b.best_seq, a.best_area, a.best_seq) ? b : a;
+  node.best_area = best.best_area;
+  node.best_seq = best.best_seq;
+  node.best_leaf = best.best_leaf;
+}
+
+void Tree::update_path(uint32_t idx) {
+  for (; idx != NIL; idx = nodes[idx].parent)
+    update_best(idx);
+}
+
+Rect Tree::root_rect() const { return inset(area, gap); }
+
+} // namespace Layout
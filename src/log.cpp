@@ -0,0 +1,235 @@
+#include "include/log.h"
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <spdlog/pattern_formatter.h>
+
+namespace {
+
+/**
+ * How long the writer sleeps when the ring is empty. Errors wake it at once,
+ * anything else waits at most this long to reach the file.
+ */
+constexpr auto IDLE_WAIT = std::chrono::milliseconds(20);
+
+size_t round_up_pow2(size_t n) {
+  size_t p = 2;
+  while (p < n) {
+    p <<= 1;
+  }
+  return p;
+}
+
+} // namespace
+
+RingSink::RingSink(std::string name, const std::string &filename,
+                   size_t capacity)
+    : slots(round_up_pow2(capacity)), mask(slots.size() - 1),
+      formatter(std::make_unique<spdlog::pattern_formatter>()),
+      name(std::move(name)) {
+  for (size_t i = 0; i < slots.size(); ++i) {
+    slots[i].seq.store(i, std::memory_order_relaxed);
+  }
+
+  file = std::fopen(filename.c_str(), "a");
+  if (!file) {
+    throw spdlog::spdlog_ex("Unable to open " + filename, errno);
+  }
+
+  writer = std::thread(&RingSink::run, this);
+}
+
+RingSink::~RingSink() {
+  stopping.store(true);
+  wake.notify_one();
+  writer.join();
+  std::fclose(file);
+}
+
+/**
+ * Claims the next slot and copies the message into it. Never blocks: if the
+ * writer is a whole ring behind, the message is counted and dropped.
+ */
+void RingSink::log(const spdlog::details::log_msg &msg) {
+  size_t pos = head.load(std::memory_order_relaxed);
+  Slot *slot;
+
+  for (;;) {
+    slot = &slots[pos & mask];
+    size_t seq = slot->seq.load(std::memory_order_acquire);
+    auto diff = static_cast<std::ptrdiff_t>(seq - pos);
+    if (diff == 0) {
+      if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+        break;
+    } else if (diff < 0) {
+      lost.fetch_add(1, std::memory_order_relaxed);
+      total_dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    } else {
+      pos = head.load(std::memory_order_relaxed);
+    }
+  }
+
+  slot->time = msg.time;
+  slot->thread_id = msg.thread_id;
+  slot->level = msg.level;
+  slot->length =
+      static_cast<uint16_t>(std::min(msg.payload.size(), TEXT_SIZE));
+  std::memcpy(slot->text, msg.payload.data(), slot->length);
+  slot->seq.store(pos + 1, std::memory_order_release);
+
+  // Errors should reach the file at once, and a burst must not fill the
+  // ring while the writer sleeps.
+  if (msg.level >= spdlog::level::err || (pos & (mask >> 1)) == 0) {
+    wake.notify_one();
+  }
+}
+
+void RingSink::flush() { wake.notify_one(); }
+
+void RingSink::set_pattern(const std::string &pattern) {
+  set_formatter(std::make_unique<spdlog::pattern_formatter>(pattern));
+}
+
+void RingSink::set_formatter(std::unique_ptr<spdlog::formatter> next) {
+  std::lock_guard<std::mutex> lock(formatter_mutex);
+  formatter = std::move(next);
+}
+
+void RingSink::run() {
+  // Signals are for the event loop, which reads them from a signalfd.
+  sigset_t all;
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, nullptr);
+
+  spdlog::memory_buf_t out;
+
+  for (;;) {
+    bool stop = stopping.load();
+    bool busy = drain(out);
+
+    if (!busy) {
+      end_repeats(out);
+      if (out.size()) {
+        std::fwrite(out.data(), 1, out.size(), file);
+        out.clear();
+      }
+      std::fflush(file);
+      if (stop)
+        return;
+
+      std::unique_lock<std::mutex> lock(wake_mutex);
+      wake.wait_for(lock, IDLE_WAIT);
+    } else if (out.size() > 64 * 1024) {
+      std::fwrite(out.data(), 1, out.size(), file);
+      out.clear();
+    }
+  }
+}
+
+/**
+ * Formats the messages waiting in the ring into out.
+ *
+ * @return false if the ring was empty.
+ */
+bool RingSink::drain(spdlog::memory_buf_t &out) {
+  bool any = false;
+
+  if (size_t n = lost.exchange(0)) {
+    write_note(spdlog::level::warn,
+               std::to_string(n) + " log messages dropped, the ring was full",
+               out);
+  }
+
+  for (;;) {
+    Slot &slot = slots[tail & mask];
+    if (slot.seq.load(std::memory_order_acquire) != tail + 1)
+      break;
+
+    write(slot, out);
+    slot.seq.store(tail + mask + 1, std::memory_order_release);
+    ++tail;
+    any = true;
+  }
+  return any;
+}
+
+void RingSink::write(const Slot &slot, spdlog::memory_buf_t &out) {
+  spdlog::string_view_t text(slot.text, slot.length);
+
+  if (slot.level == last_level && text == spdlog::string_view_t(last_text)) {
+    ++repeats;
+    return;
+  }
+  end_repeats(out);
+  last_level = slot.level;
+  last_text.assign(text.data(), text.size());
+
+  spdlog::details::log_msg msg(slot.time, spdlog::source_loc{}, name,
+                               slot.level, text);
+  msg.thread_id = slot.thread_id;
+  std::lock_guard<std::mutex> lock(formatter_mutex);
+  formatter->format(msg, out);
+}
+
+void RingSink::write_note(spdlog::level::level_enum level,
+                          const std::string &text, spdlog::memory_buf_t &out) {
+  end_repeats(out);
+  spdlog::details::log_msg msg(spdlog::log_clock::now(), spdlog::source_loc{},
+                               name, level, text);
+  std::lock_guard<std::mutex> lock(formatter_mutex);
+  formatter->format(msg, out);
+}
+
+/**
+ * Writes how many times the last message was repeated, if it was.
+ */
+void RingSink::end_repeats(spdlog::memory_buf_t &out) {
+  if (!repeats)
+    return;
+  size_t count = repeats;
+  repeats = 0;
+
+  std::string text = "last message repeated " + std::to_string(count) + " times";
+  spdlog::details::log_msg msg(spdlog::log_clock::now(), spdlog::source_loc{},
+                               name, last_level, text);
+  std::lock_guard<std::mutex> lock(formatter_mutex);
+  formatter->format(msg, out);
+  last_level = spdlog::level::off;
+}
+
+std::shared_ptr<spdlog::logger> make_async_logger(const std::string &name,
+                                                  const std::string &filename,
+                                                  size_t capacity) {
+  auto sink = std::make_shared<RingSink>(name, filename, capacity);
+  auto logger = std::make_shared<spdlog::logger>(name, std::move(sink));
+  spdlog::register_logger(logger);
+  return logger;
+}
+
+spdlog::level::level_enum cycle_log_level(spdlog::logger &logger) {
+  using namespace spdlog::level;
+  level_enum next;
+
+  switch (logger.level()) {
+  case info:
+    next = debug;
+    break;
+  case debug:
+    next = trace;
+    break;
+  case trace:
+    next = warn;
+    break;
+  case warn:
+    next = err;
+    break;
+  default:
+    next = info;
+    break;
+  }
+
+  logger.set_level(next);
+  return next;
+}
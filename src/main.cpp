@@ -1,17 +1,37 @@
 #include "include/helios.h"
+#include <cstring>
 #include <spdlog/sinks/basic_file_sink.h>
 /**
  * @brief The main entry point of the application.
  *
- * Sets up a logger and starts the WindowManager.
+ * Sets up a logger and runs the WindowManager until it is told to stop. With
+ * --bench-startup, the time from here to the first MapRequest being handled
+ * is printed. With --record FILE, the session is recorded into a trace for
+ * helios-replay.
  *
- * @return 0 on success.
+ * @return 0 on success, 1 if the window manager could not start.
  */
-int main() {
+int main(int argc, char **argv) {
+  auto start = std::chrono::steady_clock::now();
+
   auto logger = spdlog::basic_logger_mt("Log", "logs.txt");
   logger->info("Stopped!");
-  WindowManager* WM = new WindowManager();
-  WM->run();
+
+  try {
+    // On the stack, so that the destructor runs once run() returns.
+    WindowManager WM;
+    for (int i = 1; i < argc; ++i) {
+      if (std::strcmp(argv[i], "--bench-startup") == 0) {
+        WM.bench_startup(start);
+      } else if (std::strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+        WM.record(argv[++i]);
+      }
+    }
+    WM.run();
+  } catch (const std::exception &e) {
+    std::fprintf(stderr, "helios: %s\n", e.what());
+    return 1;
+  }
 
   return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,320 @@
+#include "include/ipc.h"
+#include "include/stats.h"
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+void usage() {
+  std::fprintf(
+      stderr,
+      "Usage: helios-msg [--json] COMMAND\n"
+      "       helios-msg --bench N [clients|layout|log-level]\n"
+      "\n"
+      "Commands:\n"
+      "  spawn COMMAND...   Runs a command through /bin/sh.\n"
+      "  focus next|prev|CLASS\n"
+      "                     Moves the focus.\n"
+      "  close              Closes the focused window.\n"
+      "  workspace N        Switches to workspace N.\n"
+      "  toggle CLASS       Hides or shows a window.\n"
+      "  clients            Lists the managed windows.\n"
+      "  layout             Describes the current workspace.\n"
+      "  log-level          Cycles the log level.\n"
+      "\n"
+      "The socket is $HELIOS_SOCKET, or found from $DISPLAY.\n");
+}
+
+int connect_to(const std::string &path) {
+  sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    std::fprintf(stderr, "helios-msg: socket path too long: %s\n",
+                 path.c_str());
+    return -1;
+  }
+  std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0 ||
+      connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
+    std::fprintf(stderr, "helios-msg: unable to connect to %s: %s\n",
+                 path.c_str(), std::strerror(errno));
+    if (fd >= 0)
+      close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+bool write_all(int fd, const char *data, size_t size) {
+  while (size) {
+    ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+bool read_all(int fd, char *data, size_t size) {
+  while (size) {
+    ssize_t n = read(fd, data, size);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+/**
+ * Sends a request and waits for its reply.
+ *
+ * @return false if the connection broke.
+ */
+bool request(int fd, uint16_t type, uint16_t flags, const std::string &payload,
+             Ipc::Header &header, std::string &reply) {
+  Ipc::Header out = {static_cast<uint32_t>(payload.size()), type, flags};
+  std::string message(reinterpret_cast<const char *>(&out), sizeof(out));
+  message += payload;
+  if (!write_all(fd, message.data(), message.size()) ||
+      !read_all(fd, reinterpret_cast<char *>(&header), sizeof(header)) ||
+      header.length > Ipc::MAX_PAYLOAD)
+    return false;
+
+  reply.resize(header.length);
+  return read_all(fd, reply.data(), reply.size());
+}
+
+void print_clients(Ipc::Reader &in) {
+  uint32_t count = in.u32();
+  std::printf("%-10s %-3s %-21s %-5s %-20s %-20s %s\n", "WINDOW", "WS",
+              "GEOMETRY", "FLAGS", "INSTANCE", "CLASS", "TITLE");
+  for (uint32_t i = 0; i < count && in.ok(); ++i) {
+    uint32_t window = in.u32(), workspace = in.u32();
+    auto x = static_cast<int32_t>(in.u32()), y = static_cast<int32_t>(in.u32());
+    uint32_t width = in.u32(), height = in.u32(), flags = in.u32();
+    std::string instance = in.str(), class_name = in.str(), title = in.str();
+
+    char geometry[32];
+    std::snprintf(geometry, sizeof(geometry), "%" PRIu32 "x%" PRIu32 "%+d%+d",
+                  width, height, x, y);
+    char marks[4] = {flags & Ipc::CLIENT_FOCUSED ? '*' : '-',
+                     flags & Ipc::CLIENT_TILED ? 't' : '-',
+                     flags & Ipc::CLIENT_URGENT ? '!' : '-', '\0'};
+    std::printf("0x%08" PRIx32 " %-3" PRIu32 " %-21s %-5s %-20s %-20s %s\n",
+                window, workspace, geometry, marks, instance.c_str(),
+                class_name.c_str(), title.c_str());
+  }
+}
+
+void print_layout(Ipc::Reader &in) {
+  uint32_t workspace = in.u32();
+  std::string layout = in.str();
+  uint32_t focused = in.u32(), count = in.u32();
+  std::printf("workspace %" PRIu32 " (%s), focus 0x%08" PRIx32 "\n",
+              workspace, layout.c_str(), focused);
+  for (uint32_t i = 0; i < count && in.ok(); ++i) {
+    uint32_t window = in.u32();
+    auto x = static_cast<int32_t>(in.u32()), y = static_cast<int32_t>(in.u32());
+    uint32_t width = in.u32(), height = in.u32();
+    std::printf("0x%08" PRIx32 " %" PRIu32 "x%" PRIu32 "%+d%+d\n", window,
+                width, height, x, y);
+  }
+}
+
+/**
+ * Prints a reply, decoding the binary layout of the request it answers.
+ *
+ * @return false if the reply is malformed.
+ */
+bool print_reply(const Ipc::Header &header, const std::string &reply,
+                 bool json) {
+  if (json) {
+    if (!reply.empty())
+      std::printf("%s\n", reply.c_str());
+    return true;
+  }
+
+  Ipc::Reader in(reply);
+  switch (header.type) {
+  case Ipc::REQUEST_CLIENTS:
+    print_clients(in);
+    break;
+  case Ipc::REQUEST_LAYOUT:
+    print_layout(in);
+    break;
+  case Ipc::REQUEST_LOG_LEVEL:
+    std::printf("%s\n", in.str().c_str());
+    break;
+  default:
+    break;
+  }
+  return in.ok();
+}
+
+/**
+ * Turns the command line into a request.
+ *
+ * @return false if the command is unknown or misses arguments.
+ */
+bool parse_command(int argc, char **argv, uint16_t &type,
+                   std::string &payload) {
+  if (argc < 1)
+    return false;
+  std::string command = argv[0];
+
+  auto action = [&](const char *name, std::string target) {
+    Ipc::Writer out;
+    out.str(name);
+    out.str(target);
+    type = Ipc::REQUEST_ACTION;
+    payload = std::move(out.data());
+    return true;
+  };
+
+  if (command == "spawn" && argc >= 2) {
+    std::string line = argv[1];
+    for (int i = 2; i < argc; ++i) {
+      line += ' ';
+      line += argv[i];
+    }
+    return action("run", line);
+  }
+  if (command == "focus" && argc == 2)
+    return action("focus", argv[1]);
+  if (command == "close" && argc == 1)
+    return action("close", "");
+  if (command == "workspace" && argc == 2)
+    return action("ch", argv[1]);
+  if (command == "toggle" && argc == 2)
+    return action("toggle", argv[1]);
+
+  if (argc != 1)
+    return false;
+  if (command == "clients") {
+    type = Ipc::REQUEST_CLIENTS;
+  } else if (command == "layout") {
+    type = Ipc::REQUEST_LAYOUT;
+  } else if (command == "log-level") {
+    type = Ipc::REQUEST_LOG_LEVEL;
+  } else {
+    return false;
+  }
+  payload.clear();
+  return true;
+}
+
+/**
+ * Sends the same query many times over one connection and prints the
+ * distribution of the round trip times.
+ */
+int bench(int fd, unsigned long iterations, uint16_t type) {
+  Histogram histogram;
+  Ipc::Header header;
+  std::string reply;
+
+  for (unsigned long i = 0; i < iterations; ++i) {
+    auto start = Stats::now();
+    if (!request(fd, type, 0, "", header, reply)) {
+      std::fprintf(stderr, "helios-msg: connection lost\n");
+      return 1;
+    }
+    Stats::record_since(histogram, start);
+  }
+
+  std::printf("%" PRIu64 " requests, round trip in ns: min=%" PRIu64
+              " mean=%.0f p50=%" PRIu64 " p90=%" PRIu64 " p99=%" PRIu64
+              " max=%" PRIu64 "\n",
+              histogram.count(), histogram.min(), histogram.mean(),
+              histogram.percentile(50), histogram.percentile(90),
+              histogram.percentile(99), histogram.max());
+  return 0;
+}
+
+} // namespace
+
+/**
+ * @brief The entry point of helios-msg.
+ *
+ * @return 0 on success, 1 if the request failed, 2 on a usage error.
+ */
+int main(int argc, char **argv) {
+  uint16_t flags = 0;
+  unsigned long iterations = 0;
+
+  int i = 1;
+  for (; i < argc && argv[i][0] == '-'; ++i) {
+    if (std::strcmp(argv[i], "--json") == 0) {
+      flags |= Ipc::FLAG_JSON;
+    } else if (std::strcmp(argv[i], "--bench") == 0 && i + 1 < argc) {
+      char *end = nullptr;
+      iterations = std::strtoul(argv[++i], &end, 10);
+      if (*end != '\0' || iterations == 0) {
+        usage();
+        return 2;
+      }
+    } else {
+      usage();
+      return 2;
+    }
+  }
+
+  uint16_t type = Ipc::REQUEST_CLIENTS;
+  std::string payload;
+  if (iterations && i == argc) {
+    // Benchmarks query the client list unless told otherwise.
+  } else if (!parse_command(argc - i, argv + i, type, payload) ||
+             (iterations && type == Ipc::REQUEST_ACTION)) {
+    usage();
+    return 2;
+  }
+
+  int fd = connect_to(Ipc::socket_path());
+  if (fd < 0)
+    return 1;
+
+  if (iterations) {
+    int status = bench(fd, iterations, type);
+    close(fd);
+    return status;
+  }
+
+  Ipc::Header header;
+  std::string reply;
+  if (!request(fd, type, flags, payload, header, reply)) {
+    std::fprintf(stderr, "helios-msg: connection lost\n");
+    close(fd);
+    return 1;
+  }
+  close(fd);
+
+  switch (header.flags) {
+  case Ipc::STATUS_OK:
+    break;
+  case Ipc::STATUS_INVALID:
+    std::fprintf(stderr, "helios-msg: invalid arguments\n");
+    return 1;
+  default:
+    std::fprintf(stderr, "helios-msg: request not supported\n");
+    return 1;
+  }
+
+  if (!print_reply(header, reply, flags & Ipc::FLAG_JSON)) {
+    std::fprintf(stderr, "helios-msg: malformed reply\n");
+    return 1;
+  }
+  return 0;
+}
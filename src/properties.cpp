@@ -0,0 +1,266 @@
+#include "include/properties.h"
+#include <cstdlib>
+
+namespace Properties {
+
+namespace {
+
+// Sizes, in 32-bit words, of the WM_HINTS and WM_SIZE_HINTS structures.
+constexpr uint32_t WM_HINTS_LENGTH = 9;
+constexpr uint32_t WM_SIZE_HINTS_LENGTH = 18;
+
+// How much of a title is read, in 32-bit words.
+constexpr uint32_t TITLE_LENGTH = 256;
+
+// Flags of WM_HINTS and WM_SIZE_HINTS, from the ICCCM.
+constexpr uint32_t HINT_INPUT = 1 << 0;
+constexpr uint32_t HINT_URGENCY = 1 << 8;
+constexpr uint32_t SIZE_HINT_MIN = 1 << 4;
+constexpr uint32_t SIZE_HINT_MAX = 1 << 5;
+
+/**
+ * Waits for a GetProperty reply, dropping any error. The caller owns the
+ * returned reply, which is nullptr on error.
+ */
+xcb_get_property_reply_t *property_reply(xcb_connection_t *conn,
+                                         xcb_get_property_cookie_t cookie) {
+  xcb_generic_error_t *error = nullptr;
+  auto *reply = xcb_get_property_reply(conn, cookie, &error);
+  free(error);
+  return reply;
+}
+
+void parse_title(xcb_get_property_reply_t *reply, std::string &title) {
+  auto *data = static_cast<const char *>(xcb_get_property_value(reply));
+  int length = xcb_get_property_value_length(reply);
+  while (length > 0 && data[length - 1] == '\0')
+    --length;
+  title.assign(data, length);
+}
+
+void parse_wm_class(xcb_get_property_reply_t *reply, ClientProperties &props) {
+  auto *data = static_cast<const char *>(xcb_get_property_value(reply));
+  int length = xcb_get_property_value_length(reply);
+
+  // WM_CLASS is two consecutive NUL-terminated strings.
+  int split = 0;
+  while (split < length && data[split] != '\0')
+    ++split;
+  props.instance.assign(data, split);
+  if (split + 1 < length) {
+    const char *second = data + split + 1;
+    int rest = length - split - 1;
+    while (rest > 0 && second[rest - 1] == '\0')
+      --rest;
+    props.class_name.assign(second, rest);
+  }
+}
+
+void parse_hints(xcb_get_property_reply_t *reply, ClientProperties &props) {
+  if (xcb_get_property_value_length(reply) <
+      int(WM_HINTS_LENGTH * sizeof(uint32_t)))
+    return;
+
+  auto *hints = static_cast<const uint32_t *>(xcb_get_property_value(reply));
+  if (hints[0] & HINT_INPUT)
+    props.input = hints[1] != 0;
+  props.urgent = hints[0] & HINT_URGENCY;
+}
+
+void parse_normal_hints(xcb_get_property_reply_t *reply,
+                        ClientProperties &props) {
+  if (xcb_get_property_value_length(reply) <
+      int(WM_SIZE_HINTS_LENGTH * sizeof(uint32_t)))
+    return;
+
+  auto *hints = static_cast<const int32_t *>(xcb_get_property_value(reply));
+  auto flags = static_cast<uint32_t>(hints[0]);
+  if (flags & SIZE_HINT_MIN) {
+    props.min_width = hints[5];
+    props.min_height = hints[6];
+  }
+  if (flags & SIZE_HINT_MAX) {
+    props.max_width = hints[7];
+    props.max_height = hints[8];
+  }
+}
+
+} // namespace
+
+Cookies request(xcb_ewmh_connection_t *ewmh, xcb_window_t window) {
+  Cookies cookies = request(ewmh, window, ClientProperties::FIELD_ALL);
+  cookies.attributes = xcb_get_window_attributes(ewmh->connection, window);
+  return cookies;
+}
+
+Cookies request(xcb_ewmh_connection_t *ewmh, xcb_window_t window,
+                uint8_t fields) {
+  xcb_connection_t *conn = ewmh->connection;
+
+  Cookies cookies;
+  cookies.fields = fields;
+  if (fields & ClientProperties::FIELD_TITLE) {
+    cookies.name = xcb_get_property(conn, 0, window, ewmh->_NET_WM_NAME,
+                                    ewmh->UTF8_STRING, 0, TITLE_LENGTH);
+    cookies.legacy_name =
+        xcb_get_property(conn, 0, window, XCB_ATOM_WM_NAME,
+                         XCB_GET_PROPERTY_TYPE_ANY, 0, TITLE_LENGTH);
+  }
+  if (fields & ClientProperties::FIELD_CLASS) {
+    cookies.wm_class = xcb_get_property(conn, 0, window, XCB_ATOM_WM_CLASS,
+                                        XCB_ATOM_STRING, 0, 256);
+  }
+  if (fields & ClientProperties::FIELD_TYPE) {
+    cookies.window_type = xcb_ewmh_get_wm_window_type(ewmh, window);
+  }
+  if (fields & ClientProperties::FIELD_HINTS) {
+    cookies.hints = xcb_get_property(conn, 0, window, XCB_ATOM_WM_HINTS,
+                                     XCB_ATOM_WM_HINTS, 0, WM_HINTS_LENGTH);
+  }
+  if (fields & ClientProperties::FIELD_NORMAL_HINTS) {
+    cookies.normal_hints =
+        xcb_get_property(conn, 0, window, XCB_ATOM_WM_NORMAL_HINTS,
+                         XCB_ATOM_WM_SIZE_HINTS, 0, WM_SIZE_HINTS_LENGTH);
+  }
+  if (fields & ClientProperties::FIELD_STATE) {
+    cookies.state = xcb_ewmh_get_wm_state(ewmh, window);
+  }
+  if (fields & ClientProperties::FIELD_PROTOCOLS) {
+    cookies.protocols = xcb_get_property(conn, 0, window, ewmh->WM_PROTOCOLS,
+                                         XCB_ATOM_ATOM, 0, 32);
+  }
+  return cookies;
+}
+
+bool collect(xcb_ewmh_connection_t *ewmh, const Cookies &cookies,
+             ClientProperties &props, bool &override_redirect) {
+  // Every reply is waited for, even if the window turns out to be gone, so
+  // that none of them is left behind in xcb's queue.
+  xcb_generic_error_t *error = nullptr;
+  auto *attributes = xcb_get_window_attributes_reply(
+      ewmh->connection, cookies.attributes, &error);
+  free(error);
+  update(ewmh, cookies, props);
+
+  if (!attributes)
+    return false;
+  override_redirect = attributes->override_redirect;
+  free(attributes);
+  return true;
+}
+
+/**
+ * Each field is reset before it is parsed, so a property the client deleted
+ * or one that no longer parses reads as unset.
+ */
+void update(xcb_ewmh_connection_t *ewmh, const Cookies &cookies,
+            ClientProperties &props) {
+  xcb_connection_t *conn = ewmh->connection;
+
+  if (cookies.fields & ClientProperties::FIELD_TITLE) {
+    auto *name = property_reply(conn, cookies.name);
+    auto *legacy_name = property_reply(conn, cookies.legacy_name);
+    props.title.clear();
+    if (name && xcb_get_property_value_length(name) > 0) {
+      parse_title(name, props.title);
+    } else if (legacy_name) {
+      parse_title(legacy_name, props.title);
+    }
+    free(name);
+    free(legacy_name);
+  }
+
+  if (cookies.fields & ClientProperties::FIELD_CLASS) {
+    auto *wm_class = property_reply(conn, cookies.wm_class);
+    props.instance.clear();
+    props.class_name.clear();
+    if (wm_class)
+      parse_wm_class(wm_class, props);
+    free(wm_class);
+  }
+
+  xcb_ewmh_get_atoms_reply_t atoms;
+  if (cookies.fields & ClientProperties::FIELD_TYPE) {
+    auto *window_type = property_reply(conn, cookies.window_type);
+    props.window_type = XCB_NONE;
+    if (window_type &&
+        xcb_ewmh_get_wm_window_type_from_reply(&atoms, window_type)) {
+      props.window_type = atoms.atoms_len ? atoms.atoms[0] : XCB_NONE;
+      window_type = nullptr; // Now owned by, and freed with, atoms.
+      xcb_ewmh_get_atoms_reply_wipe(&atoms);
+    }
+    free(window_type);
+  }
+
+  if (cookies.fields & ClientProperties::FIELD_STATE) {
+    auto *state = property_reply(conn, cookies.state);
+    props.state.clear();
+    if (state && xcb_ewmh_get_wm_state_from_reply(&atoms, state)) {
+      props.state.assign(atoms.atoms, atoms.atoms + atoms.atoms_len);
+      state = nullptr;
+      xcb_ewmh_get_atoms_reply_wipe(&atoms);
+    }
+    free(state);
+  }
+
+  if (cookies.fields & ClientProperties::FIELD_PROTOCOLS) {
+    auto *protocols = property_reply(conn, cookies.protocols);
+    props.protocols.clear();
+    if (protocols && protocols->type == XCB_ATOM_ATOM &&
+        protocols->format == 32) {
+      auto *values =
+          static_cast<xcb_atom_t *>(xcb_get_property_value(protocols));
+      int count = xcb_get_property_value_length(protocols) / 4;
+      props.protocols.assign(values, values + count);
+    }
+    free(protocols);
+  }
+
+  if (cookies.fields & ClientProperties::FIELD_HINTS) {
+    auto *hints = property_reply(conn, cookies.hints);
+    props.input = true;
+    props.urgent = false;
+    if (hints)
+      parse_hints(hints, props);
+    free(hints);
+  }
+
+  if (cookies.fields & ClientProperties::FIELD_NORMAL_HINTS) {
+    auto *normal_hints = property_reply(conn, cookies.normal_hints);
+    props.min_width = props.min_height = 0;
+    props.max_width = props.max_height = 0;
+    if (normal_hints)
+      parse_normal_hints(normal_hints, props);
+    free(normal_hints);
+  }
+}
+
+uint8_t field_of(const xcb_ewmh_connection_t *ewmh, xcb_atom_t atom) {
+  switch (atom) {
+  case XCB_NONE:
+    return 0;
+  case XCB_ATOM_WM_NAME:
+    return ClientProperties::FIELD_TITLE;
+  case XCB_ATOM_WM_CLASS:
+    return ClientProperties::FIELD_CLASS;
+  case XCB_ATOM_WM_HINTS:
+    return ClientProperties::FIELD_HINTS;
+  case XCB_ATOM_WM_NORMAL_HINTS:
+    return ClientProperties::FIELD_NORMAL_HINTS;
+  default:
+    break;
+  }
+
+  // The EWMH atoms are interned by the server, so they are no constants.
+  if (atom == ewmh->_NET_WM_NAME)
+    return ClientProperties::FIELD_TITLE;
+  if (atom == ewmh->_NET_WM_WINDOW_TYPE)
+    return ClientProperties::FIELD_TYPE;
+  if (atom == ewmh->_NET_WM_STATE)
+    return ClientProperties::FIELD_STATE;
+  if (atom == ewmh->WM_PROTOCOLS)
+    return ClientProperties::FIELD_PROTOCOLS;
+  return 0;
+}
+
+} // namespace Properties
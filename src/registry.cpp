@@ -0,0 +1,75 @@
+#include "include/registry.h"
+#include <utility>
+
+Client &ClientRegistry::insert(xcb_window_t window) {
+  if (auto *client = find(window))
+    return *client;
+
+  index.set(window, static_cast<uint32_t>(slots.size()));
+  slots.emplace_back();
+  slots.back().window = window;
+  return slots.back();
+}
+
+/**
+ * Fills the slot of the client with the last one.
+ */
+bool ClientRegistry::erase(xcb_window_t window) {
+  uint32_t slot = index.find(window);
+  if (slot == WindowIndex::NOT_FOUND)
+    return false;
+
+  index.erase(window);
+  uint32_t last = static_cast<uint32_t>(slots.size()) - 1;
+  if (slot != last) {
+    slots[slot] = std::move(slots[last]);
+    index.set(slots[slot].window, slot);
+  }
+  slots.pop_back();
+  return true;
+}
+
+void ClientRegistry::clear() {
+  slots.clear();
+  index.clear();
+}
+
+void ClientRegistry::push_front(ClientList &list, LinkMember link,
+                                Client &client) {
+  (client.*link).prev = XCB_NONE;
+  (client.*link).next = list.head;
+  if (auto *head = find(list.head)) {
+    (head->*link).prev = client.window;
+  } else {
+    list.tail = client.window;
+  }
+  list.head = client.window;
+}
+
+void ClientRegistry::push_back(ClientList &list, LinkMember link,
+                               Client &client) {
+  (client.*link).prev = list.tail;
+  (client.*link).next = XCB_NONE;
+  if (auto *tail = find(list.tail)) {
+    (tail->*link).next = client.window;
+  } else {
+    list.head = client.window;
+  }
+  list.tail = client.window;
+}
+
+void ClientRegistry::unlink(ClientList &list, LinkMember link,
+                            Client &client) {
+  auto &self = client.*link;
+  if (auto *prev = find(self.prev)) {
+    (prev->*link).next = self.next;
+  } else if (list.head == client.window) {
+    list.head = self.next;
+  }
+  if (auto *next = find(self.next)) {
+    (next->*link).prev = self.prev;
+  } else if (list.tail == client.window) {
+    list.tail = self.prev;
+  }
+  self = {};
+}
@@ -0,0 +1,134 @@
+#include "include/stats.h"
+#include <algorithm>
+#include <cinttypes>
+#include <cstdarg>
+#include <cstdio>
+
+namespace {
+
+/**
+ * The names of the core X events, by response type. Extension events are
+ * named by their number.
+ */
+const char *const core_event_names[] = {
+    "Error",          "Reply",          "KeyPress",         "KeyRelease",
+    "ButtonPress",    "ButtonRelease",  "MotionNotify",     "EnterNotify",
+    "LeaveNotify",    "FocusIn",        "FocusOut",         "KeymapNotify",
+    "Expose",         "GraphicsExpose", "NoExpose",         "VisibilityNotify",
+    "CreateNotify",   "DestroyNotify",  "UnmapNotify",      "MapNotify",
+    "MapRequest",     "ReparentNotify", "ConfigureNotify",  "ConfigureRequest",
+    "GravityNotify",  "ResizeRequest",  "CirculateNotify",  "CirculateRequest",
+    "PropertyNotify", "SelectionClear", "SelectionRequest", "SelectionNotify",
+    "ColormapNotify", "ClientMessage",  "MappingNotify",    "GenericEvent"};
+
+std::string event_name(unsigned type) {
+  if (type < sizeof(core_event_names) / sizeof(*core_event_names))
+    return core_event_names[type];
+  return "Event" + std::to_string(type);
+}
+
+std::string format(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+std::string format(const char *fmt, ...) {
+  char buf[256];
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(buf, sizeof(buf), fmt, args);
+  va_end(args);
+  return buf;
+}
+
+std::string text_line(const std::string &name, const Histogram &h) {
+  return format("%-18s n=%-8" PRIu64 " mean=%-10.0f p50=%-10" PRIu64
+                " p90=%-10" PRIu64 " p99=%-10" PRIu64 " max=%" PRIu64 "\n",
+                name.c_str(), h.count(), h.mean(), h.percentile(50),
+                h.percentile(90), h.percentile(99), h.max());
+}
+
+std::string json_histogram(const Histogram &h) {
+  return format("{\"count\":%" PRIu64 ",\"min\":%" PRIu64 ",\"mean\":%.1f,"
+                "\"p50\":%" PRIu64 ",\"p90\":%" PRIu64 ",\"p99\":%" PRIu64
+                ",\"p999\":%" PRIu64 ",\"max\":%" PRIu64 "}",
+                h.count(), h.min(), h.mean(), h.percentile(50),
+                h.percentile(90), h.percentile(99), h.percentile(99.9),
+                h.max());
+}
+
+} // namespace
+
+uint64_t Histogram::highest(unsigned index) {
+  if (index < SUB_BUCKETS)
+    return index;
+  unsigned exponent = index / SUB_BUCKETS - 1 + SUB_BITS;
+  uint64_t sub = index % SUB_BUCKETS;
+  uint64_t width = uint64_t(1) << (exponent - SUB_BITS);
+  return ((SUB_BUCKETS + sub) << (exponent - SUB_BITS)) + width - 1;
+}
+
+uint64_t Histogram::percentile(double percentile) const {
+  if (!total)
+    return 0;
+
+  auto rank = static_cast<uint64_t>(percentile / 100 * total + 0.5);
+  if (rank < 1)
+    rank = 1;
+
+  uint64_t seen = 0;
+  for (unsigned i = 0; i < BUCKETS; ++i) {
+    seen += buckets[i];
+    if (seen >= rank)
+      return i == BUCKETS - 1 ? max_value : std::min(highest(i), max_value);
+  }
+  return max_value;
+}
+
+void Stats::record_event(uint8_t type, Clock::time_point start) {
+  auto &histogram = events[type];
+  if (!histogram) {
+    histogram = std::make_unique<Histogram>();
+  }
+  record_since(*histogram, start);
+}
+
+std::string Stats::text() const {
+  std::string out = format("Handler latency, ns, 1 in %u batches:\n",
+                           BATCH_SAMPLE);
+  for (unsigned type = 0; type < events.size(); ++type) {
+    if (events[type]) {
+      out += text_line(event_name(type), *events[type]);
+    }
+  }
+
+  out += format("End to end latency, ns, 1 in %u batches:\n", BATCH_SAMPLE);
+  out += text_line("input-to-focus", input_to_focus);
+  out += text_line("map-to-tile", map_to_tile);
+
+  out += format("Counters:\n configures=%" PRIu64 " flushes=%" PRIu64
+                " round_trips=%" PRIu64 " retiles=%" PRIu64 "\n",
+                counters.configures, counters.flushes, counters.round_trips,
+                counters.retiles);
+  return out;
+}
+
+std::string Stats::json() const {
+  std::string out = format("{\"unit\":\"ns\",\"batch_sample\":%u,"
+                           "\"events\":{",
+                           BATCH_SAMPLE);
+  bool first = true;
+  for (unsigned type = 0; type < events.size(); ++type) {
+    if (!events[type])
+      continue;
+    if (!first)
+      out += ',';
+    first = false;
+    out += "\"" + event_name(type) + "\":" + json_histogram(*events[type]);
+  }
+
+  out += "},\"input_to_focus\":" + json_histogram(input_to_focus);
+  out += ",\"map_to_tile\":" + json_histogram(map_to_tile);
+  out += format(",\"counters\":{\"configures\":%" PRIu64 ",\"flushes\":%" PRIu64
+                ",\"round_trips\":%" PRIu64 ",\"retiles\":%" PRIu64 "}}",
+                counters.configures, counters.flushes, counters.round_trips,
+                counters.retiles);
+  return out;
+}
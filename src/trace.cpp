@@ -0,0 +1,259 @@
+#include "include/trace.h"
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+namespace Trace {
+
+namespace {
+
+/**
+ * How much is buffered before it is written out.
+ */
+constexpr size_t WRITE_SIZE = 64 * 1024;
+
+/**
+ * The bytes of an event that are recorded: all of it but the full_sequence
+ * xcb appends.
+ */
+constexpr size_t EVENT_SIZE = 32;
+
+enum PropertyFlags : uint32_t {
+  PROPERTY_OVERRIDE_REDIRECT = 1 << 0,
+  PROPERTY_INPUT = 1 << 1,
+  PROPERTY_URGENT = 1 << 2,
+  PROPERTY_TILED = 1 << 3,
+};
+
+std::runtime_error corrupt() {
+  return std::runtime_error("Truncated or corrupt trace");
+}
+
+} // namespace
+
+Recorder::Recorder(const std::string &path, const Setup &setup)
+    : file(std::fopen(path.c_str(), "wb")),
+      last(std::chrono::steady_clock::now()) {
+  if (!file)
+    throw std::runtime_error("Unable to create " + path + ": " +
+                             std::strerror(errno));
+
+  buffer.reserve(WRITE_SIZE + 1024);
+  for (uint32_t value :
+       {MAGIC, VERSION, uint32_t(setup.root), uint32_t(setup.width),
+        uint32_t(setup.height), uint32_t(setup.shape_base),
+        uint32_t(setup.randr_base)}) {
+    put_u32(value);
+  }
+}
+
+Recorder::~Recorder() {
+  write_out();
+  std::fclose(file);
+}
+
+void Recorder::begin(RecordType type) {
+  auto now = std::chrono::steady_clock::now();
+  auto delta = static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(now - last)
+          .count());
+  // Only the whole microseconds are consumed, so rounding never drifts.
+  last += std::chrono::microseconds(delta);
+
+  buffer += static_cast<char>(type);
+  do {
+    uint8_t byte = delta & 0x7f;
+    delta >>= 7;
+    buffer += static_cast<char>(delta ? byte | 0x80 : byte);
+  } while (delta);
+}
+
+void Recorder::put(const void *data, size_t size) {
+  buffer.append(static_cast<const char *>(data), size);
+}
+
+void Recorder::put_str(const std::string &value) {
+  put_u32(static_cast<uint32_t>(value.size()));
+  put(value.data(), value.size());
+}
+
+void Recorder::write_out() {
+  std::fwrite(buffer.data(), 1, buffer.size(), file);
+  buffer.clear();
+}
+
+void Recorder::event(const xcb_generic_event_t *event) {
+  begin(RECORD_EVENT);
+  put(event, EVENT_SIZE);
+  if (buffer.size() >= WRITE_SIZE) {
+    write_out();
+  }
+}
+
+void Recorder::properties(xcb_window_t window, const ClientProperties &props,
+                          bool override_redirect, bool tiled) {
+  begin(RECORD_PROPERTIES);
+  uint32_t flags = 0;
+  if (override_redirect)
+    flags |= PROPERTY_OVERRIDE_REDIRECT;
+  if (tiled)
+    flags |= PROPERTY_TILED;
+  put_u32(window);
+  put_props(props, flags);
+}
+
+void Recorder::commit() { begin(RECORD_COMMIT); }
+
+void Recorder::refresh(xcb_window_t window, uint8_t fields,
+                       const ClientProperties &props) {
+  begin(RECORD_REFRESH);
+  put_u32(window);
+  put_u32(fields);
+  put_props(props, 0);
+}
+
+/**
+ * Writes the flags, with those of the WM_HINTS added, then the rest of the
+ * properties.
+ */
+void Recorder::put_props(const ClientProperties &props, uint32_t flags) {
+  if (props.input)
+    flags |= PROPERTY_INPUT;
+  if (props.urgent)
+    flags |= PROPERTY_URGENT;
+  put_u32(flags);
+  put_u32(props.window_type);
+  put_str(props.title);
+  put_str(props.instance);
+  put_str(props.class_name);
+  for (const auto *atoms : {&props.state, &props.protocols}) {
+    put_u32(static_cast<uint32_t>(atoms->size()));
+    put(atoms->data(), atoms->size() * sizeof(xcb_atom_t));
+  }
+  for (int size :
+       {props.min_width, props.min_height, props.max_width, props.max_height}) {
+    put_u32(static_cast<uint32_t>(size));
+  }
+}
+
+Player::Player(const std::string &path) {
+  std::FILE *file = std::fopen(path.c_str(), "rb");
+  if (!file)
+    throw std::runtime_error("Unable to open " + path + ": " +
+                             std::strerror(errno));
+
+  char chunk[WRITE_SIZE];
+  size_t n;
+  while ((n = std::fread(chunk, 1, sizeof(chunk), file)) > 0) {
+    data.append(chunk, n);
+  }
+  std::fclose(file);
+
+  if (take_u32() != MAGIC)
+    throw std::runtime_error(path + " is not a trace");
+  if (take_u32() != VERSION)
+    throw std::runtime_error(path + " is a trace of another version");
+
+  header.root = take_u32();
+  header.width = static_cast<uint16_t>(take_u32());
+  header.height = static_cast<uint16_t>(take_u32());
+  header.shape_base = static_cast<uint8_t>(take_u32());
+  header.randr_base = static_cast<uint8_t>(take_u32());
+  start = pos;
+}
+
+void Player::take(void *out, size_t size) {
+  if (size > data.size() - pos)
+    throw corrupt();
+  std::memcpy(out, data.data() + pos, size);
+  pos += size;
+}
+
+std::string Player::take_str() {
+  uint32_t size = take_u32();
+  if (size > data.size() - pos)
+    throw corrupt();
+  std::string value = data.substr(pos, size);
+  pos += size;
+  return value;
+}
+
+/**
+ * Reads what Recorder::put_props() wrote.
+ *
+ * @return The flags.
+ */
+uint32_t Player::take_props(ClientProperties &props) {
+  uint32_t flags = take_u32();
+  props.input = flags & PROPERTY_INPUT;
+  props.urgent = flags & PROPERTY_URGENT;
+  props.window_type = take_u32();
+  props.title = take_str();
+  props.instance = take_str();
+  props.class_name = take_str();
+  for (auto *atoms : {&props.state, &props.protocols}) {
+    uint32_t count = take_u32();
+    if (count > (data.size() - pos) / sizeof(xcb_atom_t))
+      throw corrupt();
+    atoms->resize(count);
+    take(atoms->data(), count * sizeof(xcb_atom_t));
+  }
+  for (int *size : {&props.min_width, &props.min_height, &props.max_width,
+                    &props.max_height}) {
+    *size = static_cast<int>(take_u32());
+  }
+  return flags;
+}
+
+bool Player::next(Record &record) {
+  if (pos == data.size())
+    return false;
+
+  uint8_t type;
+  take(&type, 1);
+  record.type = static_cast<RecordType>(type);
+
+  uint64_t delta = 0;
+  for (unsigned shift = 0;; shift += 7) {
+    uint8_t byte;
+    take(&byte, 1);
+    if (shift > 63)
+      throw corrupt();
+    delta |= uint64_t(byte & 0x7f) << shift;
+    if (!(byte & 0x80))
+      break;
+  }
+  time += delta;
+  record.time = time;
+
+  switch (record.type) {
+  case RECORD_EVENT:
+    std::memset(&record.event, 0, sizeof(record.event));
+    take(&record.event, EVENT_SIZE);
+    break;
+  case RECORD_PROPERTIES: {
+    record.window = take_u32();
+    uint32_t flags = take_props(record.props);
+    record.override_redirect = flags & PROPERTY_OVERRIDE_REDIRECT;
+    record.tiled = flags & PROPERTY_TILED;
+    break;
+  }
+  case RECORD_COMMIT:
+    break;
+  case RECORD_REFRESH:
+    record.window = take_u32();
+    record.fields = static_cast<uint8_t>(take_u32());
+    take_props(record.props);
+    break;
+  default:
+    throw corrupt();
+  }
+  return true;
+}
+
+void Player::rewind() {
+  pos = start;
+  time = 0;
+}
+
+} // namespace Trace
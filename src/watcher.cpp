@@ -0,0 +1,147 @@
+#include "include/watcher.h"
+#include <cstring>
+#include <limits.h>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace {
+
+/**
+ * How long the file has to stay quiet before it is parsed, in milliseconds.
+ * Editors often write a file in several steps.
+ */
+constexpr int SETTLE_MS = 50;
+
+} // namespace
+
+ConfigWatcher::ConfigWatcher(std::string path,
+                             std::shared_ptr<spdlog::logger> logger,
+                             std::function<void()> notify)
+    : path(std::move(path)), logger(std::move(logger)),
+      notify(std::move(notify)) {
+  // The directory is watched rather than the file, so that the watch
+  // survives editors that save by renaming a new file over the old one.
+  auto slash = this->path.rfind('/');
+  std::string dir = slash == std::string::npos ? "." : this->path.substr(0, slash);
+  name = slash == std::string::npos ? this->path : this->path.substr(slash + 1);
+
+  stop_fd = eventfd(0, EFD_CLOEXEC);
+  request_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (stop_fd < 0 || request_fd < 0) {
+    if (stop_fd >= 0)
+      close(stop_fd);
+    throw std::runtime_error("Unable to create the watcher eventfds");
+  }
+
+  inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (inotify_fd < 0 ||
+      inotify_add_watch(inotify_fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) <
+          0) {
+    this->logger->warn("Not watching {}, send SIGHUP to reload it: {}", dir,
+                       std::strerror(errno));
+    if (inotify_fd >= 0)
+      close(inotify_fd);
+    inotify_fd = -1;
+  }
+
+  thread = std::thread(&ConfigWatcher::run, this);
+}
+
+ConfigWatcher::~ConfigWatcher() {
+  uint64_t one = 1;
+  if (write(stop_fd, &one, sizeof(one)) < 0) {
+    logger->error("Unable to stop the config watcher");
+  }
+  thread.join();
+  close(stop_fd);
+  close(request_fd);
+  if (inotify_fd >= 0)
+    close(inotify_fd);
+}
+
+std::optional<Config> ConfigWatcher::take() {
+  std::lock_guard<std::mutex> lock(mutex);
+  std::optional<Config> config = std::move(pending);
+  pending.reset();
+  return config;
+}
+
+void ConfigWatcher::request() {
+  uint64_t one = 1;
+  if (write(request_fd, &one, sizeof(one)) < 0) {
+    logger->error("Unable to ask the config watcher for a reload");
+  }
+}
+
+/**
+ * Reads all queued inotify events.
+ *
+ * @return true if any of them is about the config file.
+ */
+static bool drain(int fd, const std::string &name) {
+  alignas(inotify_event) char buf[4096];
+  bool matched = false;
+  ssize_t len;
+
+  while ((len = read(fd, buf, sizeof(buf))) > 0) {
+    for (char *p = buf; p < buf + len;) {
+      auto *event = reinterpret_cast<inotify_event *>(p);
+      if (event->len && name == event->name)
+        matched = true;
+      p += sizeof(inotify_event) + event->len;
+    }
+  }
+  return matched;
+}
+
+/**
+ * poll() skips the inotify entry when its fd is -1, so a file that is not
+ * watched is only parsed on request().
+ */
+void ConfigWatcher::run() {
+  pollfd fds[] = {
+      {stop_fd, POLLIN, 0}, {request_fd, POLLIN, 0}, {inotify_fd, POLLIN, 0}};
+
+  while (true) {
+    if (poll(fds, 3, -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      logger->error("Config watcher stopped: {}", std::strerror(errno));
+      return;
+    }
+    if (fds[0].revents)
+      return;
+
+    bool requested = false;
+    if (fds[1].revents) {
+      uint64_t count;
+      requested = read(request_fd, &count, sizeof(count)) > 0;
+    }
+    if (fds[2].revents && drain(inotify_fd, name)) {
+      // Wait for the writes to settle before parsing.
+      while (poll(&fds[2], 1, SETTLE_MS) > 0) {
+        drain(inotify_fd, name);
+      }
+      requested = true;
+    }
+    if (requested) {
+      reload();
+    }
+  }
+}
+
+void ConfigWatcher::reload() {
+  try {
+    Config config = loadConfig(path);
+    std::lock_guard<std::mutex> lock(mutex);
+    pending = std::move(config);
+  } catch (const std::exception &e) {
+    logger->warn("Keeping the current config, {} is invalid: {}", path,
+                 e.what());
+    return;
+  }
+  notify();
+}
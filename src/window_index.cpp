@@ -0,0 +1,79 @@
+#include "include/window_index.h"
+
+uint32_t WindowIndex::lookup(xcb_window_t window) const {
+  if (buckets.empty() || window == XCB_NONE)
+    return NOT_FOUND;
+
+  for (uint32_t i = home(window);; i = (i + 1) & mask()) {
+    if (buckets[i].window == window)
+      return i;
+    if (buckets[i].window == XCB_NONE)
+      return NOT_FOUND;
+  }
+}
+
+void WindowIndex::set(xcb_window_t window, uint32_t index) {
+  uint32_t bucket = lookup(window);
+  if (bucket != NOT_FOUND) {
+    buckets[bucket].index = index;
+    return;
+  }
+
+  if ((count + 1) * 2 > buckets.size()) {
+    rehash(buckets.empty() ? 16 : buckets.size() * 2);
+  }
+
+  uint32_t i = home(window);
+  while (buckets[i].window != XCB_NONE) {
+    i = (i + 1) & mask();
+  }
+  buckets[i] = {window, index};
+  ++count;
+}
+
+/**
+ * Backward-shift deletion keeps every probe sequence unbroken without
+ * tombstones.
+ */
+bool WindowIndex::erase(xcb_window_t window) {
+  uint32_t hole = lookup(window);
+  if (hole == NOT_FOUND)
+    return false;
+
+  for (uint32_t j = (hole + 1) & mask(); buckets[j].window != XCB_NONE;
+       j = (j + 1) & mask()) {
+    // The entry at j may fill the hole if the hole lies on its probe path.
+    uint32_t k = home(buckets[j].window);
+    if (((j - k) & mask()) >= ((j - hole) & mask())) {
+      buckets[hole] = buckets[j];
+      hole = j;
+    }
+  }
+  buckets[hole] = {};
+  --count;
+  return true;
+}
+
+void WindowIndex::clear() {
+  buckets.assign(buckets.size(), Bucket{});
+  count = 0;
+}
+
+void WindowIndex::rehash(size_t capacity) {
+  std::vector<Bucket> old(capacity);
+  old.swap(buckets);
+  shift = 64;
+  for (size_t c = capacity; c > 1; c >>= 1) {
+    --shift;
+  }
+
+  for (const Bucket &bucket : old) {
+    if (bucket.window == XCB_NONE)
+      continue;
+    uint32_t i = home(bucket.window);
+    while (buckets[i].window != XCB_NONE) {
+      i = (i + 1) & mask();
+    }
+    buckets[i] = bucket;
+  }
+}